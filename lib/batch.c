@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <log.h>
+#include <nvm.h>
+#include <image.h>
+#include <scheduler.h>
+#include <batch.h>
+
+// Batch mode.
+//
+// All jobs are loaded and spawned up front and then run together by the
+// scheduler, so a batch pays for process start-up, logging and worker
+// threads once. Nothing runs until every job is spawned, so PIDs increase
+// in job order and nvm_batch_finished finds a job by binary search; a
+// later process that reuses the PID of a finished job is ignored. Each
+// job's entry is written by the one worker finishing it and only read
+// after the scheduler has returned.
+
+typedef struct {
+    char* path;
+    uint16_t caps[BATCH_CAPS_MAX];
+    uint8_t caps_count;
+    bool expect;                // Has an expected exit code
+    int32_t expected;
+
+    int32_t pid;                // -1 if it did not start
+    const char* error;          // Why it did not start
+    bool done;
+    int32_t exit_code;
+    uint64_t instructions;
+    uint64_t cpu_ns;
+    uint64_t wall_ns;           // From the start of the batch
+    uint32_t slices;
+} batch_job_t;
+
+bool nvm_batch_active = false;
+
+static batch_job_t* jobs = NULL;
+static uint32_t job_count = 0;
+static uint32_t job_capacity = 0;
+static uint32_t* started = NULL;          // Indexes of the jobs that started
+static uint32_t started_count = 0;
+static uint64_t batch_start = 0;
+
+static batch_job_t* add_job(const char* dir, const char* file) {
+    if(job_count == job_capacity) {
+        uint32_t capacity = job_capacity ? job_capacity * 2 : 64;
+        batch_job_t* grown = realloc(jobs, capacity * sizeof(batch_job_t));
+        if(!grown) {
+            return NULL;
+        }
+        jobs = grown;
+        job_capacity = capacity;
+    }
+
+    // Relative paths are relative to the manifest or directory
+    size_t dir_len = dir && file[0] != '/' ? strlen(dir) : 0;
+    char* path = malloc(dir_len + 1 + strlen(file) + 1);
+    if(!path) {
+        return NULL;
+    }
+    if(dir_len > 0) {
+        sprintf(path, "%s/%s", dir, file);
+    } else {
+        strcpy(path, file);
+    }
+
+    batch_job_t* job = &jobs[job_count++];
+    memset(job, 0, sizeof(batch_job_t));
+    job->path = path;
+    job->pid = -1;
+    return job;
+}
+
+static int by_name(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static bool load_directory(const char* path, const char** error) {
+    DIR* dir = opendir(path);
+    if(!dir) {
+        *error = "Cannot open batch directory";
+        return false;
+    }
+
+    // Sorted, so PIDs and results come in a stable order
+    char** names = NULL;
+    uint32_t count = 0, capacity = 0;
+    struct dirent* entry;
+    bool ok = true;
+    while(ok && (entry = readdir(dir))) {
+        size_t len = strlen(entry->d_name);
+        if(len < 5 || strcmp(entry->d_name + len - 4, ".nvm") != 0) {
+            continue;
+        }
+        if(count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** grown = realloc(names, capacity * sizeof(char*));
+            if(!grown) {
+                ok = false;
+                break;
+            }
+            names = grown;
+        }
+        if(!(names[count] = strdup(entry->d_name))) {
+            ok = false;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    if(ok) {
+        qsort(names, count, sizeof(char*), by_name);
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if(ok && !add_job(path, names[i])) {
+            ok = false;
+        }
+        free(names[i]);
+    }
+    free(names);
+
+    if(!ok) {
+        *error = "Out of memory";
+    }
+    return ok;
+}
+
+// Comma-separated capability ids, or "-" for none
+static bool parse_caps(batch_job_t* job, char* list) {
+    if(strcmp(list, "-") == 0) {
+        return true;
+    }
+
+    for(char* id = strtok(list, ","); id; id = strtok(NULL, ",")) {
+        char* end;
+        long cap = strtol(id, &end, 0);
+        if(*id == '\0' || *end != '\0' || cap < 0 || cap > 0xFFFF || job->caps_count == BATCH_CAPS_MAX) {
+            return false;
+        }
+        job->caps[job->caps_count++] = (uint16_t)cap;
+    }
+    return true;
+}
+
+static bool load_manifest(const char* path, const char** error) {
+    FILE* file = fopen(path, "r");
+    if(!file) {
+        *error = "Cannot open batch manifest";
+        return false;
+    }
+
+    char* dir = strdup(path);
+    char* slash = dir ? strrchr(dir, '/') : NULL;
+    if(slash) {
+        *slash = '\0';
+    }
+
+    char line[4096];
+    bool ok = dir != NULL;
+    *error = "Out of memory";
+    while(ok && fgets(line, sizeof(line), file)) {
+        char* comment = strchr(line, '#');
+        if(comment) {
+            *comment = '\0';
+        }
+
+        char* fields[4];
+        int count = 0;
+        char* save;
+        for(char* field = strtok_r(line, " \t\r\n", &save); field; field = strtok_r(NULL, " \t\r\n", &save)) {
+            if(count == 4) {
+                break;
+            }
+            fields[count++] = field;
+        }
+        if(count == 0) {
+            continue;
+        }
+
+        batch_job_t* job = count <= 3 ? add_job(slash ? dir : NULL, fields[0]) : NULL;
+        if(!job) {
+            *error = count > 3 ? "Too many fields in batch manifest" : "Out of memory";
+            ok = false;
+            break;
+        }
+        if(count > 1 && !parse_caps(job, fields[1])) {
+            *error = "Invalid capabilities in batch manifest";
+            ok = false;
+            break;
+        }
+        if(count > 2) {
+            char* end;
+            long expected = strtol(fields[2], &end, 0);
+            if(*end != '\0' || expected < INT32_MIN || expected > INT32_MAX) {
+                *error = "Invalid exit code in batch manifest";
+                ok = false;
+                break;
+            }
+            job->expect = true;
+            job->expected = (int32_t)expected;
+        }
+    }
+
+    fclose(file);
+    free(dir);
+    return ok;
+}
+
+bool nvm_batch_load(const char* path, const char** error) {
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        *error = "Cannot find batch";
+        return false;
+    }
+
+    bool ok = S_ISDIR(st.st_mode) ? load_directory(path, error) : load_manifest(path, error);
+    if(ok && job_count == 0) {
+        *error = "Batch has no jobs";
+        ok = false;
+    }
+    nvm_batch_active = ok;
+    return ok;
+}
+
+uint32_t nvm_batch_start() {
+    started = malloc(job_count * sizeof(uint32_t));
+    if(!started) {
+        return 0;
+    }
+    batch_start = nvm_now_ns();
+
+    for(uint32_t i = 0; i < job_count; i++) {
+        batch_job_t* job = &jobs[i];
+        nvm_image_t* image = nvm_image_open(job->path, &job->error);
+        if(!image) {
+            continue;
+        }
+
+        job->pid = nvm_spawn_image(image, job->caps, job->caps_count);
+        nvm_image_release(image);
+        if(job->pid < 0) {
+            job->error = "Cannot start process";
+            continue;
+        }
+        started[started_count++] = i;
+    }
+    return started_count;
+}
+
+void nvm_batch_finished(nvm_process_t* proc) {
+    if(!nvm_batch_active) {
+        return;
+    }
+
+    // Jobs that started have increasing PIDs
+    uint32_t low = 0, high = started_count;
+    while(low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        batch_job_t* job = &jobs[started[mid]];
+        if(job->pid < (int32_t)proc->pid) {
+            low = mid + 1;
+        } else if(job->pid > (int32_t)proc->pid) {
+            high = mid;
+        } else {
+            // A later process can reuse the PID of a finished job
+            if(!job->done) {
+                job->done = true;
+                job->exit_code = proc->exit_code;
+                job->instructions = proc->retired;
+                job->cpu_ns = proc->cpu_ns;
+                job->slices = proc->slices;
+                job->wall_ns = nvm_now_ns() - batch_start;
+            }
+            return;
+        }
+    }
+}
+
+bool nvm_batch_report(const char* path) {
+    FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if(!out) {
+        fprintf(stderr, "Error: Cannot write batch results: '%s'\n", path);
+        return false;
+    }
+
+    bool passed = true;
+    fprintf(out, "file\tpid\tresult\texit_code\texpected\tinstructions\tcpu_us\twall_us\tslices\terror\n");
+    for(uint32_t i = 0; i < job_count; i++) {
+        const batch_job_t* job = &jobs[i];
+        const char* result;
+        if(job->pid < 0 || !job->done) {
+            result = "error";
+            passed = false;
+        } else if(!job->expect) {
+            result = "done";
+        } else if(job->exit_code == job->expected) {
+            result = "pass";
+        } else {
+            result = "fail";
+            passed = false;
+        }
+
+        fprintf(out, "%s\t%d\t%s\t", job->path, job->pid, result);
+        if(job->done) {
+            fprintf(out, "%d\t", job->exit_code);
+        } else {
+            fprintf(out, "-\t");
+        }
+        if(job->expect) {
+            fprintf(out, "%d\t", job->expected);
+        } else {
+            fprintf(out, "-\t");
+        }
+        if(job->done) {
+            fprintf(out, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%u\t-\n", job->instructions,
+                    job->cpu_ns / 1000, job->wall_ns / 1000, job->slices);
+        } else {
+            fprintf(out, "-\t-\t-\t-\t%s\n", job->error ? job->error : "Did not finish");
+        }
+    }
+
+    if(out == stdout) {
+        fflush(out);
+    } else {
+        fclose(out);
+    }
+    return passed;
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Capabilities one manifest entry can list
+#define BATCH_CAPS_MAX 16
+
+// Set by nvm_batch_load
+extern bool nvm_batch_active;
+
+// Read the jobs of a batch: every *.nvm file of a directory, or the lines
+// of a manifest, `file [caps [expected_exit_code]]`. On failure returns
+// false and sets *error.
+bool nvm_batch_load(const char* path, const char** error);
+
+// Spawn every job, returns how many started. Call after nvm_init.
+uint32_t nvm_batch_start();
+
+// Record the result of a stopped process, called by nvm_process_finished
+void nvm_batch_finished(nvm_process_t* proc);
+
+// Write one tab-separated line per job to `path` ("-" for stdout). Returns
+// false if a job did not start or missed its expected exit code.
+bool nvm_batch_report(const char* path);
+
+#endif // BATCH_H
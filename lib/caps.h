@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <nvm.h>
 
 #define CAPS_NONE             0x0000
@@ -20,14 +21,36 @@
 #define CAP_DRV_GROUP_NETWORK 0x0400
 #define CAP_ALL               0xFFFF
 
-// Check if process has a specific capability
-static inline bool caps_has_capability(nvm_process_t* proc, int16_t cap) {
-    for(int i = 0; i < proc->caps_count; i++) {
-        if(proc->capabilities[i] == cap) {
-            return true;
-        }
+// Capabilities are held as one nvm_caps_t bitset: ids 0x01..0x2F take bits
+// 1..47 and the groups 0x0100..0x0F00 the group mask in bits 49..63.
+// CAP_ALL sets every bit. Bit 0 stands for any other id, which only a
+// CAP_ALL holder has; CAPS_NONE needs no bit and is always held.
+#define CAPS_GROUP_MASK 0xFFFE000000000000ull
+#define CAPS_BIT(cap)                                                           \
+    ((cap) == CAPS_NONE ? 0ull :                                                \
+     (cap) == CAP_ALL ? ~0ull :                                                 \
+     (cap) < 48 ? 1ull << (cap) :                                               \
+     ((cap) & 0xFF) == 0 && ((cap) >> 8) < 16 ? 1ull << (48 + ((cap) >> 8)) :   \
+     1ull)
+
+// Results of the grant and revoke syscalls
+#define CAPS_OK        0
+#define CAPS_NO_PROC  -1    // No such process
+#define CAPS_NOT_HELD -2    // Granter lacks the capability itself
+
+// Bitset for a list of capability ids
+static inline nvm_caps_t caps_from_list(const uint16_t* caps, uint8_t count) {
+    nvm_caps_t bits = 0;
+    for(int i = 0; i < count; i++) {
+        bits |= caps[i] == CAP_ALL ? ~0ull : CAPS_BIT(caps[i]) & ~1ull;
     }
-    return false;
+    return bits;
+}
+
+// Check if process has a specific capability
+static inline bool caps_has_capability(nvm_process_t* proc, uint16_t cap) {
+    nvm_caps_t bit = CAPS_BIT(cap);
+    return (atomic_load_explicit(&proc->caps, memory_order_relaxed) & bit) == bit;
 }
 
 #endif // CAPS_H
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <nvm.h>
+#include <console.h>
+#include <log.h>
+
+// Console output.
+//
+// Each process collects what it prints in its own buffer and hands it to
+// the kernel with writev. A full buffer is written up to its last complete
+// line, so lines of different processes do not interleave unless one is
+// longer than the buffer. While the log goes to stdout as well, output is
+// passed through the log writer so the two stay in order.
+//
+// Under CONSOLE_FLUSH_EXIT a process that outgrows its buffer moves its
+// output to a heap block, doubled as needed up to CONSOLE_HOLD_MAX bytes.
+// Past that, or when the block cannot grow, output is written the way a
+// full buffer is. The block is freed when the output is flushed.
+
+nvm_console_policy_t nvm_console_policy = CONSOLE_FLUSH_LINE;
+uint32_t nvm_console_size = CONSOLE_BUFFER;
+
+static void write_out(struct iovec* iov, int count) {
+    if(log_shares_stdout()) {
+        for(int i = 0; i < count; i++) {
+            log_stdout(iov[i].iov_base, iov[i].iov_len);
+        }
+        return;
+    }
+
+    while(count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        while(count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+}
+
+// Make room for len more bytes if that stays within CONSOLE_HOLD_MAX
+static void hold(nvm_console_t* console, uint32_t len) {
+    if(len > CONSOLE_HOLD_MAX - console->len) {
+        return;
+    }
+
+    uint32_t size = console->size;
+    while(size < console->len + len) {
+        size = size > CONSOLE_HOLD_MAX / 2 ? CONSOLE_HOLD_MAX : size * 2;
+    }
+    char* data = console->data == console->buffer ? malloc(size) : realloc(console->data, size);
+    if(!data) {
+        return;
+    }
+    if(console->data == console->buffer) {
+        memcpy(data, console->buffer, console->len);
+    }
+    console->data = data;
+    console->size = size;
+}
+
+void nvm_console_init(nvm_console_t* console) {
+    console->len = 0;
+    console->size = CONSOLE_BUFFER;
+    console->data = console->buffer;
+}
+
+void nvm_console_flush(nvm_console_t* console) {
+    if(console->len > 0) {
+        struct iovec iov = {console->data, console->len};
+        write_out(&iov, 1);
+        console->len = 0;
+    }
+
+    if(console->data != console->buffer) {
+        free(console->data);
+        console->size = CONSOLE_BUFFER;
+        console->data = console->buffer;
+    }
+}
+
+void nvm_console_write(nvm_console_t* console, const char* data, uint32_t len) {
+    uint32_t limit = nvm_console_size;
+    if(nvm_console_policy == CONSOLE_FLUSH_EXIT) {
+        if(len > console->size - console->len) {
+            hold(console, len);
+        }
+        limit = console->size;
+    }
+
+    if(len > limit - console->len) {
+        uint32_t lines = console->len;
+        while(lines > 0 && console->data[lines - 1] != '\n') {
+            lines--;
+        }
+
+        if(lines > 0 && console->len - lines + len <= limit) {
+            // Write the complete lines and keep the unfinished one
+            struct iovec iov = {console->data, lines};
+            write_out(&iov, 1);
+            memmove(console->data, console->data + lines, console->len - lines);
+            console->len -= lines;
+        } else {
+            // Buffered output and the new data in one go
+            struct iovec iov[2] = {{console->data, console->len}, {(void*)data, len}};
+            write_out(console->len ? iov : iov + 1, console->len ? 2 : 1);
+            console->len = 0;
+            return;
+        }
+    }
+
+    memcpy(console->data + console->len, data, len);
+    console->len += len;
+
+    if(nvm_console_policy == CONSOLE_FLUSH_NONE ||
+       (nvm_console_policy == CONSOLE_FLUSH_LINE && memchr(data, '\n', len))) {
+        nvm_console_flush(console);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+#ifndef CONSOLE_BUFFER
+#define CONSOLE_BUFFER 1024         // Bytes of output a process holds back
+#endif
+
+#ifndef CONSOLE_HOLD_MAX
+#define CONSOLE_HOLD_MAX (1u << 20) // Most bytes CONSOLE_FLUSH_EXIT holds back
+#endif
+
+// When a process's buffered output is written
+typedef enum {
+    CONSOLE_FLUSH_NONE = 0,         // After every print
+    CONSOLE_FLUSH_LINE = 1,         // After a print that ends a line
+    CONSOLE_FLUSH_FULL = 2,         // When nvm_console_size bytes are buffered
+    CONSOLE_FLUSH_EXIT = 3          // When the process stops, or CONSOLE_HOLD_MAX bytes are held
+} nvm_console_policy_t;
+
+extern nvm_console_policy_t nvm_console_policy;
+
+// Bytes buffered before a write, 1 to CONSOLE_BUFFER
+extern uint32_t nvm_console_size;
+
+// Output of one process, written only while the process runs
+struct nvm_console {
+    _Alignas(64) uint32_t len;
+    uint32_t size;                  // Bytes data holds
+    char* data;                     // buffer, or a larger block under CONSOLE_FLUSH_EXIT
+    char buffer[CONSOLE_BUFFER];
+};
+
+void nvm_console_init(nvm_console_t* console);
+void nvm_console_write(nvm_console_t* console, const char* data, uint32_t len);
+void nvm_console_flush(nvm_console_t* console);
+
+#endif // CONSOLE_H
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <verify.h>
+
+// Fused instructions replace the first instruction of a sequence and skip
+// over the rest. The originals stay in the following slots, so jumps into
+// the middle of a sequence and the offset map keep working. Fusion never
+// crosses a control transfer except a trailing branch, so the run checks
+// computed by nvm_verify cover the fused forms as well: a fused instruction
+// only executes when none of its originals could have failed, and any run
+// that fails its check is handed to nvm_execute_instruction unfused.
+
+bool nvm_fuse_enabled = true;
+
+const char* const nvm_fusion_names[NVM_FUSION_KINDS] = {
+    "LOAD_PUSH_CMP_BRANCH",
+    "INC_LOCAL",
+    "DEC_LOCAL",
+    "PUSH_ADD",
+};
+
+static bool is_compare(uint8_t op) {
+    return op == OP_GT || op == OP_LT || op == OP_EQ || op == OP_NEQ;
+}
+
+uint32_t nvm_fuse(nvm_program_t* program, uint32_t counts[NVM_FUSION_KINDS]) {
+    nvm_insn_t* code = program->code;
+    uint32_t count = program->count;
+    uint32_t total = 0;
+
+    for(int k = 0; k < NVM_FUSION_KINDS; k++) {
+        counts[k] = 0;
+    }
+
+    for(uint32_t i = 0; i < count;) {
+        nvm_insn_t* insn = &code[i];
+
+        // load N; push K; <cmp>; jz|jnz L
+        if(i + 3 < count && insn->op == OP_LOAD && code[i + 1].op == OP_PUSH &&
+           is_compare(code[i + 2].op) &&
+           (code[i + 3].op == OP_JZ || code[i + 3].op == OP_JNZ)) {
+            insn->aux[0] = code[i + 2].op;
+            insn->aux[1] = code[i + 3].op == OP_JNZ;
+            insn->aux[2] = (uint8_t)insn->arg;
+            insn->arg = code[i + 1].arg;
+            insn->op = OP_LOAD_PUSH_CMP_BRANCH;
+            counts[0]++;
+            total++;
+            i += 4;
+            continue;
+        }
+
+        // load N; push K; add|sub; store N
+        if(i + 3 < count && insn->op == OP_LOAD && code[i + 1].op == OP_PUSH &&
+           (code[i + 2].op == OP_ADD || code[i + 2].op == OP_SUB) &&
+           code[i + 3].op == OP_STORE && code[i + 3].arg == insn->arg) {
+            bool inc = code[i + 2].op == OP_ADD;
+            insn->aux[2] = (uint8_t)insn->arg;
+            insn->arg = code[i + 1].arg;
+            insn->op = inc ? OP_INC_LOCAL : OP_DEC_LOCAL;
+            counts[inc ? 1 : 2]++;
+            total++;
+            i += 4;
+            continue;
+        }
+
+        // push K; add
+        if(i + 1 < count && insn->op == OP_PUSH && code[i + 1].op == OP_ADD) {
+            insn->op = OP_PUSH_ADD;
+            counts[3]++;
+            total++;
+            i += 2;
+            continue;
+        }
+
+        i++;
+    }
+
+    return total;
+}
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <nvm.h>
+#include <heap.h>
+
+// Linear memory.
+//
+// A process can have one linear memory, addressed by byte from 0 and grown
+// a page at a time by MEM_GROW. The first grow reserves HEAP_MAX_PAGES
+// pages plus HEAP_GUARD bytes with one PROT_NONE mapping; growing makes the
+// next pages accessible and never moves the base, so the interpreter and
+// native code can hold on to proc->heap. Every access is checked against
+// heap_size, the inaccessible pages behind it only make sure an access that
+// slipped past a check faults instead of reaching other memory.
+//
+// A restored snapshot maps its memory privately from the snapshot's file
+// over the start of the reservation, so pages are only copied once written.
+//
+// Bulk operations run as one libc call over the whole range.
+
+#define HEAP_RESERVE ((size_t)HEAP_MAX_PAGES * HEAP_PAGE + HEAP_GUARD)
+
+uint32_t nvm_heap_initial = 0;
+
+static bool reserve(nvm_process_t* proc) {
+    void* base = mmap(NULL, HEAP_RESERVE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED) {
+        return false;
+    }
+    proc->heap = base;
+    return true;
+}
+
+int32_t nvm_heap_grow(nvm_process_t* proc, int32_t pages) {
+    uint32_t old = proc->heap_size / HEAP_PAGE;
+
+    if(pages < 0 || (uint32_t)pages > HEAP_MAX_PAGES - old) {
+        return -1;
+    }
+    if(pages == 0) {
+        return (int32_t)old;
+    }
+
+    if(!proc->heap && !reserve(proc)) {
+        return -1;
+    }
+
+    size_t grow = (size_t)pages * HEAP_PAGE;
+    if(mprotect(proc->heap + proc->heap_size, grow, PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+    proc->heap_size += (uint32_t)grow;
+    return (int32_t)old;
+}
+
+void nvm_heap_free(nvm_process_t* proc) {
+    if(proc->heap) {
+        munmap(proc->heap, HEAP_RESERVE);
+    }
+    proc->heap = NULL;
+    proc->heap_size = 0;
+}
+
+bool nvm_heap_map(nvm_process_t* proc, int fd, uint32_t size) {
+    if(size == 0) {
+        nvm_heap_free(proc);
+        return true;
+    }
+    if(!proc->heap && !reserve(proc)) {
+        return false;
+    }
+
+    // Drop what the old memory had beyond the new size
+    if(proc->heap_size > size &&
+       mmap(proc->heap + size, proc->heap_size - size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        nvm_heap_free(proc);
+        return false;
+    }
+    if(mmap(proc->heap, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        nvm_heap_free(proc);
+        return false;
+    }
+    proc->heap_size = size;
+    return true;
+}
+
+bool nvm_heap_copy(nvm_process_t* proc, uint32_t dst, uint32_t src, uint32_t n) {
+    if(!nvm_heap_ok(proc, dst, n) || !nvm_heap_ok(proc, src, n)) {
+        return false;
+    }
+    if(n > 0) {
+        memmove(proc->heap + dst, proc->heap + src, n);
+    }
+    return true;
+}
+
+bool nvm_heap_fill(nvm_process_t* proc, uint32_t dst, int32_t value, uint32_t n) {
+    if(!nvm_heap_ok(proc, dst, n)) {
+        return false;
+    }
+    if(n > 0) {
+        memset(proc->heap + dst, value & 0xFF, n);
+    }
+    return true;
+}
+
+int32_t nvm_heap_compare(nvm_process_t* proc, uint32_t a, uint32_t b, uint32_t n) {
+    if(!nvm_heap_ok(proc, a, n) || !nvm_heap_ok(proc, b, n)) {
+        return NVM_HEAP_FAULT;
+    }
+    if(n == 0) {
+        return 0;
+    }
+
+    int result = memcmp(proc->heap + a, proc->heap + b, n);
+    return (result > 0) - (result < 0);
+}
@@ -0,0 +1,66 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+#define HEAP_PAGE  65536            // Bytes per page, the unit MEM_GROW works in
+
+// Pages a process can grow its linear memory to
+#ifndef HEAP_MAX_PAGES
+#define HEAP_MAX_PAGES 1024
+#endif
+
+#define HEAP_GUARD HEAP_PAGE        // Inaccessible bytes after the largest heap
+
+// Pages every process starts with, no capability needed for those
+extern uint32_t nvm_heap_initial;
+
+// MEMCMP result for an access out of bounds
+#define NVM_HEAP_FAULT 2
+
+// Add `pages` pages to the linear memory of the process, which is reserved
+// on first use. Returns the previous size in pages, -1 if the memory cannot
+// grow that far.
+int32_t nvm_heap_grow(nvm_process_t* proc, int32_t pages);
+
+// Release the linear memory of a process that stopped
+void nvm_heap_free(nvm_process_t* proc);
+
+// Replace the linear memory with a private copy-on-write mapping of the
+// first `size` bytes of file `fd`, a multiple of HEAP_PAGE
+bool nvm_heap_map(nvm_process_t* proc, int fd, uint32_t size);
+
+// Bulk operations, false (NVM_HEAP_FAULT for compare) when a range is out
+// of bounds. Copies may overlap; compare returns -1, 0 or 1 like memcmp.
+bool nvm_heap_copy(nvm_process_t* proc, uint32_t dst, uint32_t src, uint32_t n);
+bool nvm_heap_fill(nvm_process_t* proc, uint32_t dst, int32_t value, uint32_t n);
+int32_t nvm_heap_compare(nvm_process_t* proc, uint32_t a, uint32_t b, uint32_t n);
+
+// `len` bytes from `addr` lie inside the linear memory
+static inline bool nvm_heap_ok(const nvm_process_t* proc, uint32_t addr, uint32_t len) {
+    return (uint64_t)addr + len <= proc->heap_size;
+}
+
+// Little-endian loads and stores of 1, 2 or 4 bytes at a checked address;
+// values shorter than 4 bytes are zero-extended
+static inline int32_t nvm_heap_load(const nvm_process_t* proc, uint32_t addr, uint32_t width) {
+    const uint8_t* p = proc->heap + addr;
+    uint32_t value = p[0];
+    if(width >= 2) value |= (uint32_t)p[1] << 8;
+    if(width == 4) value |= (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    return (int32_t)value;
+}
+
+static inline void nvm_heap_store(nvm_process_t* proc, uint32_t addr, uint32_t width, int32_t value) {
+    uint8_t* p = proc->heap + addr;
+    p[0] = (uint8_t)value;
+    if(width >= 2) p[1] = (uint8_t)(value >> 8);
+    if(width == 4) {
+        p[2] = (uint8_t)(value >> 16);
+        p[3] = (uint8_t)(value >> 24);
+    }
+}
+
+#endif // HEAP_H
@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <log.h>
+#include <nvm.h>
+#include <verify.h>
+#include <jit.h>
+#include <image.h>
+
+// Image cache.
+//
+// Files are mapped read-only and processes run straight off the mapping.
+// Images are keyed by a hash of their contents, so every process running
+// the same bytes shares one mapping and one verified program, and the JIT
+// compiles it once. A file already in the cache is found by device, inode,
+// size and mtime without being mapped again; a rewritten file gets a new
+// mtime or inode and is loaded afresh. Files must not be truncated in place
+// while they run.
+//
+// Unreferenced images stay cached, up to IMAGE_CACHE_IDLE of them, with the
+// least recently used one going first.
+//
+// A compiled image holds the bytecode followed by the decoded program
+// exactly as it sits in memory, so loading one is a mapping and one linear
+// check of the arrays against the bytecode, instead of decoding, verifying
+// and fusing; the program's arrays then point straight into the file. It is
+// used in place of prog.nvm when prog.nvmc next to it was compiled from the
+// same bytes, in a file of the same size and mtime, by this VM version and
+// with the same fusion setting; otherwise prog.nvm is verified as usual.
+// nvm_verify_decoded rejects anything nvm_verify and nvm_fuse would not have
+// produced from the bytecode, so a forged image can do no more than the
+// bytecode it carries. The check and reading the file, about ten times the
+// size of the bytecode, take about half as long as verifying and fusing.
+//
+// A checksum over everything after the header catches damaged files run on
+// their own. A sidecar skips it: its bytecode is compared with prog.nvm and
+// its arrays are checked against that, which leaves nothing for the
+// checksum to find but the fusion counts reported at DEBUG level.
+
+#define NVMC_FUSED 0x01
+
+typedef struct {
+    char magic[4];                      // NVMC_MAGIC
+    uint32_t version;                   // NVMC_VERSION, host byte order
+    uint32_t flags;
+    uint32_t size;                      // Bytecode bytes
+    uint32_t count;                     // Instructions
+    uint32_t fusions[NVM_FUSION_KINDS];
+    uint32_t reserved;
+    uint64_t hash;                      // Of the bytecode
+    int64_t mtime_sec;                  // Bytecode file it was compiled from
+    int64_t mtime_nsec;
+    uint64_t checksum;                  // Of everything after the header
+} nvmc_header_t;
+
+static nvm_image_t* images = NULL;          // Most recently used first
+static uint32_t idle = 0;                   // Images with refs == 0
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t hash_bytes(const uint8_t* bytes, uint32_t size) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    uint32_t i = 0;
+
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    for(; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static void image_free(nvm_image_t* image) {
+    nvm_program_free(image->program);
+    if(image->map) {
+        munmap(image->map, image->map_size);
+    } else {
+        free((void*)image->bytes);
+    }
+    free(image);
+}
+
+// Move a cache hit to the front and take a reference, under cache_lock
+static nvm_image_t* hit(nvm_image_t** link) {
+    nvm_image_t* image = *link;
+    *link = image->next;
+    image->next = images;
+    images = image;
+
+    if(image->refs++ == 0) {
+        idle--;
+    }
+    return image;
+}
+
+static nvm_image_t* find_file(const struct stat* st) {
+    for(nvm_image_t** link = &images; *link; link = &(*link)->next) {
+        nvm_image_t* image = *link;
+        if(image->map && image->fused == nvm_fuse_enabled &&
+           image->dev == st->st_dev && image->ino == st->st_ino &&
+           image->file_size == st->st_size &&
+           image->mtime.tv_sec == st->st_mtim.tv_sec && image->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            return hit(link);
+        }
+    }
+    return NULL;
+}
+
+static nvm_image_t* find_content(const uint8_t* bytes, uint32_t size, uint64_t hash) {
+    for(nvm_image_t** link = &images; *link; link = &(*link)->next) {
+        nvm_image_t* image = *link;
+        if(image->hash == hash && image->size == size && image->fused == nvm_fuse_enabled &&
+           memcmp(image->bytes, bytes, size) == 0) {
+            return hit(link);
+        }
+    }
+    return NULL;
+}
+
+// Publish a new image unless another thread cached the same contents
+// meanwhile
+static nvm_image_t* publish(nvm_image_t* image) {
+    pthread_mutex_lock(&cache_lock);
+    nvm_image_t* cached = find_content(image->bytes, image->size, image->hash);
+    if(!cached) {
+        image->refs = 1;
+        image->next = images;
+        images = image;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    if(cached) {
+        image_free(image);
+        return cached;
+    }
+    return image;
+}
+
+static nvm_image_t* image_new(const uint8_t* bytes, uint32_t size, uint64_t hash, void* map,
+                              size_t map_size, const struct stat* st) {
+    nvm_image_t* image = calloc(1, sizeof(nvm_image_t));
+    if(!image) {
+        if(map) {
+            munmap(map, map_size);
+        } else {
+            free((void*)bytes);
+        }
+        return NULL;
+    }
+
+    image->bytes = bytes;
+    image->size = size;
+    image->hash = hash;
+    image->map = map;
+    image->map_size = map_size;
+    image->fused = nvm_fuse_enabled;
+    if(st) {
+        image->dev = st->st_dev;
+        image->ino = st->st_ino;
+        image->file_size = st->st_size;
+        image->mtime = st->st_mtim;
+    }
+    return image;
+}
+
+// Verify and fuse outside the lock, then publish. Takes ownership of the
+// bytes, or of the mapping holding them.
+static nvm_image_t* insert(const uint8_t* bytes, uint32_t size, uint64_t hash, void* map,
+                           size_t map_size, const struct stat* st) {
+    nvm_image_t* image = image_new(bytes, size, hash, map, map_size, st);
+    if(!image) {
+        return NULL;
+    }
+
+    image->program = nvm_verify(bytes, size, &image->reason);
+    if(image->program && image->fused) {
+        nvm_fuse(image->program, image->fusions);
+    }
+    return publish(image);
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static size_t compiled_size(uint32_t size, uint32_t count) {
+    return sizeof(nvmc_header_t) + align8(size) +
+           (size_t)count * (sizeof(nvm_insn_t) + sizeof(nvm_block_t) + sizeof(uint32_t)) +
+           (size_t)size * sizeof(uint32_t);
+}
+
+// Whether a mapped file is a compiled image this VM can use as it is;
+// if not, returns why
+static const char* check_compiled(const uint8_t* map, size_t map_size, bool checksum) {
+    const nvmc_header_t* head = (const nvmc_header_t*)map;
+    if(map_size < sizeof(nvmc_header_t) || memcmp(head->magic, NVMC_MAGIC, 4) != 0) {
+        return "Not a compiled image";
+    }
+    if(head->version != NVMC_VERSION) {
+        return "Compiled by another VM version";
+    }
+    if(head->size < 4 || head->count == 0 || map_size > UINT32_MAX ||
+       map_size != compiled_size(head->size, head->count)) {
+        return "Compiled image size does not match its header";
+    }
+    if(checksum &&
+       hash_bytes(map + sizeof(nvmc_header_t), (uint32_t)(map_size - sizeof(nvmc_header_t))) != head->checksum) {
+        return "Compiled image checksum mismatch";
+    }
+    return NULL;
+}
+
+// Image running the program of a checked compiled image, straight off the
+// mapping, or NULL and why not. Takes ownership of the mapping.
+static nvm_image_t* load_compiled(uint8_t* map, size_t map_size, const struct stat* st, const char** error) {
+    const nvmc_header_t* head = (const nvmc_header_t*)map;
+    const uint8_t* bytes = map + sizeof(nvmc_header_t);
+    nvm_image_t* image = image_new(bytes, head->size, head->hash, map, map_size, st);
+    if(!image) {
+        *error = "Memory allocation failed";
+        return NULL;
+    }
+
+    nvm_program_t* program = calloc(1, sizeof(nvm_program_t));
+    if(!program) {
+        image_free(image);
+        *error = "Memory allocation failed";
+        return NULL;
+    }
+    uint8_t* at = map + sizeof(nvmc_header_t) + align8(head->size);
+    program->code = (nvm_insn_t*)at;
+    at += head->count * sizeof(nvm_insn_t);
+    program->blocks = (nvm_block_t*)at;
+    at += head->count * sizeof(nvm_block_t);
+    program->offsets = (uint32_t*)at;
+    at += head->count * sizeof(uint32_t);
+    program->index = (uint32_t*)at;
+    program->count = head->count;
+    program->size = head->size;
+    program->mapped = true;
+    program->jit_countdown = NVM_JIT_THRESHOLD;
+
+    // The capabilities come from the bytecode as well, not from the header
+    image->program = program;
+    const char* reason;
+    if(!nvm_verify_decoded(program, bytes, &reason)) {
+        LOG_DEBUG("Compiled image rejected: %s\n", reason);
+        image_free(image);
+        *error = "Compiled image does not match its bytecode";
+        return NULL;
+    }
+    memcpy(image->fusions, head->fusions, sizeof(image->fusions));
+    return publish(image);
+}
+
+// Compiled image next to a bytecode file, if it was compiled from the same
+// bytes; `bytes` and `hash` are the bytecode file's
+static nvm_image_t* open_sidecar(const char* path, const struct stat* source, const uint8_t* bytes,
+                                 uint64_t hash) {
+    size_t len = strlen(path);
+    if(len < 4 || strcmp(path + len - 4, ".nvm") != 0) {
+        return NULL;
+    }
+
+    char* sidecar = malloc(len + 2);
+    if(!sidecar) {
+        return NULL;
+    }
+    memcpy(sidecar, path, len);
+    strcpy(sidecar + len, "c");
+
+    int fd = open(sidecar, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(nvmc_header_t)) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        free(sidecar);
+        return NULL;
+    }
+
+    size_t map_size = (size_t)st.st_size;
+    uint8_t* map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        free(sidecar);
+        return NULL;
+    }
+
+    const nvmc_header_t* head = (const nvmc_header_t*)map;
+    const char* reason = check_compiled(map, map_size, false);
+    if(!reason && (head->size != source->st_size || head->mtime_sec != source->st_mtim.tv_sec ||
+                   head->mtime_nsec != source->st_mtim.tv_nsec)) {
+        reason = "Older than its bytecode";
+    }
+    if(!reason && (head->hash != hash || memcmp(map + sizeof(nvmc_header_t), bytes, head->size) != 0)) {
+        reason = "Compiled from other bytecode";
+    }
+    if(!reason && (head->flags & NVMC_FUSED) != (nvm_fuse_enabled ? NVMC_FUSED : 0)) {
+        reason = "Compiled with another fusion setting";
+    }
+    if(reason) {
+        LOG_DEBUG("Not using %s: %s\n", sidecar, reason);
+        munmap(map, map_size);
+        free(sidecar);
+        return NULL;
+    }
+
+    nvm_image_t* image = load_compiled(map, map_size, source, &reason);
+    if(image) {
+        LOG_DEBUG("Using compiled image %s\n", sidecar);
+    } else {
+        LOG_DEBUG("Not using %s: %s\n", sidecar, reason);
+    }
+    free(sidecar);
+    return image;
+}
+
+nvm_image_t* nvm_image_open(const char* path, const char** error) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        *error = "Cannot open file";
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        *error = "Not a regular file";
+        return NULL;
+    }
+    if(st.st_size < 4) {
+        close(fd);
+        *error = "File too small to contain NVM bytecode";
+        return NULL;
+    }
+    if(st.st_size > UINT32_MAX) {
+        close(fd);
+        *error = "File too large";
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    nvm_image_t* image = find_file(&st);
+    pthread_mutex_unlock(&cache_lock);
+    if(image) {
+        close(fd);
+        return image;
+    }
+
+    uint32_t size = (uint32_t)st.st_size;
+    uint8_t* bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(bytes == MAP_FAILED) {
+        *error = "Cannot map file";
+        return NULL;
+    }
+
+    if(memcmp(bytes, NVMC_MAGIC, 4) == 0) {
+        const char* reason = check_compiled(bytes, size, true);
+        if(reason) {
+            munmap(bytes, size);
+            *error = reason;
+            return NULL;
+        }
+
+        // Compiled with another fusion setting: its bytecode is still good
+        const nvmc_header_t* head = (const nvmc_header_t*)bytes;
+        if((head->flags & NVMC_FUSED) == (nvm_fuse_enabled ? NVMC_FUSED : 0)) {
+            return load_compiled(bytes, size, &st, error);
+        }
+        image = insert(bytes + sizeof(nvmc_header_t), head->size, head->hash, bytes, size, &st);
+        if(!image) {
+            *error = "Memory allocation failed";
+        }
+        return image;
+    }
+
+    uint64_t hash = hash_bytes(bytes, size);
+    pthread_mutex_lock(&cache_lock);
+    image = find_content(bytes, size, hash);
+    pthread_mutex_unlock(&cache_lock);
+    if(!image) {
+        image = open_sidecar(path, &st, bytes, hash);
+    }
+    if(image) {
+        munmap(bytes, size);
+        return image;
+    }
+
+    image = insert(bytes, size, hash, bytes, size, &st);
+    if(!image) {
+        *error = "Memory allocation failed";
+    }
+    return image;
+}
+
+nvm_image_t* nvm_image_load(const uint8_t* bytecode, uint32_t size) {
+    uint64_t hash = hash_bytes(bytecode, size);
+
+    pthread_mutex_lock(&cache_lock);
+    nvm_image_t* image = find_content(bytecode, size, hash);
+    pthread_mutex_unlock(&cache_lock);
+    if(image) {
+        return image;
+    }
+
+    uint8_t* copy = malloc(size);
+    if(!copy) {
+        return NULL;
+    }
+    memcpy(copy, bytecode, size);
+    return insert(copy, size, hash, NULL, 0, NULL);
+}
+
+bool nvm_image_compile(nvm_image_t* image, const char* path, const char** error) {
+    const nvm_program_t* program = image->program;
+    if(!program) {
+        *error = "Bytecode does not verify";
+        return false;
+    }
+
+    size_t total = compiled_size(image->size, program->count);
+    if(total > UINT32_MAX) {
+        *error = "Program too large to compile";
+        return false;
+    }
+    uint8_t* data = calloc(1, total);
+    char* temp = malloc(strlen(path) + 5);
+    if(!data || !temp) {
+        free(data);
+        free(temp);
+        *error = "Memory allocation failed";
+        return false;
+    }
+
+    nvmc_header_t* head = (nvmc_header_t*)data;
+    memcpy(head->magic, NVMC_MAGIC, 4);
+    head->version = NVMC_VERSION;
+    head->flags = image->fused ? NVMC_FUSED : 0;
+    head->size = image->size;
+    head->count = program->count;
+    memcpy(head->fusions, image->fusions, sizeof(head->fusions));
+    head->hash = image->hash;
+    head->mtime_sec = image->mtime.tv_sec;
+    head->mtime_nsec = image->mtime.tv_nsec;
+
+    uint8_t* at = data + sizeof(nvmc_header_t);
+    memcpy(at, image->bytes, image->size);
+    at += align8(image->size);
+    memcpy(at, program->code, program->count * sizeof(nvm_insn_t));
+    at += program->count * sizeof(nvm_insn_t);
+    memcpy(at, program->blocks, program->count * sizeof(nvm_block_t));
+    at += program->count * sizeof(nvm_block_t);
+    memcpy(at, program->offsets, program->count * sizeof(uint32_t));
+    at += program->count * sizeof(uint32_t);
+    memcpy(at, program->index, image->size * sizeof(uint32_t));
+    head->checksum = hash_bytes(data + sizeof(nvmc_header_t), (uint32_t)(total - sizeof(nvmc_header_t)));
+
+    // Write beside it and rename, so nobody maps a half-written file
+    sprintf(temp, "%s.tmp", path);
+    FILE* file = fopen(temp, "wb");
+    bool ok = file && fwrite(data, 1, total, file) == total;
+    if(file && fclose(file) != 0) {
+        ok = false;
+    }
+    if(ok && rename(temp, path) != 0) {
+        ok = false;
+    }
+    if(!ok) {
+        unlink(temp);
+        *error = "Cannot write compiled image";
+    }
+
+    free(data);
+    free(temp);
+    return ok;
+}
+
+void nvm_image_retain(nvm_image_t* image) {
+    pthread_mutex_lock(&cache_lock);
+    if(image->refs++ == 0) {
+        idle--;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void nvm_image_release(nvm_image_t* image) {
+    nvm_image_t* evicted = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    if(--image->refs == 0 && ++idle > IMAGE_CACHE_IDLE) {
+        // Evict the least recently used idle image
+        nvm_image_t** last = NULL;
+        for(nvm_image_t** link = &images; *link; link = &(*link)->next) {
+            if((*link)->refs == 0) {
+                last = link;
+            }
+        }
+        evicted = *last;
+        *last = evicted->next;
+        idle--;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    if(evicted) {
+        image_free(evicted);
+    }
+}
+
+void nvm_image_flush() {
+    pthread_mutex_lock(&cache_lock);
+    nvm_image_t** link = &images;
+    while(*link) {
+        nvm_image_t* image = *link;
+        if(image->refs == 0) {
+            *link = image->next;
+            image_free(image);
+        } else {
+            link = &image->next;
+        }
+    }
+    idle = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,64 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+#include <nvm.h>
+#include <verify.h>
+
+// Unreferenced images kept for later launches
+#define IMAGE_CACHE_IDLE 16
+
+// Compiled images (.nvmc): the program as nvm_verify and nvm_fuse left it,
+// loaded without either. Bump the version whenever the header, nvm_insn_t,
+// nvm_block_t, the fused opcodes or the verifier's results change.
+#define NVMC_MAGIC "NVC0"
+#define NVMC_VERSION 2
+
+// A bytecode image shared by every process running it: the bytes, read-only,
+// and their verified and fused form
+struct nvm_image {
+    const uint8_t* bytes;
+    uint32_t size;
+    uint64_t hash;                      // Content hash, the cache key
+    void* map;                          // File mapping holding bytes, NULL for a private copy
+    size_t map_size;
+    bool fused;                         // Built with nvm_fuse_enabled
+
+    nvm_program_t* program;             // NULL if the image did not verify
+    const char* reason;                 // Why it did not verify
+    uint32_t fusions[NVM_FUSION_KINDS]; // Fused instructions of each kind
+
+    // File the image came from, to find it again without reading it; for
+    // a compiled image found next to its bytecode file, that file
+    dev_t dev;
+    ino_t ino;
+    off_t file_size;
+    struct timespec mtime;
+
+    uint32_t refs;                      // Processes and callers holding it, under the cache lock
+    struct nvm_image* next;
+};
+
+// Map a bytecode file, or return the cached image of the same file or the
+// same contents. A compiled image is used instead of prog.nvm when
+// prog.nvmc is up to date, and `path` may name a compiled image itself.
+// On failure returns NULL and sets *error.
+nvm_image_t* nvm_image_open(const char* path, const char** error);
+
+// Write the compiled form of a verified image to `path`, replacing it
+// atomically. On failure returns false and sets *error.
+bool nvm_image_compile(nvm_image_t* image, const char* path, const char** error);
+
+// Image of a bytecode buffer; copied once unless the contents are cached
+nvm_image_t* nvm_image_load(const uint8_t* bytecode, uint32_t size);
+
+void nvm_image_retain(nvm_image_t* image);
+void nvm_image_release(nvm_image_t* image);
+
+// Free every unreferenced image
+void nvm_image_flush();
+
+#endif // IMAGE_H
@@ -0,0 +1,744 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <nvm.h>
+#include <heap.h>
+#include <vector.h>
+#include <wide.h>
+#include <jit.h>
+#include <profile.h>
+
+// Threaded interpreter core.
+//
+// ip, sp and the top of stack live in locals for the whole run and are only
+// written back to the process when leaving the loop. Handlers implement the
+// common case of each opcode; anything unusual (errors, truncated operands,
+// syscalls, privileged opcodes) is handed to nvm_execute_instruction for one
+// step, so error exits and logging stay exactly those of the reference core.
+//
+// Images accepted by nvm_verify run on run_verified over the decoded program,
+// without operand, target or per-instruction stack checks. The stack is
+// checked once per run against the verifier table; a failed check falls back
+// to the reference core until execution reaches a run start that passes.
+// run_verified caches up to two stack slots, tracking which with a separate
+// set of handlers per cache state.
+//
+// Backward jumps, calls and returns are preemption points: each one uses up one
+// unit of proc->budget and the loop returns to the scheduler when it runs out.
+
+#if defined(__GNUC__) && !defined(NVM_NO_COMPUTED_GOTO)
+#define NVM_COMPUTED_GOTO 1
+#else
+#define NVM_COMPUTED_GOTO 0
+#endif
+
+// Keep a dispatch jump at the end of every handler. GCC merges identical
+// handler tails otherwise, and one shared jump predicts much worse.
+#if NVM_COMPUTED_GOTO && !defined(__clang__)
+#define DISPATCH_LOOP __attribute__((optimize("no-crossjumping")))
+#else
+#define DISPATCH_LOOP
+#endif
+
+// Big-endian 32-bit operand starting at `at`
+#define OPERAND32(at) (((uint32_t)code[(at)] << 24) |     \
+                       ((uint32_t)code[(at) + 1] << 16) | \
+                       ((uint32_t)code[(at) + 2] << 8) |  \
+                       (uint32_t)code[(at) + 3])
+
+// stack[sp - 1] is cached in `tos` and is stale in memory while sp > 0.
+// `retired` counts the instructions completed since the last RELOAD().
+#define SPILL() do {                        \
+        proc->ip = ip;                      \
+        proc->sp = sp;                      \
+        if(sp > 0) stack[sp - 1] = tos;     \
+        proc->retired += retired;           \
+    } while(0)
+
+#define RELOAD() do {                       \
+        ip = proc->ip;                      \
+        sp = proc->sp;                      \
+        if(sp > 0) tos = stack[sp - 1];     \
+        retired = 0;                        \
+    } while(0)
+
+#define PUSH(v) do {                        \
+        if(sp > 0) stack[sp - 1] = tos;     \
+        tos = (v);                          \
+        sp++;                               \
+    } while(0)
+
+#define DROP() do {                         \
+        sp--;                               \
+        if(sp > 0) tos = stack[sp - 1];     \
+    } while(0)
+
+// Replace the two top values with `expr` over (second, top)
+#define BINARY(expr) do {                   \
+        int32_t second = stack[sp - 2];     \
+        int32_t top = tos;                  \
+        tos = (expr);                       \
+        sp--;                               \
+        ip++;                               \
+    } while(0)
+
+#define WRAP(op) ((int32_t)((uint32_t)second op (uint32_t)top))
+
+// Preemption point, state must be consistent for SPILL()
+#define YIELD() do {                        \
+        if(--proc->budget <= 0) goto do_yield; \
+    } while(0)
+
+DISPATCH_LOOP static void run_checked(nvm_process_t* proc) {
+    const uint8_t* code = proc->bytecode;
+    const uint32_t size = proc->size;
+    int32_t* stack = proc->stack;
+    int32_t* locals = proc->locals;
+    uint32_t ip;
+    int32_t sp;
+    int32_t tos = 0;
+    uint64_t retired;
+
+    RELOAD();
+
+#if NVM_COMPUTED_GOTO
+    static void* const dispatch_table[256] = {
+        [0 ... 255]     = &&do_slow,
+        [OP_NOP]        = &&do_nop,
+        [OP_PUSH]       = &&do_push,
+        [OP_POP]        = &&do_pop,
+        [OP_DUP]        = &&do_dup,
+        [OP_SWAP]       = &&do_swap,
+        [OP_ADD]        = &&do_add,
+        [OP_SUB]        = &&do_sub,
+        [OP_MUL]        = &&do_mul,
+        [OP_DIV]        = &&do_div,
+        [OP_MOD]        = &&do_mod,
+        [OP_CMP]        = &&do_cmp,
+        [OP_EQ]         = &&do_eq,
+        [OP_NEQ]        = &&do_neq,
+        [OP_GT]         = &&do_gt,
+        [OP_LT]         = &&do_lt,
+        [OP_JMP]        = &&do_jmp,
+        [OP_JZ]         = &&do_jz,
+        [OP_JNZ]        = &&do_jnz,
+        [OP_CALL]       = &&do_call,
+        [OP_RET]        = &&do_ret,
+        [OP_LOAD]       = &&do_load,
+        [OP_STORE]      = &&do_store,
+    };
+#define TARGET(name, op) do_##name:
+// RESUME() starts at ip, DISPATCH() moves on after a completed instruction
+#define RESUME() do {                                   \
+        if(ip >= size) goto do_slow;                    \
+        goto *dispatch_table[code[ip]];                 \
+    } while(0)
+#define DISPATCH() do {                                 \
+        retired++;                                      \
+        RESUME();                                       \
+    } while(0)
+
+    RESUME();
+#else
+#define TARGET(name, op) case op:
+#define RESUME() continue
+#define DISPATCH() { retired++; continue; }
+
+    for(;;) {
+        if(ip >= size) goto do_slow;
+
+        switch(code[ip]) {
+#endif
+
+        TARGET(nop, OP_NOP)
+            ip++;
+            DISPATCH();
+
+        TARGET(push, OP_PUSH)
+            if(ip + 4 >= size || sp >= STACK_SIZE) goto do_slow;
+            PUSH((int32_t)OPERAND32(ip + 1));
+            ip += 5;
+            DISPATCH();
+
+        TARGET(pop, OP_POP)
+            if(sp <= 0) goto do_slow;
+            DROP();
+            ip++;
+            DISPATCH();
+
+        TARGET(dup, OP_DUP)
+            if(sp == 0 || sp >= STACK_SIZE) goto do_slow;
+            stack[sp - 1] = tos;
+            sp++;
+            ip++;
+            DISPATCH();
+
+        TARGET(swap, OP_SWAP) {
+            if(sp < 2) goto do_slow;
+            int32_t second = stack[sp - 2];
+            stack[sp - 2] = tos;
+            tos = second;
+            ip++;
+            DISPATCH();
+        }
+
+        TARGET(add, OP_ADD)
+            if(sp < 2) goto do_slow;
+            BINARY(WRAP(+));
+            DISPATCH();
+
+        TARGET(sub, OP_SUB)
+            if(sp < 2) goto do_slow;
+            BINARY(WRAP(-));
+            DISPATCH();
+
+        TARGET(mul, OP_MUL)
+            if(sp < 2) goto do_slow;
+            BINARY(WRAP(*));
+            DISPATCH();
+
+        TARGET(div, OP_DIV)
+            if(sp < 2 || tos == 0) goto do_slow;
+            BINARY(top == -1 ? (int32_t)(0u - (uint32_t)second) : second / top);
+            DISPATCH();
+
+        TARGET(mod, OP_MOD)
+            if(sp < 2 || tos == 0) goto do_slow;
+            BINARY(top == -1 ? 0 : second % top);
+            DISPATCH();
+
+        TARGET(cmp, OP_CMP)
+            if(sp < 2) goto do_slow;
+            BINARY(second < top ? -1 : (second == top ? 0 : 1));
+            DISPATCH();
+
+        TARGET(eq, OP_EQ)
+            if(sp < 2) goto do_slow;
+            BINARY(second == top);
+            DISPATCH();
+
+        TARGET(neq, OP_NEQ)
+            if(sp < 2) goto do_slow;
+            BINARY(second != top);
+            DISPATCH();
+
+        TARGET(gt, OP_GT)
+            if(sp < 2) goto do_slow;
+            BINARY(second > top);
+            DISPATCH();
+
+        TARGET(lt, OP_LT)
+            if(sp < 2) goto do_slow;
+            BINARY(second < top);
+            DISPATCH();
+
+        TARGET(jmp, OP_JMP) {
+            if(ip + 4 >= size) goto do_slow;
+            uint32_t addr = OPERAND32(ip + 1);
+            if(addr < 4 || addr >= size) goto do_slow;
+            bool back = addr <= ip;
+            ip = addr;
+            if(back) YIELD();
+            DISPATCH();
+        }
+
+        TARGET(jz, OP_JZ) {
+            if(sp <= 0 || ip + 4 >= size) goto do_slow;
+            uint32_t addr = OPERAND32(ip + 1);
+            bool taken = (tos == 0);
+            if(taken && (addr < 4 || addr >= size)) goto do_slow;
+            bool back = taken && addr <= ip;
+            DROP();
+            ip = taken ? addr : ip + 5;
+            if(back) YIELD();
+            DISPATCH();
+        }
+
+        TARGET(jnz, OP_JNZ) {
+            if(sp <= 0 || ip + 4 >= size) goto do_slow;
+            uint32_t addr = OPERAND32(ip + 1);
+            bool taken = (tos != 0);
+            if(taken && (addr < 4 || addr >= size)) goto do_slow;
+            bool back = taken && addr <= ip;
+            DROP();
+            ip = taken ? addr : ip + 5;
+            if(back) YIELD();
+            DISPATCH();
+        }
+
+        TARGET(call, OP_CALL) {
+            if(ip + 4 >= size || sp >= STACK_SIZE - 1) goto do_slow;
+            uint32_t addr = OPERAND32(ip + 1);
+            if(addr < 4 || addr >= size) goto do_slow;
+            PUSH((int32_t)(ip + 5));
+            ip = addr;
+            YIELD();
+            DISPATCH();
+        }
+
+        TARGET(ret, OP_RET) {
+            if(sp <= 0) goto do_slow;
+            uint32_t addr = (uint32_t)tos;
+            if(addr < 4 || addr >= size) goto do_slow;
+            DROP();
+            ip = addr;
+            YIELD();
+            DISPATCH();
+        }
+
+        TARGET(load, OP_LOAD) {
+            if(ip + 1 >= size || sp >= STACK_SIZE) goto do_slow;
+            uint8_t var_index = code[ip + 1];
+            if(var_index >= MAX_LOCALS) goto do_slow;
+            PUSH(locals[var_index]);
+            ip += 2;
+            DISPATCH();
+        }
+
+        TARGET(store, OP_STORE) {
+            if(ip + 1 >= size || sp <= 0) goto do_slow;
+            uint8_t var_index = code[ip + 1];
+            if(var_index >= MAX_LOCALS) goto do_slow;
+            locals[var_index] = tos;
+            DROP();
+            ip += 2;
+            DISPATCH();
+        }
+
+#if !NVM_COMPUTED_GOTO
+        default:
+#endif
+        do_slow:
+            // Run exactly one instruction on the reference core
+            SPILL();
+            if(!nvm_execute_instruction(proc) || !proc->active || proc->blocked || --proc->budget <= 0) {
+                return;
+            }
+            RELOAD();
+            RESUME();
+
+        do_yield:
+            // After the jump, call or return that used up the budget
+            retired++;
+            SPILL();
+            return;
+
+#if !NVM_COMPUTED_GOTO
+        }
+    }
+#endif
+}
+
+#undef TARGET
+#undef RESUME
+#undef DISPATCH
+#undef SPILL
+#undef RELOAD
+#undef PUSH
+#undef DROP
+#undef BINARY
+
+// The fast path runs on the decoded program with the top two stack slots
+// cached in `tos` and `nos`. Which of them are live is the cache state:
+//   0 - nothing cached, stack[0 .. sp) is all in memory
+//   1 - stack[sp - 1] is in tos, sp >= 1
+//   2 - stack[sp - 1] is in tos and stack[sp - 2] in nos, sp >= 2
+// Each state has its own copy of every handler (interp_cached.h) and its
+// own dispatch table, so a handler knows at compile time what is cached
+// and moves to the state its result leaves. Memory is only written when a
+// push finds both registers live, and on leaving the loop.
+#define LABEL_(s, name) s##_##name
+#define LABEL(s, name) LABEL_(s, name)
+#define STATE_NAME_(n) s##n
+#define STATE_NAME(n) STATE_NAME_(n)
+#define L(name) LABEL(STATE_NAME(STATE), name)
+
+#define TOP (STATE == 0 ? stack[sp - 1] : tos)
+#define SECOND (STATE == 2 ? nos : stack[sp - 2])
+
+// Write the cached slots of state `n` back to the stack
+#define FLUSH(n) do {                                               \
+        if((n) >= 1) stack[sp - 1] = tos;                           \
+        if((n) == 2) stack[sp - 2] = nos;                           \
+    } while(0)
+
+// pc is mapped back to a byte offset whenever state is handed to the
+// process; the registers stay valid
+#define SPILL() do {                                                \
+        proc->ip = offsets[pc - code];                              \
+        proc->sp = sp;                                              \
+        proc->retired = base + (uint64_t)(pc - code);               \
+        FLUSH(STATE);                                               \
+    } while(0)
+
+// Jump to label `name` of cache state `n`, a constant. Handlers that leave
+// after pushing or dropping must spill in the state they moved to.
+#define GOTO_STATE(n, name) do {                                    \
+        if((n) == 0) goto s0_##name;                                \
+        if((n) == 1) goto s1_##name;                                \
+        goto s2_##name;                                             \
+    } while(0)
+
+// Push `v`, the new state is PUSHED
+#define PUSH(v) do {                                                \
+        int32_t pushed = (v);                                       \
+        if(STATE == 2) stack[sp - 2] = nos;                         \
+        if(STATE >= 1) nos = tos;                                   \
+        tos = pushed;                                               \
+        sp++;                                                       \
+    } while(0)
+#define PUSHED (STATE == 0 ? 1 : 2)
+
+// Drop the top value, the new state is DROPPED
+#define DROP() do {                                                 \
+        if(STATE == 2) tos = nos;                                   \
+        sp--;                                                       \
+    } while(0)
+#define DROPPED (STATE == 2 ? 1 : 0)
+
+// Replace the two top values with `expr` over (second, top), leaving state 1
+#define BINARY(expr) do {                                           \
+        int32_t second = SECOND;                                    \
+        int32_t top = TOP;                                          \
+        tos = (expr);                                               \
+        sp--;                                                       \
+        pc++;                                                       \
+        NEXT(1);                                                    \
+    } while(0)
+
+// BINARY for the checked opcodes: leave when `builtin` reports overflow
+#define CHECKED(builtin) do {                                       \
+        int32_t result;                                             \
+        if(builtin(SECOND, TOP, &result)) goto L(leave);            \
+        tos = result;                                               \
+        sp--;                                                       \
+        pc++;                                                       \
+        NEXT(1);                                                    \
+    } while(0)
+
+// The two 64-bit operands a and b of a wide opcode, see wide.h. They are
+// read from memory, so the cached slots are written back first.
+#define WIDE_OPERANDS()                                             \
+        FLUSH(STATE);                                               \
+        int64_t a = nvm_wide_get(&stack[sp - 4]);                   \
+        int64_t b = nvm_wide_get(&stack[sp - 2])
+
+// Replace the operands with the 64-bit `value`, leaving state 0
+#define WIDE_RESULT(value) do {                                     \
+        nvm_wide_set(&stack[sp - 4], (value));                      \
+        sp -= 2;                                                    \
+        pc++;                                                       \
+        NEXT(0);                                                    \
+    } while(0)
+
+// Replace the address on top with the `width`-byte value stored there
+#define HEAP_LOAD(width) do {                                       \
+        uint32_t addr = (uint32_t)TOP;                              \
+        if(!nvm_heap_ok(proc, addr, (width))) goto L(leave);        \
+        tos = nvm_heap_load(proc, addr, (width));                   \
+        pc++;                                                       \
+        NEXT(STATE == 0 ? 1 : STATE);                               \
+    } while(0)
+
+// Store the top value at the address below it, leaving state 0
+#define HEAP_STORE(width) do {                                      \
+        uint32_t addr = (uint32_t)SECOND;                           \
+        if(!nvm_heap_ok(proc, addr, (width))) goto L(leave);        \
+        nvm_heap_store(proc, addr, (width), TOP);                   \
+        sp -= 2;                                                    \
+        pc++;                                                       \
+        NEXT(0);                                                    \
+    } while(0)
+
+// Leave for the reference core when the run starting at instruction
+// `target` could over- or underflow the stack; `n` is the cache state
+// after the control transfer. pc is still the transfer, the last
+// instruction of its run.
+#define ENTER(target, n) do {                                       \
+        uint32_t to = (target);                                     \
+        base += (uint64_t)(pc - code) + 1 - to;                     \
+        pc = code + to;                                             \
+        if(sp < blocks[to].need ||                                  \
+           sp + blocks[to].grow > STACK_SIZE) GOTO_STATE(n, leave); \
+    } while(0)
+
+#undef YIELD
+#define YIELD(n) do {                                               \
+        if(--proc->budget <= 0) GOTO_STATE(n, leave);               \
+    } while(0)
+
+#ifdef NVM_CHECK_FUSION
+// Debug builds replay the originals of every fused instruction on a copy of
+// the process through the reference core and compare the outcome
+#define FUSION_CHECK_BEGIN(n)                                       \
+        nvm_process_t shadow;                                       \
+        int32_t shadow_stack[STACK_SIZE];                           \
+        int32_t shadow_locals[MAX_LOCALS];                          \
+        SPILL();                                                    \
+        shadow = *proc;                                             \
+        shadow.stack = memcpy(shadow_stack, proc->stack, sizeof(shadow_stack));      \
+        shadow.locals = memcpy(shadow_locals, proc->locals, sizeof(shadow_locals));  \
+        for(int k = 0; k < (n) && shadow.active; k++) {             \
+            nvm_execute_instruction(&shadow);                       \
+        }
+
+// `state` is the cache state the fused instruction leaves
+#define FUSION_CHECK_END(next, state)                               \
+        FLUSH(state);                                               \
+        fusion_check(&shadow, proc, pc->op, offsets[(next)], sp)
+
+static void fusion_check(const nvm_process_t* shadow, const nvm_process_t* proc,
+                         uint8_t op, uint32_t ip, int32_t sp) {
+    bool same = shadow->active && (uint32_t)shadow->ip == ip && shadow->sp == sp &&
+                memcmp(shadow->locals, proc->locals, MAX_LOCALS * sizeof(int32_t)) == 0 &&
+                memcmp(shadow->stack, proc->stack, sp * sizeof(int32_t)) == 0;
+
+    if(!same) {
+        fprintf(stderr, "Process %d: fused op 0x%02X diverges from reference at IP=%u\n",
+                proc->pid, op, (unsigned)ip);
+        abort();
+    }
+}
+#else
+#define FUSION_CHECK_BEGIN(n)
+#define FUSION_CHECK_END(next, state)
+#endif
+
+#if NVM_JIT
+// Back-edges and calls count towards compiling the program; once it is hot
+// execution continues in native code from the current run start
+#define HOT(n) do {                                                 \
+        int32_t left = atomic_load_explicit(&program->jit_countdown, \
+                                            memory_order_relaxed) - 1; \
+        atomic_store_explicit(&program->jit_countdown, left,        \
+                              memory_order_relaxed);                \
+        if(left <= 0) GOTO_STATE(n, jit);                           \
+    } while(0)
+#else
+#define HOT(n)
+#endif
+
+#define TICK(n) do {                                                \
+        YIELD(n);                                                   \
+        HOT(n);                                                     \
+    } while(0)
+
+#if NVM_COMPUTED_GOTO
+#define STATE_TABLE(n) {                                            \
+        [0 ... 255]     = &&s##n##_leave,                           \
+        [OP_HALT]       = &&s##n##_callout,                         \
+        [OP_NOP]        = &&s##n##_nop,                             \
+        [OP_PUSH]       = &&s##n##_push,                            \
+        [OP_POP]        = &&s##n##_pop,                             \
+        [OP_DUP]        = &&s##n##_dup,                             \
+        [OP_SWAP]       = &&s##n##_swap,                            \
+        [OP_ADD]        = &&s##n##_add,                             \
+        [OP_SUB]        = &&s##n##_sub,                             \
+        [OP_MUL]        = &&s##n##_mul,                             \
+        [OP_DIV]        = &&s##n##_div,                             \
+        [OP_MOD]        = &&s##n##_mod,                             \
+        [OP_CMP]        = &&s##n##_cmp,                             \
+        [OP_EQ]         = &&s##n##_eq,                              \
+        [OP_NEQ]        = &&s##n##_neq,                             \
+        [OP_GT]         = &&s##n##_gt,                              \
+        [OP_LT]         = &&s##n##_lt,                              \
+        [OP_JMP]        = &&s##n##_jmp,                             \
+        [OP_JZ]         = &&s##n##_jz,                              \
+        [OP_JNZ]        = &&s##n##_jnz,                             \
+        [OP_CALL]       = &&s##n##_call,                            \
+        [OP_RET]        = &&s##n##_ret,                             \
+        [OP_CALLF]      = &&s##n##_callf,                           \
+        [OP_RETF]       = &&s##n##_retf,                            \
+        [OP_ENTER]      = &&s##n##_enter,                           \
+        [OP_LEAVE]      = &&s##n##_leave_frame,                     \
+        [OP_LOAD]       = &&s##n##_load,                            \
+        [OP_STORE]      = &&s##n##_store,                           \
+        [OP_LOADF]      = &&s##n##_loadf,                           \
+        [OP_STOREF]     = &&s##n##_storef,                          \
+        [OP_STORE_ABS]  = &&s##n##_callout,                         \
+        [OP_LOAD8]      = &&s##n##_load8,                           \
+        [OP_LOAD16]     = &&s##n##_load16,                          \
+        [OP_LOAD32]     = &&s##n##_load32,                          \
+        [OP_STORE8]     = &&s##n##_store8,                          \
+        [OP_STORE16]    = &&s##n##_store16,                         \
+        [OP_STORE32]    = &&s##n##_store32,                         \
+        [OP_MEMCPY]     = &&s##n##_heap_copy,                       \
+        [OP_MEMSET]     = &&s##n##_heap_fill,                       \
+        [OP_MEMCMP]     = &&s##n##_heap_compare,                    \
+        [OP_SYSCALL]    = &&s##n##_syscall,                         \
+        [OP_BREAK]      = &&s##n##_callout,                         \
+        [OP_VADD]       = &&s##n##_vector,                          \
+        [OP_VSUB]       = &&s##n##_vector,                          \
+        [OP_VMUL]       = &&s##n##_vector,                          \
+        [OP_VMIN]       = &&s##n##_vector,                          \
+        [OP_VMAX]       = &&s##n##_vector,                          \
+        [OP_VSUM]       = &&s##n##_vector,                          \
+        [OP_VRMIN]      = &&s##n##_vector,                          \
+        [OP_VRMAX]      = &&s##n##_vector,                          \
+        [OP_VDOT]       = &&s##n##_vector,                          \
+        [OP_VCOUNTEQ]   = &&s##n##_vector,                          \
+        [OP_VCOUNTGT]   = &&s##n##_vector,                          \
+        [OP_VCOUNTLT]   = &&s##n##_vector,                          \
+        [OP_ADD64]      = &&s##n##_add64,                           \
+        [OP_SUB64]      = &&s##n##_sub64,                           \
+        [OP_MUL64]      = &&s##n##_mul64,                           \
+        [OP_DIV64]      = &&s##n##_div64,                           \
+        [OP_MOD64]      = &&s##n##_mod64,                           \
+        [OP_CMP64]      = &&s##n##_cmp64,                           \
+        [OP_EXT64]      = &&s##n##_ext64,                           \
+        [OP_ADDC]       = &&s##n##_addc,                            \
+        [OP_SUBC]       = &&s##n##_subc,                            \
+        [OP_MULC]       = &&s##n##_mulc,                            \
+        [OP_ADD64C]     = &&s##n##_add64c,                          \
+        [OP_SUB64C]     = &&s##n##_sub64c,                          \
+        [OP_MUL64C]     = &&s##n##_mul64c,                          \
+        [OP_FMUL]       = &&s##n##_fmul,                            \
+        [OP_FDIV]       = &&s##n##_fdiv,                            \
+        [OP_DIVC]       = &&s##n##_divc,                            \
+        [OP_MODC]       = &&s##n##_modc,                            \
+        [OP_DIV64C]     = &&s##n##_div64c,                          \
+        [OP_MOD64C]     = &&s##n##_mod64c,                          \
+        [OP_LOAD_PUSH_CMP_BRANCH] = &&s##n##_load_push_cmp_branch,  \
+        [OP_INC_LOCAL]  = &&s##n##_inc_local,                       \
+        [OP_DEC_LOCAL]  = &&s##n##_dec_local,                       \
+        [OP_PUSH_ADD]   = &&s##n##_push_add,                        \
+    }
+
+#define TARGET(name, op) L(name):
+#define NEXT(n) goto *dispatch_table[(n)][pc->op]
+#else
+#define TARGET(name, op) case (STATE << 8) | (op):
+#define NEXT(n) do {                                                \
+        state = (n);                                                \
+        goto dispatch;                                              \
+    } while(0)
+#endif
+
+DISPATCH_LOOP static void run_verified(nvm_process_t* proc) {
+    nvm_program_t* program = proc->program;
+    const nvm_insn_t* code = program->code;
+    const nvm_block_t* blocks = program->blocks;
+    const uint32_t* offsets = program->offsets;
+    const uint32_t* index = program->index;
+    const uint32_t size = program->size;
+    const nvm_insn_t* pc;
+    int32_t* stack = proc->stack;
+    int32_t* locals = proc->locals;
+    int32_t sp;
+    int32_t tos = 0;
+    int32_t nos = 0;
+    uint64_t base;              // proc->retired is base + (pc - code)
+
+    pc = code + index[proc->ip];
+    sp = proc->sp;
+    base = proc->retired - (uint64_t)(pc - code);
+
+#if NVM_COMPUTED_GOTO
+    static void* const dispatch_table[3][256] = {
+        STATE_TABLE(0),
+        STATE_TABLE(1),
+        STATE_TABLE(2),
+    };
+
+    NEXT(0);
+#else
+    int state = 0;
+
+dispatch:
+    switch((state << 8) | pc->op) {
+#endif
+
+#define STATE 0
+#include <interp_cached.h>
+#undef STATE
+
+#define STATE 1
+#include <interp_cached.h>
+#undef STATE
+
+#define STATE 2
+#include <interp_cached.h>
+#undef STATE
+
+#if !NVM_COMPUTED_GOTO
+        default:
+            // Not reached for verified code
+            switch(state) {
+                case 1: goto s1_leave;
+                case 2: goto s2_leave;
+                default: goto s0_leave;
+            }
+    }
+#endif
+
+    // The state is spilled and nothing is cached from here on
+do_syscall:
+    nvm_execute_instruction(proc);
+    if(!proc->active || proc->blocked) {
+        return;
+    }
+    pc = code + index[proc->ip];
+    sp = proc->sp;
+    base = proc->retired - (uint64_t)(pc - code);
+    if(sp < blocks[pc - code].need || sp + blocks[pc - code].grow > STACK_SIZE) {
+        return;
+    }
+    NEXT(0);
+
+do_callout:
+    nvm_execute_instruction(proc);
+    if(!proc->active) {
+        return;
+    }
+    pc = code + index[proc->ip];
+    sp = proc->sp;
+    base = proc->retired - (uint64_t)(pc - code);
+    NEXT(0);
+}
+
+static bool block_enter_ok(nvm_process_t* proc) {
+    const nvm_program_t* program = proc->program;
+
+    if((uint32_t)proc->ip >= program->size || program->index[proc->ip] == NVM_NO_INSN) {
+        return false;
+    }
+
+    const nvm_block_t* block = &program->blocks[program->index[proc->ip]];
+    return proc->sp >= block->need && proc->sp + block->grow <= STACK_SIZE;
+}
+
+void nvm_run(nvm_process_t* proc) {
+    if(!proc->active || proc->budget <= 0) {
+        return;
+    }
+
+    // Kept off the fast paths entirely, see profile.c
+    if(nvm_profile_enabled) {
+        nvm_profile_run(proc);
+        return;
+    }
+
+    if(!proc->program) {
+        run_checked(proc);
+        return;
+    }
+
+    while(proc->active && !proc->blocked && proc->budget > 0) {
+        if(block_enter_ok(proc)) {
+            run_verified(proc);
+            if(!proc->active || proc->blocked || proc->budget <= 0) {
+                return;
+            }
+        }
+
+        // Step the reference core until we are back at a run start
+        if(!nvm_execute_instruction(proc)) {
+            return;
+        }
+        proc->budget--;
+    }
+}
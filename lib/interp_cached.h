@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// Handlers of run_verified for cache state STATE, included by interp.c once
+// per state. TOP, SECOND, PUSH and DROP know what STATE caches; NEXT(n)
+// dispatches the next instruction in state n.
+
+        TARGET(nop, OP_NOP)
+            pc++;
+            NEXT(STATE);
+
+        TARGET(push, OP_PUSH)
+            PUSH(pc->arg);
+            pc++;
+            NEXT(PUSHED);
+
+        TARGET(pop, OP_POP)
+            DROP();
+            pc++;
+            NEXT(DROPPED);
+
+        TARGET(dup, OP_DUP)
+            PUSH(TOP);
+            pc++;
+            NEXT(PUSHED);
+
+        TARGET(swap, OP_SWAP) {
+            int32_t top = TOP;
+            int32_t second = SECOND;
+            tos = second;
+            nos = top;
+            pc++;
+            NEXT(2);
+        }
+
+        TARGET(add, OP_ADD)
+            BINARY(WRAP(+));
+
+        TARGET(sub, OP_SUB)
+            BINARY(WRAP(-));
+
+        TARGET(mul, OP_MUL)
+            BINARY(WRAP(*));
+
+        TARGET(div, OP_DIV)
+            if(TOP == 0) goto L(leave);
+            BINARY(top == -1 ? (int32_t)(0u - (uint32_t)second) : second / top);
+
+        TARGET(mod, OP_MOD)
+            if(TOP == 0) goto L(leave);
+            BINARY(top == -1 ? 0 : second % top);
+
+        TARGET(addc, OP_ADDC)
+            CHECKED(__builtin_add_overflow);
+
+        TARGET(subc, OP_SUBC)
+            CHECKED(__builtin_sub_overflow);
+
+        TARGET(mulc, OP_MULC)
+            CHECKED(__builtin_mul_overflow);
+
+        TARGET(divc, OP_DIVC)
+            if(TOP == 0 || (TOP == -1 && SECOND == INT32_MIN)) goto L(leave);
+            BINARY(second / top);
+
+        TARGET(modc, OP_MODC)
+            if(TOP == 0 || (TOP == -1 && SECOND == INT32_MIN)) goto L(leave);
+            BINARY(second % top);
+
+        TARGET(fmul, OP_FMUL)
+            BINARY(nvm_fixed_mul(second, top, pc->arg));
+
+        TARGET(fdiv, OP_FDIV)
+            if(TOP == 0) goto L(leave);
+            BINARY(nvm_fixed_div(second, top, pc->arg));
+
+        // 64-bit pairs, see wide.h
+        TARGET(add64, OP_ADD64) {
+            WIDE_OPERANDS();
+            WIDE_RESULT(nvm_wide_add(a, b));
+        }
+
+        TARGET(sub64, OP_SUB64) {
+            WIDE_OPERANDS();
+            WIDE_RESULT(nvm_wide_sub(a, b));
+        }
+
+        TARGET(mul64, OP_MUL64) {
+            WIDE_OPERANDS();
+            WIDE_RESULT(nvm_wide_mul(a, b));
+        }
+
+        TARGET(div64, OP_DIV64) {
+            WIDE_OPERANDS();
+            if(b == 0) goto L(leave);
+            WIDE_RESULT(nvm_wide_div(a, b));
+        }
+
+        TARGET(mod64, OP_MOD64) {
+            WIDE_OPERANDS();
+            if(b == 0) goto L(leave);
+            WIDE_RESULT(nvm_wide_mod(a, b));
+        }
+
+        TARGET(add64c, OP_ADD64C) {
+            WIDE_OPERANDS();
+            int64_t result;
+            if(__builtin_add_overflow(a, b, &result)) goto L(leave);
+            WIDE_RESULT(result);
+        }
+
+        TARGET(sub64c, OP_SUB64C) {
+            WIDE_OPERANDS();
+            int64_t result;
+            if(__builtin_sub_overflow(a, b, &result)) goto L(leave);
+            WIDE_RESULT(result);
+        }
+
+        TARGET(mul64c, OP_MUL64C) {
+            WIDE_OPERANDS();
+            int64_t result;
+            if(__builtin_mul_overflow(a, b, &result)) goto L(leave);
+            WIDE_RESULT(result);
+        }
+
+        TARGET(div64c, OP_DIV64C) {
+            WIDE_OPERANDS();
+            if(b == 0 || (b == -1 && a == INT64_MIN)) goto L(leave);
+            WIDE_RESULT(a / b);
+        }
+
+        TARGET(mod64c, OP_MOD64C) {
+            WIDE_OPERANDS();
+            if(b == 0 || (b == -1 && a == INT64_MIN)) goto L(leave);
+            WIDE_RESULT(a % b);
+        }
+
+        TARGET(cmp64, OP_CMP64) {
+            WIDE_OPERANDS();
+            tos = a < b ? -1 : (a == b ? 0 : 1);
+            sp -= 3;
+            pc++;
+            NEXT(1);
+        }
+
+        TARGET(ext64, OP_EXT64)
+            PUSH(TOP < 0 ? -1 : 0);
+            pc++;
+            NEXT(PUSHED);
+
+        TARGET(cmp, OP_CMP)
+            BINARY(second < top ? -1 : (second == top ? 0 : 1));
+
+        TARGET(eq, OP_EQ)
+            BINARY(second == top);
+
+        TARGET(neq, OP_NEQ)
+            BINARY(second != top);
+
+        TARGET(gt, OP_GT)
+            BINARY(second > top);
+
+        TARGET(lt, OP_LT)
+            BINARY(second < top);
+
+        TARGET(jmp, OP_JMP) {
+            bool back = (uint32_t)pc->arg <= (uint32_t)(pc - code);
+            ENTER(pc->arg, STATE);
+            if(back) TICK(STATE);
+            NEXT(STATE);
+        }
+
+        TARGET(jz, OP_JZ) {
+            bool taken = (TOP == 0);
+            bool back = taken && (uint32_t)pc->arg <= (uint32_t)(pc - code);
+            DROP();
+            ENTER(taken ? (uint32_t)pc->arg : (uint32_t)(pc - code) + 1, DROPPED);
+            if(back) TICK(DROPPED);
+            NEXT(DROPPED);
+        }
+
+        TARGET(jnz, OP_JNZ) {
+            bool taken = (TOP != 0);
+            bool back = taken && (uint32_t)pc->arg <= (uint32_t)(pc - code);
+            DROP();
+            ENTER(taken ? (uint32_t)pc->arg : (uint32_t)(pc - code) + 1, DROPPED);
+            if(back) TICK(DROPPED);
+            NEXT(DROPPED);
+        }
+
+        TARGET(call, OP_CALL)
+            // The return address pushed is still a byte offset
+            PUSH((int32_t)offsets[pc - code + 1]);
+            ENTER(pc->arg, PUSHED);
+            TICK(PUSHED);
+            NEXT(PUSHED);
+
+        TARGET(ret, OP_RET) {
+            // Return addresses are data, so this one stays checked
+            uint32_t addr = (uint32_t)TOP;
+            if(addr < 4 || addr >= size || index[addr] == NVM_NO_INSN) goto L(leave);
+            DROP();
+            ENTER(index[addr], DROPPED);
+            YIELD(DROPPED);
+            NEXT(DROPPED);
+        }
+
+        TARGET(callf, OP_CALLF)
+            if(proc->csp >= nvm_call_depth) goto L(leave);
+            proc->calls[proc->csp++] = offsets[pc - code + 1];
+            ENTER(pc->arg, STATE);
+            TICK(STATE);
+            NEXT(STATE);
+
+        TARGET(retf, OP_RETF)
+            // Return offsets come from CALLF or a checked snapshot, they need no checks
+            if(proc->csp == 0) goto L(leave);
+            ENTER(index[proc->calls[--proc->csp]], STATE);
+            YIELD(STATE);
+            NEXT(STATE);
+
+        TARGET(enter, OP_ENTER)
+            if(!nvm_frame_enter(proc, (uint32_t)pc->arg)) goto L(leave);
+            pc++;
+            NEXT(STATE);
+
+        TARGET(leave_frame, OP_LEAVE)
+            if(!nvm_frame_leave(proc)) goto L(leave);
+            pc++;
+            NEXT(STATE);
+
+        TARGET(load, OP_LOAD)
+            PUSH(locals[pc->arg]);
+            pc++;
+            NEXT(PUSHED);
+
+        TARGET(store, OP_STORE)
+            locals[pc->arg] = TOP;
+            DROP();
+            pc++;
+            NEXT(DROPPED);
+
+        TARGET(loadf, OP_LOADF)
+            if((uint32_t)pc->arg >= proc->frame_size) goto L(leave);
+            PUSH(proc->frame[pc->arg]);
+            pc++;
+            NEXT(PUSHED);
+
+        TARGET(storef, OP_STOREF)
+            if((uint32_t)pc->arg >= proc->frame_size) goto L(leave);
+            proc->frame[pc->arg] = TOP;
+            DROP();
+            pc++;
+            NEXT(DROPPED);
+
+        TARGET(load8, OP_LOAD8)
+            HEAP_LOAD(1);
+
+        TARGET(load16, OP_LOAD16)
+            HEAP_LOAD(2);
+
+        TARGET(load32, OP_LOAD32)
+            HEAP_LOAD(4);
+
+        TARGET(store8, OP_STORE8)
+            HEAP_STORE(1);
+
+        TARGET(store16, OP_STORE16)
+            HEAP_STORE(2);
+
+        TARGET(store32, OP_STORE32)
+            HEAP_STORE(4);
+
+        // dst src n, the third value down is never cached
+        TARGET(heap_copy, OP_MEMCPY)
+            if(!nvm_heap_copy(proc, (uint32_t)stack[sp - 3], (uint32_t)SECOND, (uint32_t)TOP)) goto L(leave);
+            sp -= 3;
+            pc++;
+            NEXT(0);
+
+        TARGET(heap_fill, OP_MEMSET)
+            if(!nvm_heap_fill(proc, (uint32_t)stack[sp - 3], SECOND, (uint32_t)TOP)) goto L(leave);
+            sp -= 3;
+            pc++;
+            NEXT(0);
+
+        TARGET(heap_compare, OP_MEMCMP) {
+            int32_t result = nvm_heap_compare(proc, (uint32_t)stack[sp - 3], (uint32_t)SECOND, (uint32_t)TOP);
+            if(result == NVM_HEAP_FAULT) goto L(leave);
+            tos = result;
+            sp -= 2;
+            pc++;
+            NEXT(1);
+        }
+
+        // Operands and results go through the stack, see vector.c
+#if NVM_COMPUTED_GOTO
+        L(vector):
+#else
+        case (STATE << 8) | OP_VADD:
+        case (STATE << 8) | OP_VSUB:
+        case (STATE << 8) | OP_VMUL:
+        case (STATE << 8) | OP_VMIN:
+        case (STATE << 8) | OP_VMAX:
+        case (STATE << 8) | OP_VSUM:
+        case (STATE << 8) | OP_VRMIN:
+        case (STATE << 8) | OP_VRMAX:
+        case (STATE << 8) | OP_VDOT:
+        case (STATE << 8) | OP_VCOUNTEQ:
+        case (STATE << 8) | OP_VCOUNTGT:
+        case (STATE << 8) | OP_VCOUNTLT:
+#endif
+            FLUSH(STATE);
+            proc->sp = sp;
+            if(!nvm_vector_exec(proc, pc->op)) GOTO_STATE(0, leave);
+            sp = proc->sp;
+            pc++;
+            NEXT(0);
+
+        TARGET(syscall, OP_SYSCALL)
+            SPILL();
+            goto do_syscall;
+
+        // Fused instructions, see fuse.c
+        TARGET(load_push_cmp_branch, OP_LOAD_PUSH_CMP_BRANCH) {
+            FUSION_CHECK_BEGIN(4);
+            int32_t value = locals[pc->aux[2]];
+            bool result;
+            switch(pc->aux[0]) {
+                case OP_GT: result = value > pc->arg; break;
+                case OP_LT: result = value < pc->arg; break;
+                case OP_EQ: result = value == pc->arg; break;
+                default:    result = value != pc->arg; break;
+            }
+            uint32_t target = (result == pc->aux[1]) ? (uint32_t)pc[3].arg : (uint32_t)(pc - code) + 4;
+            bool back = target <= (uint32_t)(pc - code);
+            FUSION_CHECK_END(target, STATE);
+            pc += 3;                                // The branch it replaces
+            ENTER(target, STATE);
+            if(back) TICK(STATE);
+            NEXT(STATE);
+        }
+
+        TARGET(inc_local, OP_INC_LOCAL) {
+            FUSION_CHECK_BEGIN(4);
+            locals[pc->aux[2]] = (int32_t)((uint32_t)locals[pc->aux[2]] + (uint32_t)pc->arg);
+            FUSION_CHECK_END(pc - code + 4, STATE);
+            pc += 4;
+            NEXT(STATE);
+        }
+
+        TARGET(dec_local, OP_DEC_LOCAL) {
+            FUSION_CHECK_BEGIN(4);
+            locals[pc->aux[2]] = (int32_t)((uint32_t)locals[pc->aux[2]] - (uint32_t)pc->arg);
+            FUSION_CHECK_END(pc - code + 4, STATE);
+            pc += 4;
+            NEXT(STATE);
+        }
+
+        TARGET(push_add, OP_PUSH_ADD) {
+            FUSION_CHECK_BEGIN(2);
+            tos = (int32_t)((uint32_t)TOP + (uint32_t)pc->arg);
+            FUSION_CHECK_END(pc - code + 2, STATE == 0 ? 1 : STATE);
+            pc += 2;
+            NEXT(STATE == 0 ? 1 : STATE);
+        }
+
+#if NVM_COMPUTED_GOTO
+        L(callout):
+#else
+        case (STATE << 8) | OP_HALT:
+        case (STATE << 8) | OP_STORE_ABS:
+        case (STATE << 8) | OP_BREAK:
+#endif
+            SPILL();
+            goto do_callout;
+
+#if NVM_JIT
+        L(jit):
+            SPILL();
+            if(nvm_jit_run(proc)) {
+                return;
+            }
+            atomic_store_explicit(&program->jit_countdown, INT32_MAX, memory_order_relaxed);
+            NEXT(STATE);
+#endif
+
+        L(leave):
+            SPILL();
+            return;
@@ -0,0 +1,1065 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <jit.h>
+#include <syscall.h>
+#include <heap.h>
+#include <vector.h>
+
+bool nvm_jit_enabled = true;
+
+#if NVM_JIT
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+// Template JIT for x86-64 (System V).
+//
+// Every decoded instruction gets its own native block, emitted in program
+// order so straight-line code simply falls through. The data stack and the
+// locals stay in the process structure:
+//
+//   rbx  proc->stack
+//   r12  sp
+//   r13  proc->locals
+//   r14  proc
+//   r15  proc->retired minus the index of the current instruction
+//
+// Control transfers repeat the verifier's run check. Whenever native code
+// cannot reproduce the interpreter exactly (failed run check, zero or -1
+// divisor, overflow in a checked opcode, odd return address) it stores the
+// byte offset of the instruction to resume at and returns; the interpreter
+// executes that instruction on the reference core. HALT, BREAK and
+// STORE_ABS call nvm_execute_instruction in place, ENTER, LEAVE, the bulk
+// memory and the vector opcodes call their helpers, SYSCALL calls
+// syscall_handler and leaves if it blocked. Preemption points charge
+// proc->budget like the interpreter and leave through the same path once
+// it runs out.
+//
+// Straight-line code leaves r15 alone; control transfers adjust it by the
+// distance jumped, and proc->retired is written from it before anything
+// that reads or counts it.
+
+typedef int (*jit_entry_t)(nvm_process_t* proc, void* target, uint64_t index);
+
+struct nvm_jit {
+    uint8_t* code;
+    size_t size;
+    uint32_t* native;           // Instruction index -> code offset
+};
+
+static pthread_mutex_t compile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+enum { FIX_NATIVE, FIX_STUB, FIX_TABLE };
+
+typedef struct {
+    uint32_t at;                // Offset of the rel32 (abs64 for FIX_TABLE) field
+    uint32_t target;            // Instruction index
+    uint8_t kind;
+} jit_fixup_t;
+
+typedef struct {
+    const nvm_program_t* program;
+    uint8_t* buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+    uint32_t* native;
+    uint32_t* stub;             // Deopt stub per instruction, UINT32_MAX if none
+    jit_fixup_t* fixups;
+    size_t fixup_count;
+    size_t fixup_cap;
+    uint32_t deopt;             // Epilogue: process still runnable
+    uint32_t stopped;           // Epilogue: process no longer active
+} jit_emitter_t;
+
+#define OFF_IP      ((int32_t)offsetof(nvm_process_t, ip))
+#define OFF_SP      ((int32_t)offsetof(nvm_process_t, sp))
+#define OFF_ACTIVE  ((int32_t)offsetof(nvm_process_t, active))
+#define OFF_BLOCKED ((int32_t)offsetof(nvm_process_t, blocked))
+#define OFF_STACK   ((int32_t)offsetof(nvm_process_t, stack))
+#define OFF_LOCALS  ((int32_t)offsetof(nvm_process_t, locals))
+#define OFF_BUDGET  ((int32_t)offsetof(nvm_process_t, budget))
+#define OFF_FRAME   ((int32_t)offsetof(nvm_process_t, frame))
+#define OFF_FRAME_SIZE ((int32_t)offsetof(nvm_process_t, frame_size))
+#define OFF_CALLS   ((int32_t)offsetof(nvm_process_t, calls))
+#define OFF_CSP     ((int32_t)offsetof(nvm_process_t, csp))
+#define OFF_HEAP    ((int32_t)offsetof(nvm_process_t, heap))
+#define OFF_HEAP_SIZE ((int32_t)offsetof(nvm_process_t, heap_size))
+#define OFF_RETIRED ((int32_t)offsetof(nvm_process_t, retired))
+
+// Registers for 32-bit operations
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+
+static void emit8(jit_emitter_t* e, uint8_t b) {
+    if(e->len >= e->cap) {
+        e->failed = true;
+        return;
+    }
+    e->buf[e->len++] = b;
+}
+
+static void emit32(jit_emitter_t* e, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        emit8(e, (uint8_t)(v >> (i * 8)));
+    }
+}
+
+static void emit64(jit_emitter_t* e, uint64_t v) {
+    emit32(e, (uint32_t)v);
+    emit32(e, (uint32_t)(v >> 32));
+}
+
+static void emit_bytes(jit_emitter_t* e, const uint8_t* bytes, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        emit8(e, bytes[i]);
+    }
+}
+
+#define EMIT(...) do {                                          \
+        static const uint8_t bytes_[] = { __VA_ARGS__ };        \
+        emit_bytes(e, bytes_, sizeof(bytes_));                  \
+    } while(0)
+
+static void patch32(jit_emitter_t* e, uint32_t at, uint32_t v) {
+    if(at + 4 <= e->len) {
+        memcpy(&e->buf[at], &v, 4);
+    }
+}
+
+static void add_fixup(jit_emitter_t* e, uint32_t target, uint8_t kind) {
+    if(e->fixup_count == e->fixup_cap) {
+        size_t cap = e->fixup_cap ? e->fixup_cap * 2 : 64;
+        jit_fixup_t* grown = realloc(e->fixups, cap * sizeof(jit_fixup_t));
+        if(!grown) {
+            e->failed = true;
+            return;
+        }
+        e->fixups = grown;
+        e->fixup_cap = cap;
+    }
+
+    e->fixups[e->fixup_count++] = (jit_fixup_t){ (uint32_t)e->len, target, kind };
+    if(kind == FIX_STUB) {
+        e->stub[target] = 0;    // Requested, emitted after the body
+    }
+    if(kind == FIX_TABLE) {
+        emit64(e, 0);
+    } else {
+        emit32(e, 0);
+    }
+}
+
+// rel32 to a known code offset
+static void emit_rel32(jit_emitter_t* e, uint32_t dest) {
+    emit32(e, dest - (uint32_t)(e->len + 4));
+}
+
+static void jmp_native(jit_emitter_t* e, uint32_t index) {
+    emit8(e, 0xE9);
+    add_fixup(e, index, FIX_NATIVE);
+}
+
+static void jmp_stub(jit_emitter_t* e, uint32_t index) {
+    emit8(e, 0xE9);
+    add_fixup(e, index, FIX_STUB);
+}
+
+// Two-byte jcc (0x0F 0x8x) to the deopt stub of `index`
+static void jcc_stub(jit_emitter_t* e, uint8_t cc, uint32_t index) {
+    emit8(e, 0x0F);
+    emit8(e, cc);
+    add_fixup(e, index, FIX_STUB);
+}
+
+#define CC_O  0x80
+#define CC_B  0x82
+#define CC_AE 0x83
+#define CC_E  0x84
+#define CC_NE 0x85
+#define CC_BE 0x86
+#define CC_A  0x87
+#define CC_L  0x8C
+#define CC_GE 0x8D
+#define CC_LE 0x8E
+#define CC_G  0x8F
+
+// mov reg, [rbx + r12*4 + disp]
+static void stack_load(jit_emitter_t* e, int reg, int8_t disp) {
+    emit8(e, 0x42); emit8(e, 0x8B); emit8(e, 0x44 | (reg << 3)); emit8(e, 0xA3); emit8(e, (uint8_t)disp);
+}
+
+// mov [rbx + r12*4 + disp], reg
+static void stack_store(jit_emitter_t* e, int reg, int8_t disp) {
+    emit8(e, 0x42); emit8(e, 0x89); emit8(e, 0x44 | (reg << 3)); emit8(e, 0xA3); emit8(e, (uint8_t)disp);
+}
+
+// mov reg64, [rbx + r12*4 + disp]
+static void stack_load64(jit_emitter_t* e, int reg, int8_t disp) {
+    emit8(e, 0x4A); emit8(e, 0x8B); emit8(e, 0x44 | (reg << 3)); emit8(e, 0xA3); emit8(e, (uint8_t)disp);
+}
+
+// mov [rbx + r12*4 + disp], reg64
+static void stack_store64(jit_emitter_t* e, int reg, int8_t disp) {
+    emit8(e, 0x4A); emit8(e, 0x89); emit8(e, 0x44 | (reg << 3)); emit8(e, 0xA3); emit8(e, (uint8_t)disp);
+}
+
+// movsxd reg64, dword [rbx + r12*4 + disp]
+static void stack_load_sx(jit_emitter_t* e, int reg, int8_t disp) {
+    emit8(e, 0x4A); emit8(e, 0x63); emit8(e, 0x44 | (reg << 3)); emit8(e, 0xA3); emit8(e, (uint8_t)disp);
+}
+
+// mov dword [rbx + r12*4], imm32
+static void stack_store_imm(jit_emitter_t* e, int32_t value) {
+    EMIT(0x42, 0xC7, 0x44, 0xA3, 0x00);
+    emit32(e, (uint32_t)value);
+}
+
+// mov reg, [r13 + index*4]
+static void local_load(jit_emitter_t* e, int reg, int32_t index) {
+    emit8(e, 0x41); emit8(e, 0x8B); emit8(e, 0x85 | (reg << 3));
+    emit32(e, (uint32_t)(index * 4));
+}
+
+// mov [r13 + index*4], reg
+static void local_store(jit_emitter_t* e, int reg, int32_t index) {
+    emit8(e, 0x41); emit8(e, 0x89); emit8(e, 0x85 | (reg << 3));
+    emit32(e, (uint32_t)(index * 4));
+}
+
+static void sp_inc(jit_emitter_t* e) { EMIT(0x49, 0xFF, 0xC4); }
+static void sp_dec(jit_emitter_t* e) { EMIT(0x49, 0xFF, 0xCC); }
+
+// mov dword [r14 + OFF_IP], imm32
+static void store_ip(jit_emitter_t* e, uint32_t offset) {
+    EMIT(0x41, 0xC7, 0x86);
+    emit32(e, (uint32_t)OFF_IP);
+    emit32(e, offset);
+}
+
+// mov [r14 + OFF_SP], r12d
+static void store_sp(jit_emitter_t* e) {
+    EMIT(0x45, 0x89, 0xA6);
+    emit32(e, (uint32_t)OFF_SP);
+}
+
+// mov r12d, [r14 + OFF_SP]
+static void load_sp(jit_emitter_t* e) {
+    EMIT(0x45, 0x8B, 0xA6);
+    emit32(e, (uint32_t)OFF_SP);
+}
+
+// proc->retired with instruction `index` next:
+// lea rax, [r15 + index]; mov [r14 + OFF_RETIRED], rax
+static void store_retired(jit_emitter_t* e, uint32_t index) {
+    EMIT(0x49, 0x8D, 0x87);
+    emit32(e, index);
+    EMIT(0x49, 0x89, 0x86);
+    emit32(e, (uint32_t)OFF_RETIRED);
+}
+
+// Transfer from the instruction before `next` to `to`: add r15, next - to
+static void emit_retire(jit_emitter_t* e, uint32_t next, uint32_t to) {
+    if(next != to) {
+        EMIT(0x49, 0x81, 0xC7);
+        emit32(e, next - to);
+    }
+}
+
+// cmp byte [r14 + OFF_ACTIVE], 0; je stopped
+static void check_active(jit_emitter_t* e) {
+    EMIT(0x41, 0x80, 0xBE);
+    emit32(e, (uint32_t)OFF_ACTIVE);
+    emit8(e, 0x00);
+    EMIT(0x0F, 0x84);
+    emit_rel32(e, e->stopped);
+}
+
+// movabs rax, fn; call rax
+static void call_abs(jit_emitter_t* e, const void* fn) {
+    EMIT(0x48, 0xB8);
+    emit64(e, (uint64_t)(uintptr_t)fn);
+    EMIT(0xFF, 0xD0);
+}
+
+// Run check for entering instruction `index`, as ENTER() in interp.c
+static void emit_check(jit_emitter_t* e, uint32_t index) {
+    nvm_block_t block = e->program->blocks[index];
+
+    if(block.need == NVM_BLOCK_NONE || block.grow == NVM_BLOCK_NONE) {
+        jmp_stub(e, index);
+        return;
+    }
+    if(block.need > 0) {
+        EMIT(0x49, 0x81, 0xFC);                             // cmp r12, need
+        emit32(e, block.need);
+        jcc_stub(e, CC_L, index);
+    }
+    if(block.grow > 0) {
+        EMIT(0x49, 0x81, 0xFC);                             // cmp r12, STACK_SIZE - grow
+        emit32(e, (uint32_t)(STACK_SIZE - (int32_t)block.grow));
+        jcc_stub(e, CC_G, index);
+    }
+}
+
+// Preemption point before entering instruction `index`:
+// sub dword [r14 + OFF_BUDGET], 1; jle stub
+static void emit_tick(jit_emitter_t* e, uint32_t index) {
+    EMIT(0x41, 0x83, 0xAE);
+    emit32(e, (uint32_t)OFF_BUDGET);
+    emit8(e, 0x01);
+    jcc_stub(e, CC_LE, index);
+}
+
+// Let the reference core execute instruction `index` and continue after it
+static void emit_callout(jit_emitter_t* e, uint32_t index) {
+    store_retired(e, index);
+    store_ip(e, e->program->offsets[index]);
+    store_sp(e);
+    EMIT(0x4C, 0x89, 0xF7);                                 // mov rdi, r14
+    call_abs(e, (const void*)nvm_execute_instruction);
+    check_active(e);
+    load_sp(e);
+}
+
+// Binary operation: eax = second, ecx = top
+static void binary_begin(jit_emitter_t* e) {
+    stack_load(e, EAX, -8);
+    stack_load(e, ECX, -4);
+}
+
+static void binary_end(jit_emitter_t* e, int reg) {
+    stack_store(e, reg, -8);
+    sp_dec(e);
+}
+
+// 64-bit binary operation on lo hi pairs: rax = a, rcx = b
+static void wide_begin(jit_emitter_t* e) {
+    stack_load64(e, EAX, -16);
+    stack_load64(e, ECX, -8);
+}
+
+static void wide_end(jit_emitter_t* e, int reg) {
+    stack_store64(e, reg, -16);
+    sp_dec(e);
+    sp_dec(e);
+}
+
+static void emit_setcc(jit_emitter_t* e, uint8_t setcc) {
+    EMIT(0x39, 0xC8);                                       // cmp eax, ecx
+    emit8(e, 0x0F); emit8(e, setcc); emit8(e, 0xC0);        // setcc al
+    EMIT(0x0F, 0xB6, 0xC0);                                 // movzx eax, al
+    binary_end(e, EAX);
+}
+
+static uint8_t negate_cc(uint8_t cc) {
+    return cc ^ 1;
+}
+
+// Branch on flags set by the caller: condition `cc` goes to `taken`,
+// otherwise continue at `fall`. The fall-through path is emitted last so it
+// can run straight into the next instruction when `fall_next` is set.
+// Backward branches are preemption points.
+static void emit_branch(jit_emitter_t* e, uint8_t cc, uint32_t taken, uint32_t fall, bool fall_next, bool back) {
+    emit8(e, 0x0F);
+    emit8(e, negate_cc(cc));
+    uint32_t rel = (uint32_t)e->len;
+    emit32(e, 0);
+
+    emit_retire(e, fall, taken);
+    emit_check(e, taken);
+    if(back) {
+        emit_tick(e, taken);
+    }
+    jmp_native(e, taken);
+
+    patch32(e, rel, (uint32_t)e->len - (rel + 4));
+    emit_check(e, fall);
+    if(!fall_next) {
+        jmp_native(e, fall);
+    }
+}
+
+// Return to byte offset eax, instruction ecx, with the run check and
+// preemption point of a return; on failure the interpreter resumes there.
+// `next` follows the returning instruction.
+static void emit_return(jit_emitter_t* e, uint32_t next) {
+    const nvm_program_t* program = e->program;
+
+    EMIT(0x49, 0x81, 0xC7);                                 // add r15, next
+    emit32(e, next);
+    EMIT(0x49, 0x29, 0xCF);                                 // sub r15, rcx
+
+    // Dynamic run check; on failure resume at the return address
+    EMIT(0x48, 0xBA);                                       // movabs rdx, blocks
+    emit64(e, (uint64_t)(uintptr_t)program->blocks);
+    EMIT(0x0F, 0xB7, 0x34, 0x8A);                           // movzx esi, word [rdx + rcx*4]
+    EMIT(0x49, 0x39, 0xF4);                                 // cmp r12, rsi
+    EMIT(0x0F, 0x8C);                                       // jl fail
+    uint32_t fail1 = (uint32_t)e->len;
+    emit32(e, 0);
+    EMIT(0x0F, 0xB7, 0x74, 0x8A, 0x02);                     // movzx esi, word [rdx + rcx*4 + 2]
+    EMIT(0x4C, 0x01, 0xE6);                                 // add rsi, r12
+    EMIT(0x48, 0x81, 0xFE);                                 // cmp rsi, STACK_SIZE
+    emit32(e, STACK_SIZE);
+    EMIT(0x0F, 0x8F);                                       // jg fail
+    uint32_t fail2 = (uint32_t)e->len;
+    emit32(e, 0);
+    EMIT(0x41, 0x83, 0xAE);                                 // sub dword [r14 + OFF_BUDGET], 1
+    emit32(e, (uint32_t)OFF_BUDGET);
+    emit8(e, 0x01);
+    EMIT(0x0F, 0x8E);                                       // jle fail
+    uint32_t fail3 = (uint32_t)e->len;
+    emit32(e, 0);
+    EMIT(0x48, 0xBA);                                       // movabs rdx, native table
+    add_fixup(e, 0, FIX_TABLE);
+    EMIT(0xFF, 0x24, 0xCA);                                 // jmp [rdx + rcx*8]
+
+    patch32(e, fail1, (uint32_t)e->len - (fail1 + 4));
+    patch32(e, fail2, (uint32_t)e->len - (fail2 + 4));
+    patch32(e, fail3, (uint32_t)e->len - (fail3 + 4));
+    EMIT(0x41, 0x89, 0x86);                                 // mov [r14 + OFF_IP], eax
+    emit32(e, (uint32_t)OFF_IP);
+    EMIT(0x49, 0x8D, 0x04, 0x0F);                           // lea rax, [r15 + rcx]
+    EMIT(0x49, 0x89, 0x86);                                 // mov [r14 + OFF_RETIRED], rax
+    emit32(e, (uint32_t)OFF_RETIRED);
+    emit8(e, 0xE9);
+    emit_rel32(e, e->deopt);
+}
+
+static void emit_insn(jit_emitter_t* e, uint32_t i) {
+    const nvm_program_t* program = e->program;
+    const nvm_insn_t* insn = &program->code[i];
+
+    switch(insn->op) {
+        case OP_NOP:
+            break;
+
+        case OP_PUSH:
+            stack_store_imm(e, insn->arg);
+            sp_inc(e);
+            break;
+
+        case OP_POP:
+            sp_dec(e);
+            break;
+
+        case OP_DUP:
+            stack_load(e, EAX, -4);
+            stack_store(e, EAX, 0);
+            sp_inc(e);
+            break;
+
+        case OP_SWAP:
+            stack_load(e, EAX, -4);
+            stack_load(e, ECX, -8);
+            stack_store(e, EAX, -8);
+            stack_store(e, ECX, -4);
+            break;
+
+        case OP_ADD:
+            binary_begin(e);
+            EMIT(0x01, 0xC8);                               // add eax, ecx
+            binary_end(e, EAX);
+            break;
+
+        case OP_SUB:
+            binary_begin(e);
+            EMIT(0x29, 0xC8);                               // sub eax, ecx
+            binary_end(e, EAX);
+            break;
+
+        case OP_MUL:
+            binary_begin(e);
+            EMIT(0x0F, 0xAF, 0xC1);                         // imul eax, ecx
+            binary_end(e, EAX);
+            break;
+
+        // A divisor of 0 or -1 leaves for the reference core, which wraps or
+        // stops the process
+        case OP_DIV:
+        case OP_MOD:
+        case OP_DIVC:
+        case OP_MODC:
+            binary_begin(e);
+            EMIT(0x85, 0xC9);                               // test ecx, ecx
+            jcc_stub(e, CC_E, i);
+            EMIT(0x83, 0xF9, 0xFF);                         // cmp ecx, -1: INT32_MIN / -1 faults
+            jcc_stub(e, CC_E, i);
+            EMIT(0x99, 0xF7, 0xF9);                         // cdq; idiv ecx
+            binary_end(e, insn->op == OP_DIV || insn->op == OP_DIVC ? EAX : EDX);
+            break;
+
+        case OP_CMP:
+            binary_begin(e);
+            EMIT(0x39, 0xC8,                                // cmp eax, ecx
+                 0x0F, 0x9F, 0xC2,                          // setg dl
+                 0x0F, 0x9C, 0xC0,                          // setl al
+                 0x0F, 0xB6, 0xD2,                          // movzx edx, dl
+                 0x0F, 0xB6, 0xC0,                          // movzx eax, al
+                 0x29, 0xC2);                               // sub edx, eax
+            binary_end(e, EDX);
+            break;
+
+        // Overflow leaves for the reference core, which stops the process
+        case OP_ADDC:
+            binary_begin(e);
+            EMIT(0x01, 0xC8);                               // add eax, ecx
+            jcc_stub(e, CC_O, i);
+            binary_end(e, EAX);
+            break;
+
+        case OP_SUBC:
+            binary_begin(e);
+            EMIT(0x29, 0xC8);                               // sub eax, ecx
+            jcc_stub(e, CC_O, i);
+            binary_end(e, EAX);
+            break;
+
+        case OP_MULC:
+            binary_begin(e);
+            EMIT(0x0F, 0xAF, 0xC1);                         // imul eax, ecx
+            jcc_stub(e, CC_O, i);
+            binary_end(e, EAX);
+            break;
+
+        case OP_FMUL:
+            stack_load_sx(e, EAX, -8);
+            stack_load_sx(e, ECX, -4);
+            EMIT(0x48, 0x0F, 0xAF, 0xC1);                   // imul rax, rcx
+            EMIT(0x48, 0xC1, 0xF8);                         // sar rax, shift
+            emit8(e, (uint8_t)(insn->arg & 31));
+            binary_end(e, EAX);
+            break;
+
+        case OP_FDIV:
+            stack_load_sx(e, ECX, -4);
+            EMIT(0x48, 0x85, 0xC9);                         // test rcx, rcx
+            jcc_stub(e, CC_E, i);
+            stack_load_sx(e, EAX, -8);
+            EMIT(0x48, 0xC1, 0xE0);                         // shl rax, shift
+            emit8(e, (uint8_t)(insn->arg & 31));
+            EMIT(0x48, 0x99, 0x48, 0xF7, 0xF9);             // cqo; idiv rcx
+            binary_end(e, EAX);
+            break;
+
+        // A 64-bit pair is one little-endian qword on the stack
+        case OP_ADD64:
+        case OP_ADD64C:
+            wide_begin(e);
+            EMIT(0x48, 0x01, 0xC8);                         // add rax, rcx
+            if(insn->op == OP_ADD64C) {
+                jcc_stub(e, CC_O, i);
+            }
+            wide_end(e, EAX);
+            break;
+
+        case OP_SUB64:
+        case OP_SUB64C:
+            wide_begin(e);
+            EMIT(0x48, 0x29, 0xC8);                         // sub rax, rcx
+            if(insn->op == OP_SUB64C) {
+                jcc_stub(e, CC_O, i);
+            }
+            wide_end(e, EAX);
+            break;
+
+        case OP_MUL64:
+        case OP_MUL64C:
+            wide_begin(e);
+            EMIT(0x48, 0x0F, 0xAF, 0xC1);                   // imul rax, rcx
+            if(insn->op == OP_MUL64C) {
+                jcc_stub(e, CC_O, i);
+            }
+            wide_end(e, EAX);
+            break;
+
+        case OP_DIV64:
+        case OP_MOD64:
+        case OP_DIV64C:
+        case OP_MOD64C:
+            wide_begin(e);
+            EMIT(0x48, 0x85, 0xC9);                         // test rcx, rcx
+            jcc_stub(e, CC_E, i);
+            EMIT(0x48, 0x83, 0xF9, 0xFF);                   // cmp rcx, -1
+            jcc_stub(e, CC_E, i);
+            EMIT(0x48, 0x99, 0x48, 0xF7, 0xF9);             // cqo; idiv rcx
+            wide_end(e, insn->op == OP_DIV64 || insn->op == OP_DIV64C ? EAX : EDX);
+            break;
+
+        case OP_CMP64:
+            wide_begin(e);
+            EMIT(0x48, 0x39, 0xC8,                          // cmp rax, rcx
+                 0x0F, 0x9F, 0xC2,                          // setg dl
+                 0x0F, 0x9C, 0xC0,                          // setl al
+                 0x0F, 0xB6, 0xD2,                          // movzx edx, dl
+                 0x0F, 0xB6, 0xC0,                          // movzx eax, al
+                 0x29, 0xC2);                               // sub edx, eax
+            stack_store(e, EDX, -16);
+            sp_dec(e);
+            sp_dec(e);
+            sp_dec(e);
+            break;
+
+        case OP_EXT64:
+            stack_load(e, EAX, -4);
+            EMIT(0xC1, 0xF8, 0x1F);                         // sar eax, 31
+            stack_store(e, EAX, 0);
+            sp_inc(e);
+            break;
+
+        case OP_EQ:  binary_begin(e); emit_setcc(e, 0x94); break;
+        case OP_NEQ: binary_begin(e); emit_setcc(e, 0x95); break;
+        case OP_GT:  binary_begin(e); emit_setcc(e, 0x9F); break;
+        case OP_LT:  binary_begin(e); emit_setcc(e, 0x9C); break;
+
+        case OP_JMP:
+            emit_retire(e, i + 1, (uint32_t)insn->arg);
+            emit_check(e, (uint32_t)insn->arg);
+            if((uint32_t)insn->arg <= i) {
+                emit_tick(e, (uint32_t)insn->arg);
+            }
+            jmp_native(e, (uint32_t)insn->arg);
+            break;
+
+        case OP_JZ:
+        case OP_JNZ:
+            stack_load(e, EAX, -4);
+            sp_dec(e);
+            EMIT(0x85, 0xC0);                               // test eax, eax
+            emit_branch(e, insn->op == OP_JZ ? CC_E : CC_NE, (uint32_t)insn->arg, i + 1, true,
+                        (uint32_t)insn->arg <= i);
+            break;
+
+        case OP_CALL:
+            stack_store_imm(e, (int32_t)program->offsets[i + 1]);
+            sp_inc(e);
+            emit_retire(e, i + 1, (uint32_t)insn->arg);
+            emit_check(e, (uint32_t)insn->arg);
+            emit_tick(e, (uint32_t)insn->arg);
+            jmp_native(e, (uint32_t)insn->arg);
+            break;
+
+        case OP_RET: {
+            stack_load(e, EAX, -4);
+            EMIT(0x83, 0xF8, 0x04);                         // cmp eax, 4
+            jcc_stub(e, CC_B, i);
+            EMIT(0x3D);                                     // cmp eax, size
+            emit32(e, program->size);
+            jcc_stub(e, CC_AE, i);
+            EMIT(0x48, 0xBA);                               // movabs rdx, index
+            emit64(e, (uint64_t)(uintptr_t)program->index);
+            EMIT(0x8B, 0x0C, 0x82);                         // mov ecx, [rdx + rax*4]
+            EMIT(0x83, 0xF9, 0xFF);                         // cmp ecx, NVM_NO_INSN
+            jcc_stub(e, CC_E, i);
+            sp_dec(e);
+            emit_return(e, i + 1);
+            break;
+        }
+
+        case OP_CALLF:
+            EMIT(0x41, 0x8B, 0x86);                         // mov eax, [r14 + OFF_CSP]
+            emit32(e, (uint32_t)OFF_CSP);
+            EMIT(0x48, 0xBA);                               // movabs rdx, &nvm_call_depth
+            emit64(e, (uint64_t)(uintptr_t)&nvm_call_depth);
+            EMIT(0x3B, 0x02);                               // cmp eax, [rdx]
+            jcc_stub(e, CC_AE, i);
+            EMIT(0x49, 0x8B, 0x96);                         // mov rdx, [r14 + OFF_CALLS]
+            emit32(e, (uint32_t)OFF_CALLS);
+            EMIT(0xC7, 0x04, 0x82);                         // mov dword [rdx + rax*4], return offset
+            emit32(e, program->offsets[i + 1]);
+            EMIT(0xFF, 0xC0);                               // inc eax
+            EMIT(0x41, 0x89, 0x86);                         // mov [r14 + OFF_CSP], eax
+            emit32(e, (uint32_t)OFF_CSP);
+            emit_retire(e, i + 1, (uint32_t)insn->arg);
+            emit_check(e, (uint32_t)insn->arg);
+            emit_tick(e, (uint32_t)insn->arg);
+            jmp_native(e, (uint32_t)insn->arg);
+            break;
+
+        case OP_RETF:
+            EMIT(0x41, 0x8B, 0x86);                         // mov eax, [r14 + OFF_CSP]
+            emit32(e, (uint32_t)OFF_CSP);
+            EMIT(0x85, 0xC0);                               // test eax, eax
+            jcc_stub(e, CC_E, i);
+            EMIT(0xFF, 0xC8);                               // dec eax
+            EMIT(0x41, 0x89, 0x86);                         // mov [r14 + OFF_CSP], eax
+            emit32(e, (uint32_t)OFF_CSP);
+            EMIT(0x49, 0x8B, 0x96);                         // mov rdx, [r14 + OFF_CALLS]
+            emit32(e, (uint32_t)OFF_CALLS);
+            EMIT(0x8B, 0x04, 0x82);                         // mov eax, [rdx + rax*4]
+            EMIT(0x48, 0xBA);                               // movabs rdx, index
+            emit64(e, (uint64_t)(uintptr_t)program->index);
+            EMIT(0x8B, 0x0C, 0x82);                         // mov ecx, [rdx + rax*4]
+            emit_return(e, i + 1);
+            break;
+
+        case OP_ENTER:
+        case OP_LEAVE:
+            EMIT(0x4C, 0x89, 0xF7);                         // mov rdi, r14
+            if(insn->op == OP_ENTER) {
+                emit8(e, 0xBE);                             // mov esi, size
+                emit32(e, (uint32_t)insn->arg);
+                call_abs(e, (const void*)nvm_frame_enter);
+            } else {
+                call_abs(e, (const void*)nvm_frame_leave);
+            }
+            EMIT(0x84, 0xC0);                               // test al, al
+            jcc_stub(e, CC_E, i);
+            break;
+
+        case OP_LOADF:
+        case OP_STOREF:
+            EMIT(0x41, 0x81, 0xBE);                         // cmp dword [r14 + OFF_FRAME_SIZE], n
+            emit32(e, (uint32_t)OFF_FRAME_SIZE);
+            emit32(e, (uint32_t)insn->arg);
+            jcc_stub(e, CC_BE, i);
+            EMIT(0x49, 0x8B, 0x96);                         // mov rdx, [r14 + OFF_FRAME]
+            emit32(e, (uint32_t)OFF_FRAME);
+            if(insn->op == OP_LOADF) {
+                EMIT(0x8B, 0x82);                           // mov eax, [rdx + n*4]
+                emit32(e, (uint32_t)(insn->arg * 4));
+                stack_store(e, EAX, 0);
+                sp_inc(e);
+            } else {
+                stack_load(e, EAX, -4);
+                EMIT(0x89, 0x82);                           // mov [rdx + n*4], eax
+                emit32(e, (uint32_t)(insn->arg * 4));
+                sp_dec(e);
+            }
+            break;
+
+        case OP_LOAD:
+            local_load(e, EAX, insn->arg);
+            stack_store(e, EAX, 0);
+            sp_inc(e);
+            break;
+
+        case OP_STORE:
+            stack_load(e, EAX, -4);
+            local_store(e, EAX, insn->arg);
+            sp_dec(e);
+            break;
+
+        case OP_LOAD8:
+        case OP_LOAD16:
+        case OP_LOAD32:
+        case OP_STORE8:
+        case OP_STORE16:
+        case OP_STORE32: {
+            bool load = insn->op <= OP_LOAD32;
+            uint8_t width = 1 << ((insn->op - OP_LOAD8) % 3);
+            stack_load(e, EAX, load ? -4 : -8);             // eax = address
+            EMIT(0x41, 0x8B, 0x96);                         // mov edx, [r14 + OFF_HEAP_SIZE]
+            emit32(e, (uint32_t)OFF_HEAP_SIZE);
+            EMIT(0x48, 0x8D, 0x70);                         // lea rsi, [rax + width]
+            emit8(e, width);
+            EMIT(0x48, 0x39, 0xD6);                         // cmp rsi, rdx
+            jcc_stub(e, CC_A, i);
+            EMIT(0x49, 0x8B, 0x96);                         // mov rdx, [r14 + OFF_HEAP]
+            emit32(e, (uint32_t)OFF_HEAP);
+            if(load) {
+                if(width == 1) {
+                    EMIT(0x0F, 0xB6, 0x04, 0x02);           // movzx eax, byte [rdx + rax]
+                } else if(width == 2) {
+                    EMIT(0x0F, 0xB7, 0x04, 0x02);           // movzx eax, word [rdx + rax]
+                } else {
+                    EMIT(0x8B, 0x04, 0x02);                 // mov eax, [rdx + rax]
+                }
+                stack_store(e, EAX, -4);
+            } else {
+                stack_load(e, ECX, -4);
+                if(width == 1) {
+                    EMIT(0x88, 0x0C, 0x02);                 // mov [rdx + rax], cl
+                } else if(width == 2) {
+                    EMIT(0x66, 0x89, 0x0C, 0x02);           // mov [rdx + rax], cx
+                } else {
+                    EMIT(0x89, 0x0C, 0x02);                 // mov [rdx + rax], ecx
+                }
+                sp_dec(e);
+                sp_dec(e);
+            }
+            break;
+        }
+
+        case OP_MEMCPY:
+        case OP_MEMSET:
+        case OP_MEMCMP:
+            EMIT(0x4C, 0x89, 0xF7);                         // mov rdi, r14
+            stack_load(e, ESI, -12);
+            stack_load(e, EDX, -8);
+            stack_load(e, ECX, -4);
+            if(insn->op == OP_MEMCMP) {
+                call_abs(e, (const void*)nvm_heap_compare);
+                EMIT(0x83, 0xF8, NVM_HEAP_FAULT);           // cmp eax, NVM_HEAP_FAULT
+                jcc_stub(e, CC_E, i);
+                stack_store(e, EAX, -12);
+            } else {
+                call_abs(e, insn->op == OP_MEMCPY ? (const void*)nvm_heap_copy : (const void*)nvm_heap_fill);
+                EMIT(0x84, 0xC0);                           // test al, al
+                jcc_stub(e, CC_E, i);
+                sp_dec(e);
+            }
+            sp_dec(e);
+            sp_dec(e);
+            break;
+
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VMIN: case OP_VMAX:
+        case OP_VSUM: case OP_VRMIN: case OP_VRMAX: case OP_VDOT:
+        case OP_VCOUNTEQ: case OP_VCOUNTGT: case OP_VCOUNTLT:
+            store_sp(e);
+            EMIT(0x4C, 0x89, 0xF7);                         // mov rdi, r14
+            emit8(e, 0xBE);                                 // mov esi, op
+            emit32(e, insn->op);
+            call_abs(e, (const void*)nvm_vector_exec);
+            EMIT(0x84, 0xC0);                               // test al, al
+            jcc_stub(e, CC_E, i);                           // sp is unchanged on failure
+            load_sp(e);
+            break;
+
+        case OP_SYSCALL:
+            store_retired(e, i + 1);                        // Taken back if it blocks
+            store_ip(e, program->offsets[i] + 2);
+            store_sp(e);
+            emit8(e, 0xBF);                                 // mov edi, id
+            emit32(e, (uint32_t)(int32_t)(int8_t)insn->arg);
+            EMIT(0x4C, 0x89, 0xF6);                         // mov rsi, r14
+            call_abs(e, (const void*)syscall_handler);
+            check_active(e);
+            EMIT(0x41, 0x80, 0xBE);                         // cmp byte [r14 + OFF_BLOCKED], 0
+            emit32(e, (uint32_t)OFF_BLOCKED);
+            emit8(e, 0x00);
+            EMIT(0x0F, 0x85);                               // jne stopped, ip is back at the syscall
+            emit_rel32(e, e->stopped);
+            load_sp(e);
+            if(i + 1 < program->count) {
+                emit_check(e, i + 1);
+            } else {
+                // Only reachable if the syscall returned; let the reference
+                // core report running off the end
+                store_ip(e, program->offsets[i] + 2);
+                emit8(e, 0xE9);
+                emit_rel32(e, e->deopt);
+            }
+            break;
+
+        case OP_HALT:
+        case OP_BREAK:
+        case OP_STORE_ABS:
+            emit_callout(e, i);
+            break;
+
+        case OP_LOAD_PUSH_CMP_BRANCH: {
+            uint8_t cc;
+            switch(insn->aux[0]) {
+                case OP_GT: cc = CC_G; break;
+                case OP_LT: cc = CC_L; break;
+                case OP_EQ: cc = CC_E; break;
+                default:    cc = CC_NE; break;
+            }
+            local_load(e, EAX, insn->aux[2]);
+            EMIT(0x3D);                                     // cmp eax, K
+            emit32(e, (uint32_t)insn->arg);
+            emit_branch(e, insn->aux[1] ? cc : negate_cc(cc), (uint32_t)insn[3].arg, i + 4, false,
+                        (uint32_t)insn[3].arg <= i);
+            break;
+        }
+
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL:
+            EMIT(0x41, 0x81);                               // add|sub dword [r13 + n*4], K
+            emit8(e, insn->op == OP_INC_LOCAL ? 0x85 : 0xAD);
+            emit32(e, (uint32_t)(insn->aux[2] * 4));
+            emit32(e, (uint32_t)insn->arg);
+            jmp_native(e, i + 4);
+            break;
+
+        case OP_PUSH_ADD:
+            EMIT(0x42, 0x81, 0x44, 0xA3, 0xFC);             // add dword [rbx + r12*4 - 4], K
+            emit32(e, (uint32_t)insn->arg);
+            jmp_native(e, i + 2);
+            break;
+
+        default:
+            // Anything unknown is left to the interpreter
+            jmp_stub(e, i);
+            break;
+    }
+}
+
+static nvm_jit_t* jit_compile(const nvm_program_t* program) {
+    jit_emitter_t em = { 0 };
+    jit_emitter_t* e = &em;
+    nvm_jit_t* jit = NULL;
+
+    e->program = program;
+    e->cap = 128 + (size_t)program->count * 128;
+    e->buf = malloc(e->cap);
+    e->native = malloc(program->count * sizeof(uint32_t));
+    e->stub = malloc(program->count * sizeof(uint32_t));
+    if(!e->buf || !e->native || !e->stub) {
+        goto done;
+    }
+    memset(e->stub, 0xFF, program->count * sizeof(uint32_t));
+
+    // Entry: int entry(nvm_process_t* proc, void* target, uint64_t index)
+    EMIT(0x53,                                              // push rbx
+         0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,    // push r12..r15
+         0x49, 0x89, 0xFE);                                 // mov r14, rdi
+    EMIT(0x49, 0x8B, 0x9E);                                 // mov rbx, [r14 + OFF_STACK]
+    emit32(e, (uint32_t)OFF_STACK);
+    EMIT(0x4D, 0x8B, 0xAE);                                 // mov r13, [r14 + OFF_LOCALS]
+    emit32(e, (uint32_t)OFF_LOCALS);
+    load_sp(e);
+    EMIT(0x4D, 0x8B, 0xBE);                                 // mov r15, [r14 + OFF_RETIRED]
+    emit32(e, (uint32_t)OFF_RETIRED);
+    EMIT(0x49, 0x29, 0xD7);                                 // sub r15, rdx
+    EMIT(0xFF, 0xE6);                                       // jmp rsi
+
+    // Exits
+    e->deopt = (uint32_t)e->len;
+    store_sp(e);
+    EMIT(0xB8, 0x01, 0x00, 0x00, 0x00);                     // mov eax, 1
+    uint32_t common = (uint32_t)e->len + 7;
+    EMIT(0xEB, 0x05);                                       // jmp common
+    e->stopped = (uint32_t)e->len;
+    EMIT(0xB8, 0x00, 0x00, 0x00, 0x00);                     // mov eax, 0
+    if(e->len != common) {
+        e->failed = true;
+    }
+    EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C,    // pop r15..r12
+         0x5B, 0xC3);                                       // pop rbx; ret
+
+    for(uint32_t i = 0; i < program->count && !e->failed; i++) {
+        e->native[i] = (uint32_t)e->len;
+        emit_insn(e, i);
+    }
+
+    // Deopt stubs: resume the interpreter at the instruction
+    for(uint32_t i = 0; i < program->count && !e->failed; i++) {
+        if(e->stub[i] == UINT32_MAX) {
+            continue;
+        }
+        e->stub[i] = (uint32_t)e->len;
+        store_retired(e, i);
+        store_ip(e, program->offsets[i]);
+        emit8(e, 0xE9);
+        emit_rel32(e, e->deopt);
+    }
+
+    if(e->failed) {
+        goto done;
+    }
+
+    jit = calloc(1, sizeof(nvm_jit_t));
+    if(!jit) {
+        goto done;
+    }
+    jit->size = e->len + program->count * sizeof(uint64_t);
+    jit->code = mmap(NULL, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->code == MAP_FAILED) {
+        free(jit);
+        jit = NULL;
+        goto done;
+    }
+
+    // Native address table for RET lives right after the code
+    uint64_t* table = (uint64_t*)(jit->code + ((e->len + 7) & ~(size_t)7));
+    jit->size += 8;
+
+    for(size_t f = 0; f < e->fixup_count; f++) {
+        jit_fixup_t* fix = &e->fixups[f];
+        if(fix->kind == FIX_TABLE) {
+            uint64_t addr = (uint64_t)(uintptr_t)table;
+            memcpy(&e->buf[fix->at], &addr, 8);
+            continue;
+        }
+        uint32_t dest = fix->kind == FIX_STUB ? e->stub[fix->target] : e->native[fix->target];
+        patch32(e, fix->at, dest - (fix->at + 4));
+    }
+
+    memcpy(jit->code, e->buf, e->len);
+    for(uint32_t i = 0; i < program->count; i++) {
+        table[i] = (uint64_t)(uintptr_t)(jit->code + e->native[i]);
+    }
+
+    if(mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(jit->code, jit->size);
+        free(jit);
+        jit = NULL;
+        goto done;
+    }
+
+    jit->native = e->native;
+    e->native = NULL;
+
+done:
+    free(e->buf);
+    free(e->native);
+    free(e->stub);
+    free(e->fixups);
+    return jit;
+}
+
+void nvm_jit_free(nvm_jit_t* jit) {
+    if(!jit) {
+        return;
+    }
+
+    munmap(jit->code, jit->size);
+    free(jit->native);
+    free(jit);
+}
+
+bool nvm_jit_run(nvm_process_t* proc) {
+    nvm_program_t* program = proc->program;
+
+    if(!nvm_jit_enabled || atomic_load_explicit(&program->jit_failed, memory_order_relaxed)) {
+        return false;
+    }
+
+    // Processes sharing the program may get hot together, compile it once
+    nvm_jit_t* jit = atomic_load_explicit(&program->jit, memory_order_acquire);
+    if(!jit) {
+        pthread_mutex_lock(&compile_lock);
+        jit = atomic_load_explicit(&program->jit, memory_order_acquire);
+        if(!jit && !atomic_load(&program->jit_failed)) {
+            jit = jit_compile(program);
+            if(jit) {
+                atomic_store_explicit(&program->jit, jit, memory_order_release);
+            } else {
+                atomic_store(&program->jit_failed, true);
+            }
+        }
+        pthread_mutex_unlock(&compile_lock);
+        if(!jit) {
+            return false;
+        }
+    }
+
+    uint32_t index = program->index[proc->ip];
+    jit_entry_t entry = (jit_entry_t)(void*)jit->code;
+    entry(proc, jit->code + jit->native[index], index);
+    return true;
+}
+
+#else
+
+bool nvm_jit_run(nvm_process_t* proc) {
+    (void)proc;
+    return false;
+}
+
+void nvm_jit_free(nvm_jit_t* jit) {
+    (void)jit;
+}
+
+#endif // NVM_JIT
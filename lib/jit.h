@@ -0,0 +1,31 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Baseline JIT, override with -DNVM_JIT=0 in CFLAGS
+#ifndef NVM_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define NVM_JIT 1
+#else
+#define NVM_JIT 0
+#endif
+#endif
+
+// Back-edges and calls executed by a program before it is compiled
+#ifndef NVM_JIT_THRESHOLD
+#define NVM_JIT_THRESHOLD 1000
+#endif
+
+extern bool nvm_jit_enabled;
+
+// Compile proc->program if needed and run native code from proc->ip, which
+// must be a run start that passed its check. Returns false when no native
+// code is available; otherwise the process state is up to date and proc->ip
+// is the instruction the interpreter has to execute next.
+bool nvm_jit_run(nvm_process_t* proc);
+void nvm_jit_free(nvm_jit_t* jit);
+
+#endif // JIT_H
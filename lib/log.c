@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <log.h>
+
+// Asynchronous logging.
+//
+// Every thread that logs owns a ring of binary records: timestamp, level,
+// the format string as format id, and the raw arguments with strings copied
+// in. Recording never locks or waits; when the ring is full the record is
+// dropped and counted. A writer thread drains the rings oldest record
+// first, formats them and writes in batches, flushing only when it runs
+// out of records. The ring of an exited thread goes to the next thread that
+// starts logging.
+
+#define LOG_RING_SIZE   (64 * 1024)     // Bytes per thread, power of two
+#define LOG_MAX_RECORD  512             // Bytes, header included
+#define LOG_MAX_STRING  128             // Longest %s argument kept
+#define LOG_LINE        1024
+#define LOG_IDLE_NS     1000000         // Writer poll interval while idle
+
+enum { RECORD_LOG, RECORD_OUTPUT };
+
+typedef struct {
+    uint32_t size;              // Whole record, a multiple of 8
+    uint8_t kind;
+    uint8_t level;
+    uint16_t length;            // Bytes of program output
+    uint64_t time;              // Monotonic ns
+    const char* format;
+} log_record_t;
+
+typedef struct log_ring {
+    _Alignas(64) _Atomic uint64_t tail;     // Next byte to write, owner only
+    _Alignas(64) _Atomic uint64_t head;     // Next byte to read, writer only
+    _Atomic uint64_t dropped;               // Records lost to a full ring
+    uint64_t reported;                      // Drops already reported
+    _Atomic bool owned;                     // A live thread records here
+    struct log_ring* next;
+    uint8_t data[LOG_RING_SIZE];
+} log_ring_t;
+
+_Atomic int log_threshold = -1;
+
+static int log_level = LOG_LEVEL_TRACE;
+static log_output_t log_output = LOG_OUTPUT_NONE;
+static FILE* log_file = NULL;
+
+static _Atomic(log_ring_t*) rings = NULL;
+static _Thread_local log_ring_t* own_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static pthread_t writer;
+static bool writer_running = false;
+static _Atomic bool writer_stop = false;
+
+static const char* const level_names[] = {"FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+static const char* const level_keys[] = {"fatal", "error", "warn", "info", "debug", "trace"};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void ring_disown(void* ring) {
+    atomic_store(&((log_ring_t*)ring)->owned, false);
+}
+
+static void ring_key_create() {
+    pthread_key_create(&ring_key, ring_disown);
+}
+
+static log_ring_t* ring_get() {
+    if(own_ring) {
+        return own_ring;
+    }
+
+    for(log_ring_t* ring = atomic_load(&rings); ring; ring = ring->next) {
+        bool owned = false;
+        if(atomic_compare_exchange_strong(&ring->owned, &owned, true)) {
+            own_ring = ring;
+            break;
+        }
+    }
+
+    if(!own_ring) {
+        log_ring_t* ring = aligned_alloc(64, sizeof(log_ring_t));
+        if(!ring) {
+            return NULL;
+        }
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->dropped, 0);
+        ring->reported = 0;
+        atomic_init(&ring->owned, true);
+        ring->next = atomic_load(&rings);
+        while(!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+        }
+        own_ring = ring;
+    }
+
+    pthread_once(&ring_once, ring_key_create);
+    pthread_setspecific(ring_key, own_ring);
+    return own_ring;
+}
+
+static void ring_copy_in(log_ring_t* ring, uint64_t at, const void* src, uint32_t size) {
+    uint32_t offset = (uint32_t)(at & (LOG_RING_SIZE - 1));
+    uint32_t first = size < LOG_RING_SIZE - offset ? size : LOG_RING_SIZE - offset;
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const uint8_t*)src + first, size - first);
+}
+
+static void ring_copy_out(log_ring_t* ring, uint64_t at, void* dst, uint32_t size) {
+    uint32_t offset = (uint32_t)(at & (LOG_RING_SIZE - 1));
+    uint32_t first = size < LOG_RING_SIZE - offset ? size : LOG_RING_SIZE - offset;
+    memcpy(dst, ring->data + offset, first);
+    memcpy((uint8_t*)dst + first, ring->data, size - first);
+}
+
+static bool ring_put(log_ring_t* ring, const void* record, uint32_t size) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if(tail + size - head > LOG_RING_SIZE) {
+        return false;
+    }
+
+    ring_copy_in(ring, tail, record, size);
+    atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+    return true;
+}
+
+void log_write(int level, const char* format, ...) {
+    log_ring_t* ring = ring_get();
+    if(!ring) {
+        return;
+    }
+
+    uint64_t record[LOG_MAX_RECORD / 8];
+    uint8_t* bytes = (uint8_t*)record;
+    uint32_t pos = sizeof(log_record_t);
+
+    // Arguments are stored as 64-bit values in format order; strings as
+    // their length followed by the bytes. Whatever does not fit is left out.
+    va_list args;
+    va_start(args, format);
+    for(const char* f = format; *f; f++) {
+        if(*f != '%' || f[1] == '\0') {
+            continue;
+        }
+
+        uint64_t value;
+        switch(*++f) {
+            case 'd':
+            case 'c':
+                value = (uint64_t)(int64_t)va_arg(args, int);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                value = va_arg(args, unsigned int);
+                break;
+            case 'p':
+                value = (uintptr_t)va_arg(args, void*);
+                break;
+            case 's': {
+                const char* str = va_arg(args, const char*);
+                if(!str) {
+                    str = "(null)";
+                }
+                if(pos + 8 > LOG_MAX_RECORD) {
+                    goto full;
+                }
+                uint32_t len = (uint32_t)strnlen(str, LOG_MAX_STRING);
+                if(pos + 8 + len > LOG_MAX_RECORD) {
+                    len = LOG_MAX_RECORD - pos - 8;
+                }
+                value = len;
+                memcpy(bytes + pos, &value, 8);
+                memcpy(bytes + pos + 8, str, len);
+                pos = (pos + 8 + len + 7) & ~7u;
+                continue;
+            }
+            default:
+                continue;
+        }
+
+        if(pos + 8 > LOG_MAX_RECORD) {
+            goto full;
+        }
+        memcpy(bytes + pos, &value, 8);
+        pos += 8;
+    }
+full:
+    va_end(args);
+
+    log_record_t* header = (log_record_t*)record;
+    header->size = pos;
+    header->kind = RECORD_LOG;
+    header->level = (uint8_t)level;
+    header->length = 0;
+    header->time = now_ns();
+    header->format = format;
+
+    if(!ring_put(ring, record, pos)) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    }
+}
+
+bool log_shares_stdout() {
+    return log_output == LOG_OUTPUT_STDOUT && writer_running;
+}
+
+void log_stdout(const char* data, size_t len) {
+    log_ring_t* ring = NULL;
+    if(log_output == LOG_OUTPUT_STDOUT && writer_running) {
+        ring = ring_get();
+    }
+    if(!ring) {
+        fwrite(data, 1, len, stdout);
+        return;
+    }
+
+    // Program output is never dropped; wait for the writer instead
+    uint64_t record[LOG_MAX_RECORD / 8];
+    log_record_t* header = (log_record_t*)record;
+    while(len > 0) {
+        uint32_t chunk = len < LOG_MAX_RECORD - sizeof(log_record_t) ? (uint32_t)len
+                                                                       : LOG_MAX_RECORD - sizeof(log_record_t);
+        header->size = (sizeof(log_record_t) + chunk + 7) & ~7u;
+        header->kind = RECORD_OUTPUT;
+        header->level = 0;
+        header->length = (uint16_t)chunk;
+        header->time = now_ns();
+        header->format = NULL;
+        memcpy(header + 1, data, chunk);
+
+        while(!ring_put(ring, record, header->size)) {
+            sched_yield();
+        }
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+// Append to a line, truncating at LOG_LINE - 1
+static void append(char* line, size_t* len, const char* text, size_t n) {
+    if(n > LOG_LINE - 1 - *len) {
+        n = LOG_LINE - 1 - *len;
+    }
+    memcpy(line + *len, text, n);
+    *len += n;
+}
+
+static size_t format_record(const uint8_t* record, char* line) {
+    const log_record_t* header = (const log_record_t*)record;
+    uint32_t pos = sizeof(log_record_t);
+    size_t len = 0;
+    char number[32];
+
+    append(line, &len, "[", 1);
+    append(line, &len, level_names[header->level], strlen(level_names[header->level]));
+    append(line, &len, "] ", 2);
+
+    for(const char* f = header->format; *f; f++) {
+        if(*f != '%' || f[1] == '\0' || !strchr("ducxXps%", f[1])) {
+            append(line, &len, f, 1);
+            continue;
+        }
+
+        char spec = *++f;
+        if(spec == '%') {
+            append(line, &len, "%", 1);
+            continue;
+        }
+        if(pos + 8 > header->size) {
+            continue;
+        }
+
+        uint64_t value;
+        memcpy(&value, record + pos, 8);
+        pos += 8;
+
+        int n = 0;
+        switch(spec) {
+            case 'd':
+                n = snprintf(number, sizeof(number), "%d", (int)(int64_t)value);
+                break;
+            case 'u':
+                n = snprintf(number, sizeof(number), "%u", (unsigned int)value);
+                break;
+            case 'x':
+                n = snprintf(number, sizeof(number), "%x", (unsigned int)value);
+                break;
+            case 'X':
+                n = snprintf(number, sizeof(number), "%X", (unsigned int)value);
+                break;
+            case 'c':
+                number[0] = (char)value;
+                n = 1;
+                break;
+            case 'p':
+                n = snprintf(number, sizeof(number), "0x%08llX", (unsigned long long)value);
+                break;
+            case 's':
+                append(line, &len, (const char*)record + pos, (size_t)value);
+                pos = (pos + (uint32_t)value + 7) & ~7u;
+                continue;
+        }
+        append(line, &len, number, (size_t)n);
+    }
+
+    return len;
+}
+
+// Write out every record available, oldest first. Returns false if there
+// was none.
+static bool drain() {
+    uint64_t record[LOG_MAX_RECORD / 8];
+    char line[LOG_LINE];
+    bool wrote = false;
+
+    for(;;) {
+        log_ring_t* oldest = NULL;
+        log_record_t first;
+
+        for(log_ring_t* ring = atomic_load(&rings); ring; ring = ring->next) {
+            uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+            if(dropped != ring->reported) {
+                fprintf(log_file, "[WARN] %llu log records dropped\n",
+                        (unsigned long long)(dropped - ring->reported));
+                ring->reported = dropped;
+                wrote = true;
+            }
+
+            uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            if(head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+                continue;
+            }
+
+            log_record_t header;
+            ring_copy_out(ring, head, &header, sizeof(header));
+            if(!oldest || header.time < first.time) {
+                oldest = ring;
+                first = header;
+            }
+        }
+
+        if(!oldest) {
+            return wrote;
+        }
+
+        uint64_t head = atomic_load_explicit(&oldest->head, memory_order_relaxed);
+        ring_copy_out(oldest, head, record, first.size);
+        atomic_store_explicit(&oldest->head, head + first.size, memory_order_release);
+
+        if(first.kind == RECORD_OUTPUT) {
+            fwrite((const uint8_t*)record + sizeof(log_record_t), 1, first.length, log_file);
+        } else {
+            fwrite(line, 1, format_record((const uint8_t*)record, line), log_file);
+        }
+        wrote = true;
+    }
+}
+
+static void* writer_main(void* arg) {
+    (void)arg;
+    struct timespec idle = {0, LOG_IDLE_NS};
+
+    for(;;) {
+        // Read before draining so nothing recorded ahead of the stop is lost
+        bool stop = atomic_load(&writer_stop);
+        if(drain()) {
+            continue;
+        }
+
+        fflush(log_file);
+        if(stop) {
+            break;
+        }
+        nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+void log_shutdown() {
+    if(!writer_running) {
+        return;
+    }
+
+    atomic_store(&log_threshold, -1);
+    atomic_store(&writer_stop, true);
+    pthread_join(writer, NULL);
+    writer_running = false;
+    atomic_store(&writer_stop, false);
+}
+
+// Call before any process runs
+void log_set_output(log_output_t output, const char* filename) {
+    static bool registered = false;
+
+    log_shutdown();
+
+    // Close existing file if any
+    if (log_file && log_file != stdout) {
+        fclose(log_file);
+    }
+    log_file = NULL;
+    log_output = output;
+
+    if (output == LOG_OUTPUT_FILE && filename) {
+        log_file = fopen(filename, "a");
+        if (!log_file) {
+            // Fallback to stdout if file can't be opened
+            log_output = LOG_OUTPUT_STDOUT;
+            log_file = stdout;
+        }
+    } else if (output == LOG_OUTPUT_STDOUT) {
+        log_file = stdout;
+    }
+
+    if (log_file && pthread_create(&writer, NULL, writer_main, NULL) == 0) {
+        writer_running = true;
+        if (!registered) {
+            atexit(log_shutdown);
+            registered = true;
+        }
+    }
+
+    atomic_store(&log_threshold, writer_running ? log_level : -1);
+}
+
+void log_set_level(int level) {
+    log_level = level;
+    if(writer_running) {
+        atomic_store(&log_threshold, level);
+    }
+}
+
+int log_level_from_name(const char* name) {
+    for(int level = LOG_LEVEL_FATAL; level <= LOG_LEVEL_TRACE; level++) {
+        if(strcmp(name, level_keys[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
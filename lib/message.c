@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <nvm.h>
+#include <message.h>
+#include <proctab.h>
+#include <scheduler.h>
+
+// Each cell carries a sequence number: a sender may fill cell `pos` when
+// seq == pos, and the receiver may take it when seq == pos + 1. Taking a cell
+// hands it to the next lap by setting seq to pos + MAILBOX_SIZE.
+
+void nvm_mailbox_init(nvm_mailbox_t* mailbox) {
+    atomic_store(&mailbox->tail, 0);
+    atomic_store(&mailbox->head, 0);
+    for(uint32_t i = 0; i < MAILBOX_SIZE; i++) {
+        atomic_store(&mailbox->cells[i].seq, i);
+    }
+}
+
+bool nvm_mailbox_pending(nvm_mailbox_t* mailbox) {
+    uint32_t head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+    return atomic_load(&mailbox->cells[head & (MAILBOX_SIZE - 1)].seq) == head + 1;
+}
+
+bool nvm_mailbox_receive(nvm_mailbox_t* mailbox, uint32_t* from, int32_t* value) {
+    uint32_t head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+    nvm_message_t* cell = &mailbox->cells[head & (MAILBOX_SIZE - 1)];
+
+    if(atomic_load_explicit(&cell->seq, memory_order_acquire) != head + 1) {
+        return false;
+    }
+
+    *from = cell->from;
+    *value = cell->value;
+    atomic_store_explicit(&cell->seq, head + MAILBOX_SIZE, memory_order_release);
+    atomic_store_explicit(&mailbox->head, head + 1, memory_order_relaxed);
+    return true;
+}
+
+static bool mailbox_send(nvm_mailbox_t* mailbox, uint32_t from, int32_t value) {
+    uint32_t pos = atomic_load_explicit(&mailbox->tail, memory_order_relaxed);
+    nvm_message_t* cell;
+
+    for(;;) {
+        cell = &mailbox->cells[pos & (MAILBOX_SIZE - 1)];
+        int32_t diff = (int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(&mailbox->tail, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&mailbox->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->from = from;
+    cell->value = value;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_seq_cst);
+    return true;
+}
+
+int32_t nvm_send(uint32_t from, uint32_t to, int32_t value) {
+    nvm_process_t* target = nvm_proctab_get(to);
+    if(!target || !target->active) {
+        return SEND_NO_PROC;
+    }
+
+    if(!mailbox_send(target->mailbox, from, value)) {
+        return SEND_FULL;
+    }
+
+    // Pairs with the mailbox check in the scheduler's park()
+    nvm_scheduler_wake(to, WAKE_MESSAGE);
+    return SEND_OK;
+}
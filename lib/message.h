@@ -0,0 +1,44 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <nvm.h>
+
+#define MAILBOX_SIZE 64             // Messages, power of two
+
+// Wakeup reasons
+#define WAKE_MESSAGE 1
+#define WAKE_TIMEOUT 2
+
+// Send results pushed by SYSCALL_SEND
+#define SEND_OK       0
+#define SEND_NO_PROC -1             // Target does not exist or has stopped
+#define SEND_FULL    -2             // Target mailbox is full
+
+typedef struct {
+    _Atomic uint32_t seq;           // Ring position this cell is ready for
+    uint32_t from;                  // Sender PID
+    int32_t value;
+} nvm_message_t;
+
+// Bounded multi-producer, single-consumer ring. Any process may send; only
+// the owner receives. Messages are written straight into the cell they are
+// received from.
+struct nvm_mailbox {
+    _Alignas(64) _Atomic uint32_t tail;     // Next cell to send to
+    _Alignas(64) _Atomic uint32_t head;     // Next cell to receive, written by the owner only
+    nvm_message_t cells[MAILBOX_SIZE];
+};
+
+void nvm_mailbox_init(nvm_mailbox_t* mailbox);
+
+// May be asked from any thread, a stale answer only costs a spurious wakeup
+bool nvm_mailbox_pending(nvm_mailbox_t* mailbox);
+bool nvm_mailbox_receive(nvm_mailbox_t* mailbox, uint32_t* from, int32_t* value);
+
+// Deliver a message and wake the target if it is waiting for one
+int32_t nvm_send(uint32_t from, uint32_t to, int32_t value);
+
+#endif // MESSAGE_H
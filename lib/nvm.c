@@ -0,0 +1,1182 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <log.h>
+#include <nvm.h>
+#include <caps.h>
+#include <verify.h>
+#include <jit.h>
+#include <scheduler.h>
+#include <proctab.h>
+#include <message.h>
+#include <image.h>
+#include <console.h>
+#include <heap.h>
+#include <vector.h>
+#include <wide.h>
+#include <profile.h>
+#include <batch.h>
+
+_Thread_local uint32_t current_process = 0;
+_Atomic uint32_t timer_ticks = 0;
+uint32_t nvm_call_depth = 1024;
+
+void nvm_init() {
+    nvm_scheduler_reset();
+
+    uint32_t count = nvm_proctab_count();
+    for(uint32_t pid = 0; pid < count; pid++) {
+        nvm_process_t* proc = nvm_proctab_get(pid);
+        if(proc && proc->image) {
+            nvm_image_release(proc->image);
+            proc->image = NULL;
+            proc->program = NULL;
+            nvm_heap_free(proc);
+            nvm_profile_free(proc);
+        }
+    }
+    nvm_proctab_reset();
+}
+
+// Signature checking and process creation; the process takes its own
+// reference to the image
+nvm_process_t* nvm_process_create(nvm_image_t* image, nvm_caps_t caps) {
+    const uint8_t* bytecode = image->bytes;
+    if(image->size < 4 ||
+       bytecode[0] != 0x4E || bytecode[1] != 0x56 || 
+       bytecode[2] != 0x4D || bytecode[3] != 0x30) {
+        LOG_WARN("Invalid NVM signature\n");
+        return NULL;
+    }
+    
+    // Privileged opcodes and syscalls of a verified program were resolved
+    // when it was loaded; refuse to start it without the capabilities
+    if(image->program && (image->program->caps & ~caps) != 0) {
+        LOG_WARN("Program needs capabilities the process lacks\n");
+        return NULL;
+    }
+
+    nvm_process_t* proc = nvm_proctab_alloc();
+    if(!proc) {
+        LOG_WARN("No free process slots\n");
+        return NULL;
+    }
+
+    proc->heap = NULL;
+    proc->heap_size = 0;
+    if(nvm_heap_grow(proc, (int32_t)nvm_heap_initial) < 0) {
+        LOG_WARN("Cannot reserve linear memory\n");
+        nvm_proctab_free(proc);
+        return NULL;
+    }
+
+    nvm_image_retain(image);
+    proc->image = image;
+    proc->bytecode = (uint8_t*)bytecode;
+    proc->ip = 4;
+    proc->size = image->size;
+    proc->sp = 0;
+    proc->csp = 0;
+    proc->frame = proc->arena;
+    proc->frame_size = 0;
+    proc->active = true;
+    proc->exit_code = 0;
+    proc->blocked = false;
+    proc->wakeup_reason = 0;
+    atomic_store(&proc->parked, 0);     // wait_gen keeps counting so stale timers never match
+    proc->wake_deadline = 0;
+    nvm_mailbox_init(proc->mailbox);
+    nvm_console_init(proc->console);
+    proc->budget = 0;
+    proc->quantum = QUANTUM_MIN;
+    proc->cpu_ns = 0;
+    proc->slices = 0;
+    proc->retired = 0;
+    proc->profile = NULL;
+    proc->vm = NULL;
+
+    // The image was verified once when it was loaded
+    proc->program = image->program;
+    if(!proc->program) {
+        LOG_DEBUG("Process %d: Bytecode not verified (%s), using checked path\n", proc->pid, image->reason);
+    } else {
+        for(int k = 0; k < NVM_FUSION_KINDS; k++) {
+            if(image->fusions[k] > 0) {
+                LOG_DEBUG("Process %d: Fused %d x %s\n", proc->pid, image->fusions[k], nvm_fusion_names[k]);
+            }
+        }
+    }
+
+    // Initializing capabilities
+    atomic_store(&proc->caps, caps);
+    
+    for(int j = 0; j < MAX_LOCALS; j++) {
+        proc->locals[j] = 0;
+    }
+
+    return proc;
+}
+
+// Same, queued on the scheduler
+int nvm_create_process(nvm_image_t* image, uint16_t initial_caps[], uint8_t caps_count) {
+    nvm_process_t* proc = nvm_process_create(image, caps_from_list(initial_caps, caps_count));
+    if(!proc) {
+        return -1;
+    }
+
+    nvm_scheduler_enqueue(proc->pid);
+    return (int)proc->pid;
+}
+
+// Start a frame of `size` zeroed locals above the current one. The slot
+// below a frame holds the size of the frame before it.
+bool nvm_frame_enter(nvm_process_t* proc, uint32_t size) {
+    int32_t* link = proc->frame + proc->frame_size;
+    if(link + 1 + size > proc->arena + FRAME_ARENA) {
+        return false;
+    }
+
+    *link = (int32_t)proc->frame_size;
+    proc->frame = link + 1;
+    proc->frame_size = size;
+    memset(proc->frame, 0, size * sizeof(int32_t));
+    return true;
+}
+
+bool nvm_frame_leave(nvm_process_t* proc) {
+    if(proc->frame == proc->arena) {
+        return false;
+    }
+
+    int32_t* link = proc->frame - 1;
+    proc->frame_size = (uint32_t)*link;
+    proc->frame = link - proc->frame_size;
+    return true;
+}
+
+// Execute one instruction
+bool nvm_execute_instruction(nvm_process_t* proc) {
+    if(proc->ip >= proc->size) {
+        LOG_WARN("Process %d: Instruction pointer out of bounds\n", proc->pid);
+        proc->exit_code = -1;
+        proc->active = false;
+        return false;
+    }
+    
+    uint8_t opcode = proc->bytecode[proc->ip++];
+    proc->retired++;
+    
+    switch(opcode) {
+        // Basic:
+        case 0x00: // HALT
+            proc->active = false;
+            proc->exit_code = 0;
+            LOG_DEBUG("Process %d: Halted\n", proc->pid);
+            return false;
+        
+        case 0x01: // NOP
+            break;
+            
+        case 0x02: // PUSH
+            if(proc->ip + 3 < proc->size) {
+                uint32_t value = (proc->bytecode[proc->ip] << 24) |
+                                (proc->bytecode[proc->ip + 1] << 16) |
+                                (proc->bytecode[proc->ip + 2] << 8) |
+                                proc->bytecode[proc->ip + 3];
+                proc->ip += 4;
+                
+                if(proc->sp < STACK_SIZE) {
+                    proc->stack[proc->sp++] = (int32_t)value;
+                    
+                    // TODO: switch to core/kernel/log.h features
+                    /* char dbg[64];
+                    serial_print("DEBUG PUSH32: value=0x");
+                    itoa(value, dbg, 16);
+                    serial_print(dbg);
+                    serial_print(" (");
+                    itoa((int32_t)value, dbg, 10);
+                    serial_print(dbg);
+                    serial_print(") at ip=");
+                    itoa(proc->ip, dbg, 10);
+                    serial_print(dbg);
+                    serial_print("\n"); */
+
+                } else {
+                    LOG_WARN("Process %d: Stack overflow in PUSH32\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Not enough bytes\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x04: // POP
+            if(proc->sp > 0) {
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in POP\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x05: // DUP
+            if(proc->sp == 0) {
+                LOG_WARN("Process %d: Stack underflow in DUP\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            if(proc->sp >= STACK_SIZE) {
+                LOG_WARN("Process %d: Stack overflow in DUP\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            
+            proc->stack[proc->sp] = proc->stack[proc->sp - 1];
+            proc->sp++;
+            break;
+        
+        case 0x06: // SWAP
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                proc->stack[proc->sp - 2] = top;
+                proc->stack[proc->sp - 1] = second;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in SWAP\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Arithmetic:
+        case 0x10: // ADD
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = top + second; 
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in ADD\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x11: // SUB
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = second - top;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in SUB\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x12: // MUL
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = second * top;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in MUL\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x13: // DIV
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result;
+
+                if(top != 0) {
+                    // INT32_MIN / -1 wraps instead of trapping
+                    result = top == -1 ? (int32_t)(0u - (uint32_t)second) : second / top;
+                    proc->stack[proc->sp - 2] = result;
+                    proc->sp--;
+                } else {
+                    LOG_WARN("Process %d: Zero division DIV. Terminate process. \n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in DIV\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x14: // MOD
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                
+                if (top == 0) {
+                    LOG_WARN("Process %d: Zero division MOD. Terminate process. \n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                int32_t result = top == -1 ? 0 : second % top;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in MOD\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+        
+        // Comparisons:
+        case 0x20: // CMP
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result;
+
+                if(second < top) {
+                    result = -1;
+                } else if (top == second) {
+                    result = 0;
+                } else {
+                    result = 1;
+                }
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in CMP\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x21: // EQ
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = (top == second) ? 1 : 0;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in EQ\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x22: // NEQ
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = (top != second) ? 1 : 0;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in NEQ\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x23: // GT
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = (second > top) ? 1 : 0;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in GT\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x24: // LT
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result = (second < top) ? 1 : 0;
+                
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in LT\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Flow control (32-bit addresses):
+        case 0x30: // JMP
+            if(proc->ip + 3 < proc->size) {
+                uint32_t addr = (proc->bytecode[proc->ip] << 24) |
+                               (proc->bytecode[proc->ip + 1] << 16) |
+                               (proc->bytecode[proc->ip + 2] << 8) |
+                               proc->bytecode[proc->ip + 3];
+                proc->ip += 4;
+                
+                if(addr >= 4 && addr < proc->size) {
+                    proc->ip = addr;
+                } else {
+                    LOG_WARN("Process %d: Invalid address for JMP\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            }
+            break;
+
+        case 0x31: // JZ
+            if (proc->sp > 0) {
+                int32_t value = proc->stack[--proc->sp];
+                if (proc->ip + 3 < proc->size) {
+                    uint32_t addr = (proc->bytecode[proc->ip] << 24) |
+                                   (proc->bytecode[proc->ip + 1] << 16) |
+                                   (proc->bytecode[proc->ip + 2] << 8) |
+                                   proc->bytecode[proc->ip + 3];
+                    proc->ip += 4;
+                    
+                    if (value == 0) {
+                        if (addr >= 4 && addr < proc->size) {
+                            proc->ip = addr;
+                        } else {
+                            LOG_WARN("Process %d: Invalid address for JZ\n", proc->pid);
+                            proc->exit_code = -1;
+                            proc->active = false;
+                            return false;
+                        }
+                    }
+                } else {
+                    LOG_WARN("Process %d: Not enough bytes for address JZ32\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in JZ32\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x32: // JNZ
+            if (proc->sp > 0) {
+                int32_t value = proc->stack[--proc->sp];
+                if (proc->ip + 3 < proc->size) {
+                    uint32_t addr = (proc->bytecode[proc->ip] << 24) |
+                                   (proc->bytecode[proc->ip + 1] << 16) |
+                                   (proc->bytecode[proc->ip + 2] << 8) |
+                                   proc->bytecode[proc->ip + 3];
+                    proc->ip += 4;
+                    
+                    if (value != 0) {
+                        if (addr >= 4 && addr < proc->size) {
+                            proc->ip = addr;
+                        } else {
+                            LOG_WARN("Process %d: Invalid address for JNZ\n", proc->pid);
+                            proc->exit_code = -1;
+                            proc->active = false;
+                            return false;
+                        }
+                    }
+                } else {
+                    LOG_WARN("Process %d: Not enough bytes for address JNZ\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in JNZ32\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x33: // CALL
+            if(proc->ip + 3 < proc->size) {
+                int32_t addr = (proc->bytecode[proc->ip] << 24) |
+                               (proc->bytecode[proc->ip + 1] << 16) |
+                               (proc->bytecode[proc->ip + 2] << 8) |
+                               proc->bytecode[proc->ip + 3];
+                proc->ip += 4;
+                
+                if(proc->sp < STACK_SIZE - 1) {
+                    proc->stack[proc->sp++] = proc->ip;
+                    
+                    if(addr >= 4 && addr < proc->size) {
+                        proc->ip = addr;
+                    } else {
+                        LOG_WARN("Process %d: Invalid address for CALL\n", proc->pid);
+                        proc->exit_code = -1;
+                        proc->active = false;
+                        return false;
+                    }
+                } else {
+                    LOG_WARN("Process %d: Stack overflow in CALL\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Not enough bytes for address CALL\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x34: // RET
+            if(proc->sp > 0) {
+                uint32_t return_addr = (int32_t)proc->stack[--proc->sp];
+                
+                if(return_addr >= 4 && return_addr < proc->size) {
+                    proc->ip = return_addr;
+                } else {
+                    LOG_WARN("Process %d: invalid return address\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: stack underflow in RET\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x35: // CALLF - call with the return offset on the call stack
+            if(proc->ip + 3 < proc->size) {
+                uint32_t addr = (proc->bytecode[proc->ip] << 24) |
+                                (proc->bytecode[proc->ip + 1] << 16) |
+                                (proc->bytecode[proc->ip + 2] << 8) |
+                                proc->bytecode[proc->ip + 3];
+                proc->ip += 4;
+
+                if(proc->csp < nvm_call_depth) {
+                    proc->calls[proc->csp++] = proc->ip;
+
+                    if(addr >= 4 && addr < proc->size) {
+                        proc->ip = addr;
+                    } else {
+                        LOG_WARN("Process %d: Invalid address for CALLF\n", proc->pid);
+                        proc->exit_code = -1;
+                        proc->active = false;
+                        return false;
+                    }
+                } else {
+                    LOG_WARN("Process %d: Call stack overflow in CALLF\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Not enough bytes for address CALLF\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x36: // RETF
+            if(proc->csp > 0) {
+                // Only CALLF pushes here, so the offset is always in the image
+                proc->ip = proc->calls[--proc->csp];
+            } else {
+                LOG_WARN("Process %d: Call stack underflow in RETF\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x37: // ENTER - start a frame of N locals
+            if(proc->ip < proc->size) {
+                uint8_t frame_size = proc->bytecode[proc->ip++];
+
+                if(!nvm_frame_enter(proc, frame_size)) {
+                    LOG_WARN("Process %d: Frame arena overflow in ENTER\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Not enough bytes for ENTER\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x38: // LEAVE
+            if(!nvm_frame_leave(proc)) {
+                LOG_WARN("Process %d: No frame to leave\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Memory:
+        case 0x40: // LOAD
+            if(proc->ip < proc->size) {
+                uint8_t var_index = proc->bytecode[proc->ip++];
+                
+                if(var_index < MAX_LOCALS) {
+                    int32_t value = proc->locals[var_index];
+                    
+                    if(proc->sp < STACK_SIZE) {
+                        proc->stack[proc->sp++] = value;
+                    } else {
+                        LOG_WARN("Process %d: Stack overflow in LOAD\n", proc->pid);
+                        proc->exit_code = -1;
+                        proc->active = false;
+                        return false;
+                    }
+                } else {
+                    LOG_WARN("Process %d: invalid variable index in LOAD\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            }
+            break;
+
+        case 0x41: // STORE
+            if(proc->ip < proc->size) {
+                uint8_t var_index = proc->bytecode[proc->ip++];
+                
+                if(var_index < MAX_LOCALS && proc->sp > 0) {
+                    int32_t value = proc->stack[--proc->sp];
+                    proc->locals[var_index] = value;
+                } else {
+                    LOG_WARN("Process %d: invalid index or stack underflow in STORE\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            }
+            break;
+
+        case 0x42: // LOADF - local of the current frame
+        case 0x43: // STOREF
+            if(proc->ip < proc->size) {
+                uint8_t var_index = proc->bytecode[proc->ip++];
+
+                if(var_index >= proc->frame_size) {
+                    LOG_WARN("Process %d: invalid frame index %d\n", proc->pid, var_index);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+                if(opcode == 0x42 && proc->sp < STACK_SIZE) {
+                    proc->stack[proc->sp++] = proc->frame[var_index];
+                } else if(opcode == 0x43 && proc->sp > 0) {
+                    proc->frame[var_index] = proc->stack[--proc->sp];
+                } else {
+                    LOG_WARN("Process %d: Stack overflow or underflow in %s\n", proc->pid,
+                             opcode == 0x42 ? "LOADF" : "STOREF");
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Not enough bytes for frame index\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Memory absolute access
+        case 0x45: // STORE_ABS - store to absolute memory address
+            if (!caps_has_capability(proc, CAP_DRV_ACCESS)) {
+                LOG_WARN("Procces %d: Required caps not receivedn\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+
+            if(proc->sp >= 2) {
+                uint32_t addr = (uint32_t)proc->stack[proc->sp - 2]; // address
+                int32_t value = proc->stack[proc->sp - 1]; // value
+
+                if((addr >= 0x100000 && addr < 0xFFFFFFFF) || 
+                (addr >= 0xB8000 && addr <= 0xB8FA0)) {
+                    // Special handling for VGA text buffer - write only 16 bits (char + attribute)
+                    if (addr >= 0xB8000 && addr <= 0xB8FA0) {
+                        *(uint16_t*)addr = (uint16_t)(value & 0xFFFF);
+                    } else {
+                        *(int32_t*)addr = value;
+                    }
+                    proc->sp -= 2;
+                } else {
+                    LOG_WARN("Procces %d: Invalid memory address in STORE_ABS\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Procces %d: Stack underflow in STORE_ABS\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Linear memory, see heap.c
+        case 0x46: // LOAD8 - addr -> value
+        case 0x47: // LOAD16
+        case 0x48: // LOAD32
+            if(proc->sp > 0) {
+                uint32_t width = 1u << (opcode - 0x46);
+                uint32_t addr = (uint32_t)proc->stack[proc->sp - 1];
+
+                if(nvm_heap_ok(proc, addr, width)) {
+                    proc->stack[proc->sp - 1] = nvm_heap_load(proc, addr, width);
+                } else {
+                    LOG_WARN("Process %d: Memory access out of bounds in LOAD%d at 0x%x\n",
+                             proc->pid, width * 8, addr);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in LOAD\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x49: // STORE8 - addr value ->
+        case 0x4A: // STORE16
+        case 0x4B: // STORE32
+            if(proc->sp >= 2) {
+                uint32_t width = 1u << (opcode - 0x49);
+                uint32_t addr = (uint32_t)proc->stack[proc->sp - 2];
+
+                if(nvm_heap_ok(proc, addr, width)) {
+                    nvm_heap_store(proc, addr, width, proc->stack[proc->sp - 1]);
+                    proc->sp -= 2;
+                } else {
+                    LOG_WARN("Process %d: Memory access out of bounds in STORE%d at 0x%x\n",
+                             proc->pid, width * 8, addr);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in STORE\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x4C: // MEMCPY - dst src n ->
+        case 0x4D: // MEMSET - dst byte n ->
+        case 0x4E: // MEMCMP - a b n -> sign
+            if(proc->sp >= 3) {
+                int32_t* args = &proc->stack[proc->sp - 3];
+                bool ok;
+
+                if(opcode == 0x4C) {
+                    ok = nvm_heap_copy(proc, (uint32_t)args[0], (uint32_t)args[1], (uint32_t)args[2]);
+                    proc->sp -= 3;
+                } else if(opcode == 0x4D) {
+                    ok = nvm_heap_fill(proc, (uint32_t)args[0], args[1], (uint32_t)args[2]);
+                    proc->sp -= 3;
+                } else {
+                    args[0] = nvm_heap_compare(proc, (uint32_t)args[0], (uint32_t)args[1], (uint32_t)args[2]);
+                    ok = args[0] != NVM_HEAP_FAULT;
+                    proc->sp -= 2;
+                }
+
+                if(!ok) {
+                    LOG_WARN("Process %d: Memory range out of bounds in %s\n", proc->pid,
+                             opcode == 0x4C ? "MEMCPY" : opcode == 0x4D ? "MEMSET" : "MEMCMP");
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in memory operation\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Vector operations on int32 arrays in linear memory, see vector.c
+        case 0x60: // VADD - dst a b n ->
+        case 0x61: // VSUB
+        case 0x62: // VMUL
+        case 0x63: // VMIN
+        case 0x64: // VMAX
+        case 0x68: // VSUM - a n -> sum
+        case 0x69: // VRMIN - a n -> min
+        case 0x6A: // VRMAX - a n -> max
+        case 0x6B: // VDOT - a b n -> sum of products
+        case 0x6C: // VCOUNTEQ - a n value -> count
+        case 0x6D: // VCOUNTGT
+        case 0x6E: // VCOUNTLT
+            if(proc->sp >= nvm_vector_pop(opcode)) {
+                if(!nvm_vector_exec(proc, opcode)) {
+                    LOG_WARN("Process %d: Vector out of bounds in opcode 0x%X\n", proc->pid, opcode);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in vector operation\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // 64-bit arithmetic on lo hi pairs, see wide.h
+        case 0x70: // ADD64 - a b -> a + b
+        case 0x71: // SUB64
+        case 0x72: // MUL64
+        case 0x73: // DIV64
+        case 0x74: // MOD64
+        case 0x75: // CMP64 - a b -> -1 | 0 | 1
+        case 0x7B: // ADD64C - ADD64 stopping on overflow
+        case 0x7C: // SUB64C
+        case 0x7D: // MUL64C
+        case 0x82: // DIV64C - DIV64 stopping on INT64_MIN / -1
+        case 0x83: // MOD64C
+            if(proc->sp >= 4) {
+                int32_t* args = &proc->stack[proc->sp - 4];
+                int64_t a = nvm_wide_get(args);
+                int64_t b = nvm_wide_get(args + 2);
+                int64_t result = 0;
+                bool overflow = false;
+
+                bool divide = opcode == 0x73 || opcode == 0x74 || opcode == 0x82 || opcode == 0x83;
+                if(divide && b == 0) {
+                    LOG_WARN("Process %d: Zero division %s. Terminate process. \n", proc->pid,
+                             opcode == 0x73 ? "DIV64" : opcode == 0x74 ? "MOD64" :
+                             opcode == 0x82 ? "DIV64C" : "MOD64C");
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                switch(opcode) {
+                    case 0x70: result = nvm_wide_add(a, b); break;
+                    case 0x71: result = nvm_wide_sub(a, b); break;
+                    case 0x72: result = nvm_wide_mul(a, b); break;
+                    case 0x73: result = nvm_wide_div(a, b); break;
+                    case 0x74: result = nvm_wide_mod(a, b); break;
+                    case 0x7B: overflow = __builtin_add_overflow(a, b, &result); break;
+                    case 0x7C: overflow = __builtin_sub_overflow(a, b, &result); break;
+                    case 0x7D: overflow = __builtin_mul_overflow(a, b, &result); break;
+                    case 0x82:
+                    case 0x83:
+                        overflow = a == INT64_MIN && b == -1;
+                        if(!overflow) {
+                            result = opcode == 0x82 ? a / b : a % b;
+                        }
+                        break;
+                }
+
+                if(overflow) {
+                    LOG_WARN("Process %d: Integer overflow in opcode 0x%X\n", proc->pid, opcode);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                if(opcode == 0x75) {
+                    args[0] = a < b ? -1 : (a == b ? 0 : 1);
+                    proc->sp -= 3;
+                } else {
+                    nvm_wide_set(args, result);
+                    proc->sp -= 2;
+                }
+            } else {
+                LOG_WARN("Process %d: Stack underflow in 64-bit operation\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x76: // EXT64 - v -> lo hi
+            if(proc->sp == 0) {
+                LOG_WARN("Process %d: Stack underflow in EXT64\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            if(proc->sp >= STACK_SIZE) {
+                LOG_WARN("Process %d: Stack overflow in EXT64\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+
+            proc->stack[proc->sp] = proc->stack[proc->sp - 1] < 0 ? -1 : 0;
+            proc->sp++;
+            break;
+
+        case 0x78: // ADDC - ADD stopping on overflow
+        case 0x79: // SUBC
+        case 0x7A: // MULC
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+                int32_t result;
+                bool overflow;
+
+                if(opcode == 0x78) {
+                    overflow = __builtin_add_overflow(second, top, &result);
+                } else if(opcode == 0x79) {
+                    overflow = __builtin_sub_overflow(second, top, &result);
+                } else {
+                    overflow = __builtin_mul_overflow(second, top, &result);
+                }
+
+                if(overflow) {
+                    LOG_WARN("Process %d: Integer overflow in opcode 0x%X\n", proc->pid, opcode);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                proc->stack[proc->sp - 2] = result;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in checked operation\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x80: // DIVC - DIV stopping on INT32_MIN / -1
+        case 0x81: // MODC
+            if(proc->sp >= 2) {
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+
+                if(top == 0) {
+                    LOG_WARN("Process %d: Zero division %s. Terminate process. \n", proc->pid,
+                             opcode == 0x80 ? "DIVC" : "MODC");
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+                if(top == -1 && second == INT32_MIN) {
+                    LOG_WARN("Process %d: Integer overflow in opcode 0x%X\n", proc->pid, opcode);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                proc->stack[proc->sp - 2] = opcode == 0x80 ? second / top : second % top;
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Stack underflow in checked operation\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x7E: // FMUL - Q: a b -> a * b >> Q
+        case 0x7F: // FDIV - Q: a b -> (a << Q) / b
+            if(proc->ip < proc->size) {
+                uint8_t shift = proc->bytecode[proc->ip++];
+
+                if(proc->sp < 2) {
+                    LOG_WARN("Process %d: Stack underflow in %s\n", proc->pid, opcode == 0x7E ? "FMUL" : "FDIV");
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                int32_t top = proc->stack[proc->sp - 1];
+                int32_t second = proc->stack[proc->sp - 2];
+
+                if(opcode == 0x7E) {
+                    proc->stack[proc->sp - 2] = nvm_fixed_mul(second, top, shift);
+                } else if(top != 0) {
+                    proc->stack[proc->sp - 2] = nvm_fixed_div(second, top, shift);
+                } else {
+                    LOG_WARN("Process %d: Zero division FDIV. Terminate process. \n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+                proc->sp--;
+            } else {
+                LOG_WARN("Process %d: Not enough bytes for %s\n", proc->pid, opcode == 0x7E ? "FMUL" : "FDIV");
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // System calls:
+        case 0x50: // SYSCALL
+            if(proc->ip < proc->size) {
+                uint8_t syscall_id = proc->bytecode[proc->ip++];
+                syscall_handler(syscall_id, proc);
+                if(!proc->active) {
+                    return false;
+                }
+            }
+            break;
+
+        // System calls:
+        case 0x51: // BREAK
+            LOG_DEBUG("Process %d: Stop from BREAK at IP=%d, SP=%d\n", proc->pid, proc->ip, proc->sp);
+            break;
+            
+        default:
+            char buffer[32];
+            LOG_WARN("Process %d: Unknown opcode: 0x%s", proc->pid, buffer);
+            proc->exit_code = -1;
+            proc->active = false;
+            return false;
+    }
+    
+    return true;
+}
+
+// Create a process and queue it to run
+int nvm_spawn_image(nvm_image_t* image, uint16_t* capabilities, uint8_t caps_count) {
+    int pid = nvm_create_process(image, capabilities, caps_count);
+    if(pid >= 0) {
+        LOG_INFO("NVM process started with PID: %d\n", pid);
+    } else {
+        LOG_ERROR("Failed to create NVM process\n");
+    }
+    return pid;
+}
+
+// Same for a bytecode buffer, which the caller may free once this returns
+int nvm_spawn(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count) {
+    nvm_image_t* image = nvm_image_load(bytecode, size);
+    if(!image) {
+        LOG_ERROR("Failed to create NVM process\n");
+        return -1;
+    }
+
+    int pid = nvm_spawn_image(image, capabilities, caps_count);
+    nvm_image_release(image);
+    return pid;
+}
+
+// Report a stopped process and free its slot
+void nvm_process_finished(nvm_process_t* proc) {
+    nvm_console_flush(proc->console);
+    LOG_DEBUG("Process %d: CPU time %d us in %d slices\n", proc->pid,
+              (int)(proc->cpu_ns / 1000), (int)proc->slices);
+    LOG_INFO("NVM process %d finished with exit code: %d\n", proc->pid, proc->exit_code);
+    nvm_batch_finished(proc);
+    nvm_process_release(proc);
+}
+
+// Drop everything a stopped process holds and free its slot
+void nvm_process_release(nvm_process_t* proc) {
+    nvm_profile_report(proc);
+    nvm_profile_free(proc);
+    nvm_image_release(proc->image);
+    proc->image = NULL;
+    proc->program = NULL;
+    proc->vm = NULL;
+    nvm_heap_free(proc);
+    nvm_proctab_free(proc);
+}
+
+// Stop processes left waiting for a message nobody can send any more;
+// embedding hosts decide about their own
+void nvm_stop_blocked() {
+    uint32_t count = nvm_proctab_count();
+    for(uint32_t pid = 0; pid < count; pid++) {
+        nvm_process_t* proc = nvm_proctab_get(pid);
+        if(proc && proc->active && proc->blocked && !proc->vm) {
+            LOG_WARN("Process %d: Blocked on receive with no sender left\n", proc->pid);
+            proc->exit_code = -1;
+            proc->active = false;
+            nvm_process_finished(proc);
+        }
+    }
+}
+
+void nvm_execute(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count) {
+    if(nvm_spawn(bytecode, size, capabilities, caps_count) >= 0) {
+        nvm_scheduler_run();
+        nvm_stop_blocked();
+    }
+}
+
+// Function for get exit code
+int32_t nvm_get_exit_code(uint32_t pid) {
+    nvm_process_t* proc = nvm_proctab_get(pid);
+    if(proc && !proc->active) {
+        return proc->exit_code;
+    }
+    return -1;
+}
+
+// Function for check process activity
+bool nvm_is_process_active(uint32_t pid) {
+    nvm_process_t* proc = nvm_proctab_get(pid);
+    if(proc) {
+        return proc->active;
+    }
+    return false;
+}
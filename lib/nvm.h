@@ -3,42 +3,235 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
-#define MAX_PROCESSES 8
 #define STACK_SIZE 256
 #define MAX_LOCALS 32
-#define MAX_CAPS 16
 #define TIME_SLICE_MS 10
 
+// Return offsets CALLF can nest, the run-time limit is nvm_call_depth
+#define CALL_DEPTH_MAX 4096
+
+// Slots of the per-process arena ENTER takes local frames from; each frame
+// also uses one slot to link back to the previous frame
+#ifndef FRAME_ARENA
+#define FRAME_ARENA 16384
+#endif
+
+// Preemption points (backward jumps, calls, returns) per time slice; the
+// scheduler adapts each process's quantum within these bounds so a slice
+// takes about TIME_SLICE_MS
+#define QUANTUM_MIN 1024
+#define QUANTUM_MAX (1 << 24)
+
+// Interpreter core, override with -DNVM_THREADED=0 in CFLAGS:
+//   1 - threaded dispatch loop (nvm_run), computed goto on GCC/Clang
+//   0 - legacy loop over nvm_execute_instruction
+#ifndef NVM_THREADED
+#define NVM_THREADED 1
+#endif
+
+// Opcodes
+#define OP_HALT      0x00
+#define OP_NOP       0x01
+#define OP_PUSH      0x02
+#define OP_POP       0x04
+#define OP_DUP       0x05
+#define OP_SWAP      0x06
+#define OP_ADD       0x10
+#define OP_SUB       0x11
+#define OP_MUL       0x12
+#define OP_DIV       0x13
+#define OP_MOD       0x14
+#define OP_CMP       0x20
+#define OP_EQ        0x21
+#define OP_NEQ       0x22
+#define OP_GT        0x23
+#define OP_LT        0x24
+#define OP_JMP       0x30
+#define OP_JZ        0x31
+#define OP_JNZ       0x32
+#define OP_CALL      0x33
+#define OP_RET       0x34
+#define OP_CALLF     0x35   // Call with the return offset on the call stack
+#define OP_RETF      0x36   // Return to the offset on top of the call stack
+#define OP_ENTER     0x37   // N: start a frame of N zeroed locals
+#define OP_LEAVE     0x38   // Drop the current frame
+#define OP_LOAD      0x40
+#define OP_STORE     0x41
+#define OP_LOADF     0x42   // Push local N of the current frame
+#define OP_STOREF    0x43   // Pop into local N of the current frame
+#define OP_STORE_ABS 0x45
+#define OP_LOAD8     0x46   // addr -> byte of linear memory, see heap.h
+#define OP_LOAD16    0x47   // addr -> 16-bit value
+#define OP_LOAD32    0x48   // addr -> 32-bit value
+#define OP_STORE8    0x49   // addr value ->
+#define OP_STORE16   0x4A
+#define OP_STORE32   0x4B
+#define OP_MEMCPY    0x4C   // dst src n ->, ranges may overlap
+#define OP_MEMSET    0x4D   // dst byte n ->
+#define OP_MEMCMP    0x4E   // a b n -> -1 | 0 | 1
+#define OP_SYSCALL   0x50
+#define OP_BREAK     0x51
+#define OP_VADD      0x60   // dst a b n ->: int32 arrays in linear memory, see vector.c
+#define OP_VSUB      0x61
+#define OP_VMUL      0x62
+#define OP_VMIN      0x63
+#define OP_VMAX      0x64
+#define OP_VSUM      0x68   // a n -> sum
+#define OP_VRMIN     0x69   // a n -> smallest element
+#define OP_VRMAX     0x6A   // a n -> largest element
+#define OP_VDOT      0x6B   // a b n -> sum of products
+#define OP_VCOUNTEQ  0x6C   // a n value -> elements equal to value
+#define OP_VCOUNTGT  0x6D   // a n value -> elements greater than value
+#define OP_VCOUNTLT  0x6E   // a n value -> elements less than value
+#define OP_ADD64     0x70   // a b -> a + b, 64-bit values as lo hi pairs, see wide.h
+#define OP_SUB64     0x71
+#define OP_MUL64     0x72
+#define OP_DIV64     0x73
+#define OP_MOD64     0x74
+#define OP_CMP64     0x75   // a b -> -1 | 0 | 1
+#define OP_EXT64     0x76   // v -> lo hi, sign-extended
+#define OP_ADDC      0x78   // Like ADD, stops the process on overflow
+#define OP_SUBC      0x79
+#define OP_MULC      0x7A
+#define OP_ADD64C    0x7B   // Like ADD64, stops the process on overflow
+#define OP_SUB64C    0x7C
+#define OP_MUL64C    0x7D
+#define OP_FMUL      0x7E   // Q: a b -> a * b >> Q, fixed-point
+#define OP_FDIV      0x7F   // Q: a b -> (a << Q) / b
+#define OP_DIVC      0x80   // Like DIV, stops the process on INT32_MIN / -1
+#define OP_MODC      0x81
+#define OP_DIV64C    0x82   // Like DIV64, stops the process on INT64_MIN / -1
+#define OP_MOD64C    0x83
+
+// Internal fused opcodes, only produced by nvm_fuse in decoded programs
+#define OP_LOAD_PUSH_CMP_BRANCH 0xF0    // load N; push K; gt|lt|eq|neq; jz|jnz L
+#define OP_INC_LOCAL            0xF1    // load N; push K; add; store N
+#define OP_DEC_LOCAL            0xF2    // load N; push K; sub; store N
+#define OP_PUSH_ADD             0xF3    // push K; add
+
+// Verifier output for a run start: stack depth needed on entry and the
+// maximum growth before the next control transfer
+typedef struct {
+    uint16_t need;
+    uint16_t grow;
+} nvm_block_t;
+
+#define NVM_BLOCK_NONE 0xFFFF   // Not a run start, entering here always takes the checked path
+#define NVM_NO_INSN    UINT32_MAX
+
+// Decoded instruction: jump and call targets are instruction indices,
+// immediates are native-endian
 typedef struct {
-    uint8_t* bytecode;          // Bytecode pointer
+    uint8_t op;                 // Opcode
+    uint8_t aux[3];             // Extra operands of fused instructions
+    int32_t arg;                // Immediate, local index, syscall id or target index
+} nvm_insn_t;
+
+// Capability bitset, see caps.h
+typedef uint64_t nvm_caps_t;
+
+typedef struct nvm_jit nvm_jit_t;
+typedef struct nvm_mailbox nvm_mailbox_t;
+typedef struct nvm_image nvm_image_t;
+typedef struct nvm_console nvm_console_t;
+typedef struct nvm_profile nvm_profile_t;
+typedef struct nvm_vm nvm_vm_t;
+
+// Verified and decoded form of an NVM0 image
+typedef struct {
+    nvm_insn_t* code;           // Decoded instructions
+    nvm_block_t* blocks;        // Run checks, one per instruction
+    uint32_t* offsets;          // Instruction index -> byte offset
+    uint32_t* index;            // Byte offset -> instruction index, NVM_NO_INSN inside operands
+    uint32_t count;             // Number of instructions
+    uint32_t size;              // Image size in bytes
+    nvm_caps_t caps;            // Capabilities its privileged opcodes and syscalls need
+    bool mapped;                // Arrays point into a compiled image, see image.c
+
+    // JIT, shared by every process running the program. The countdown uses
+    // relaxed loads and stores, so racing processes may lose a few ticks.
+    _Atomic(nvm_jit_t*) jit;            // Native code, NULL until the program gets hot
+    _Atomic int32_t jit_countdown;      // Back-edges and calls left before compiling
+    _Atomic bool jit_failed;            // Compilation failed, stay interpreted
+} nvm_program_t;
+
+typedef struct {
+    // Hot: used on every time slice, kept within one cache line
+    _Alignas(64) uint8_t* bytecode;     // Bytecode pointer
+    nvm_program_t* program;     // Verified and decoded image, NULL if unverified
+    int32_t* stack;             // Data stack, STACK_SIZE slots from the process table slab
+    int32_t* locals;            // Local variables, MAX_LOCALS slots from the same slab
+    int32_t* frame;             // Locals of the current ENTER frame, within arena
     int32_t ip;                 // Instruction Pointer
-    int32_t stack[STACK_SIZE];  // Data stack
     int32_t sp;                 // Stack Pointer (changed to 32-bit)
-    bool active;                // Process is active?
     uint32_t size;              // Bytecode size
-    int32_t exit_code;          // Exit code
+    int32_t budget;             // Preemption points left in the current slice
+    uint32_t frame_size;        // Slots in the current frame, 0 outside any
+    bool active;                // Process is active?
+    bool blocked;               // Process blocked waiting for message
+
+    // Linear memory, see heap.c
+    uint8_t* heap;              // Base of the reservation, NULL until the first grow
+    uint32_t heap_size;         // Accessible bytes
 
-    int32_t locals[MAX_LOCALS]; // Local variables
+    // Cold
+    nvm_image_t* image;         // Shared image the bytecode and program belong to
+    uint32_t pid;               // Process ID
+    int32_t exit_code;          // Exit code
 
     // CAPS
-    uint16_t capabilities[MAX_CAPS];  // List of caps
-    uint8_t caps_count;               // Count active caps
-    uint8_t pid;                      // Process ID
+    _Atomic nvm_caps_t caps;          // Held capabilities, changed by other processes too
 
     // Message system
-    bool blocked;           // Process blocked waiting for message
     int8_t wakeup_reason;   // Reason for wakeup
+    nvm_mailbox_t* mailbox;         // Incoming messages, from the process table slab
+    _Atomic uint32_t parked;        // Wait generation while parked, 0 otherwise
+    uint32_t wait_gen;              // Last wait generation
+    uint64_t wake_deadline;         // Monotonic ns to wake a blocked process at, 0 for none
+
+    nvm_console_t* console;         // Buffered output, from the process table slab
+
+    // Call stack and local frames, from the process table slab
+    uint32_t* calls;                // Return offsets pushed by CALLF, CALL_DEPTH_MAX slots
+    uint32_t csp;                   // Entries on the call stack
+    int32_t* arena;                 // FRAME_ARENA slots for ENTER frames
+
+    // Scheduler
+    int32_t quantum;        // Budget granted per slice
+    uint64_t cpu_ns;        // Time spent running
+    uint32_t slices;        // Slices run
+    uint64_t retired;       // Instructions executed
+
+    nvm_profile_t* profile;         // Counters while profiling, see profile.c
+
+    // Embedding, see vm.c
+    nvm_vm_t* vm;                   // VM that owns the process, NULL under the scheduler
+    uint32_t vm_slot;               // Index in its process list
+
+    _Atomic uint32_t next_free;     // Free slot list link, see proctab.c
 } nvm_process_t;
 
-extern nvm_process_t processes[MAX_PROCESSES];
-extern uint8_t current_process;
-extern uint32_t timer_ticks;
+extern _Thread_local uint32_t current_process;  // Process running on this worker
+extern _Atomic uint32_t timer_ticks;            // Time slices run so far
+extern uint32_t nvm_call_depth;                 // CALLF nesting allowed, at most CALL_DEPTH_MAX
 
 void nvm_init();
 void nvm_execute(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count);
-void nvm_scheduler_tick();
-bool nvm_is_process_active(uint8_t pid);
-int32_t nvm_get_exit_code(uint8_t pid);
+int nvm_spawn(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count);
+int nvm_spawn_image(nvm_image_t* image, uint16_t* capabilities, uint8_t caps_count);
+nvm_process_t* nvm_process_create(nvm_image_t* image, nvm_caps_t caps);
+void nvm_process_release(nvm_process_t* proc);
+void nvm_stop_blocked();
+bool nvm_scheduler_tick();
+void nvm_scheduler_run();
+void nvm_scheduler_wake(uint32_t pid, int8_t reason);
+bool nvm_execute_instruction(nvm_process_t* proc);
+bool nvm_frame_enter(nvm_process_t* proc, uint32_t size);
+bool nvm_frame_leave(nvm_process_t* proc);
+void nvm_run(nvm_process_t* proc);
+bool nvm_is_process_active(uint32_t pid);
+int32_t nvm_get_exit_code(uint32_t pid);
 
 #endif // NVM_H
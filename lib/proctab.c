@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <nvm.h>
+#include <proctab.h>
+#include <message.h>
+#include <console.h>
+
+// Growable process table.
+//
+// Slots live in chunks of PROC_CHUNK processes. Chunks are never moved or
+// unmapped, so process pointers stay valid while other threads grow the
+// table. Each chunk is one anonymous mapping holding the process structures
+// followed by a slab with the stack, locals, mailbox, console buffer, call
+// stack and frame arena of every slot; pages are only committed once they
+// are used, so processes that never call through CALLF or ENTER a frame pay
+// nothing for the last two.
+//
+// Free slots form a lock-free stack threaded through next_free. The head
+// keeps a generation tag in its upper half so a pop cannot succeed on a
+// stale view of a slot that was taken and returned in the meantime.
+
+// Bytes per slot, a multiple of the mailbox alignment
+#define SLAB_BLOCK ((STACK_SIZE + MAX_LOCALS) * sizeof(int32_t) + sizeof(nvm_mailbox_t) + \
+                    sizeof(nvm_console_t) + (CALL_DEPTH_MAX + FRAME_ARENA) * sizeof(int32_t))
+
+_Static_assert(((STACK_SIZE + MAX_LOCALS) * sizeof(int32_t)) % _Alignof(nvm_mailbox_t) == 0,
+               "mailbox in the slab must stay aligned");
+_Static_assert(((CALL_DEPTH_MAX + FRAME_ARENA) * sizeof(int32_t)) % _Alignof(nvm_mailbox_t) == 0,
+               "the next slot's stack must stay aligned");
+
+static _Atomic(nvm_process_t*) chunks[PROC_MAX_CHUNKS];
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint32_t next_pid = 0;       // PIDs handed out at least once
+static _Atomic uint64_t free_head = 0;      // tag << 32 | (pid + 1), 0 when empty
+
+static nvm_process_t* chunk_create() {
+    size_t size = PROC_CHUNK * (sizeof(nvm_process_t) + SLAB_BLOCK);
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+nvm_process_t* nvm_proctab_get(uint32_t pid) {
+    if((pid >> PROC_CHUNK_SHIFT) >= PROC_MAX_CHUNKS) {
+        return NULL;
+    }
+
+    nvm_process_t* chunk = atomic_load_explicit(&chunks[pid >> PROC_CHUNK_SHIFT], memory_order_acquire);
+    return chunk ? &chunk[pid & (PROC_CHUNK - 1)] : NULL;
+}
+
+uint32_t nvm_proctab_count() {
+    uint32_t count = atomic_load(&next_pid);
+    return count < MAX_PROCESSES ? count : MAX_PROCESSES;
+}
+
+nvm_process_t* nvm_proctab_alloc() {
+    // Reuse a slot whose stack is likely still warm
+    uint64_t head = atomic_load(&free_head);
+    while((uint32_t)head != 0) {
+        nvm_process_t* proc = nvm_proctab_get((uint32_t)head - 1);
+        uint64_t next = ((head >> 32) + 1) << 32 | atomic_load(&proc->next_free);
+        if(atomic_compare_exchange_weak(&free_head, &head, next)) {
+            return proc;
+        }
+    }
+
+    uint32_t pid = atomic_fetch_add(&next_pid, 1);
+    if(pid >= MAX_PROCESSES) {
+        return NULL;
+    }
+
+    uint32_t c = pid >> PROC_CHUNK_SHIFT;
+    nvm_process_t* chunk = atomic_load_explicit(&chunks[c], memory_order_acquire);
+    if(!chunk) {
+        pthread_mutex_lock(&grow_lock);
+        chunk = atomic_load_explicit(&chunks[c], memory_order_acquire);
+        if(!chunk && (chunk = chunk_create())) {
+            atomic_store_explicit(&chunks[c], chunk, memory_order_release);
+        }
+        pthread_mutex_unlock(&grow_lock);
+        if(!chunk) {
+            return NULL;
+        }
+    }
+
+    uint32_t slot = pid & (PROC_CHUNK - 1);
+    uint8_t* block = (uint8_t*)&chunk[PROC_CHUNK] + (size_t)slot * SLAB_BLOCK;
+    nvm_process_t* proc = &chunk[slot];
+    proc->pid = pid;
+    proc->stack = (int32_t*)block;
+    proc->locals = proc->stack + STACK_SIZE;
+    proc->mailbox = (nvm_mailbox_t*)(proc->locals + MAX_LOCALS);
+    proc->console = (nvm_console_t*)(proc->mailbox + 1);
+    proc->calls = (uint32_t*)(proc->console + 1);
+    proc->arena = (int32_t*)(proc->calls + CALL_DEPTH_MAX);
+    return proc;
+}
+
+void nvm_proctab_free(nvm_process_t* proc) {
+    uint64_t head = atomic_load(&free_head);
+    uint64_t next;
+    do {
+        atomic_store(&proc->next_free, (uint32_t)head);
+        next = ((head >> 32) + 1) << 32 | (proc->pid + 1);
+    } while(!atomic_compare_exchange_weak(&free_head, &head, next));
+}
+
+void nvm_proctab_reset() {
+    uint32_t count = nvm_proctab_count();
+    for(uint32_t pid = 0; pid < count; pid++) {
+        nvm_process_t* proc = nvm_proctab_get(pid);
+        if(proc) {
+            proc->active = false;
+        }
+    }
+
+    atomic_store(&free_head, 0);
+    atomic_store(&next_pid, 0);
+}
@@ -0,0 +1,30 @@
+#ifndef PROCTAB_H
+#define PROCTAB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Process slots are allocated in chunks that never move
+#define PROC_CHUNK_SHIFT 10
+#define PROC_CHUNK       (1u << PROC_CHUNK_SHIFT)
+#define PROC_MAX_CHUNKS  4096
+#define MAX_PROCESSES    (PROC_CHUNK * PROC_MAX_CHUNKS)
+
+// Take a free slot, NULL when out of slots or memory. The slot keeps the
+// state of its previous process except pid and its slab pointers.
+nvm_process_t* nvm_proctab_alloc();
+
+// Return a slot to the free list; its state stays readable until reused
+void nvm_proctab_free(nvm_process_t* proc);
+
+// Slot of `pid`, NULL if it was never allocated
+nvm_process_t* nvm_proctab_get(uint32_t pid);
+
+// Number of PIDs handed out so far, all below this have a slot
+uint32_t nvm_proctab_count();
+
+// Forget all slots, only while no process is running
+void nvm_proctab_reset();
+
+#endif // PROCTAB_H
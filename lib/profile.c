@@ -0,0 +1,518 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <log.h>
+#include <nvm.h>
+#include <verify.h>
+#include <profile.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Instruction-level profiler.
+//
+// A profiled process never enters run_checked, run_verified or the JIT:
+// nvm_run hands every slice to nvm_profile_run, which steps the reference
+// core one instruction at a time and reads the time stamp counter after
+// each. The ticks between two reads are charged to the opcode, to the byte
+// offset of the instruction and to the function it ran in. With profiling
+// off the only cost is the test of nvm_profile_enabled once per slice.
+//
+// Functions form a calling context tree: CALL and CALLF move to the child
+// node of the target offset, RET and RETF back to the parent. Every path
+// from the top level gets its own node, which is what a folded stack line
+// needs; calls nested deeper than PROFILE_DEPTH stay in the deepest node.
+//
+// Basic blocks are found while running: whatever runs after a control
+// transfer or syscall starts one, as does the target of any other jump. The
+// report walks the executed instructions from each start to rebuild them.
+
+#ifndef PROFILE_DEPTH
+#define PROFILE_DEPTH 512
+#endif
+
+#define PROFILE_TOP 20              // Blocks and functions listed in a report
+#define NO_NODE UINT32_MAX
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICK_UNIT "cycles"
+static inline uint64_t ticks() {
+    return __rdtsc();
+}
+#else
+#define TICK_UNIT "ns"
+static inline uint64_t ticks() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+typedef struct {
+    uint32_t parent;        // Caller, NO_NODE for the top level
+    uint32_t func;          // Entry offset, 0 for the top level
+    uint32_t child;         // First callee
+    uint32_t sibling;       // Next callee of the parent
+    uint64_t self;          // Ticks spent in the function itself
+    uint64_t total;         // Including callees, filled in by the report
+} profile_node_t;
+
+struct nvm_profile {
+    uint64_t op_count[256];
+    uint64_t op_ticks[256];
+    uint64_t* count;        // Executions per byte offset
+    uint64_t* ticks;        // Ticks per byte offset
+    uint64_t* calls;        // Calls per target offset
+    uint8_t* leader;        // Offsets that start a basic block
+
+    profile_node_t* nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    uint32_t node;          // Function running now
+    uint32_t depth;         // Nodes above the top level
+    uint32_t overflow;      // Calls past PROFILE_DEPTH not yet returned from
+};
+
+bool nvm_profile_enabled = false;
+
+static _Atomic uint64_t executed = 0;       // By every process reported so far
+
+static FILE* report_file = NULL;
+static FILE* folded_file = NULL;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* const op_names[256] = {
+    [OP_HALT] = "HALT", [OP_NOP] = "NOP", [OP_PUSH] = "PUSH", [OP_POP] = "POP",
+    [OP_DUP] = "DUP", [OP_SWAP] = "SWAP",
+    [OP_ADD] = "ADD", [OP_SUB] = "SUB", [OP_MUL] = "MUL", [OP_DIV] = "DIV", [OP_MOD] = "MOD",
+    [OP_CMP] = "CMP", [OP_EQ] = "EQ", [OP_NEQ] = "NEQ", [OP_GT] = "GT", [OP_LT] = "LT",
+    [OP_JMP] = "JMP", [OP_JZ] = "JZ", [OP_JNZ] = "JNZ", [OP_CALL] = "CALL", [OP_RET] = "RET",
+    [OP_CALLF] = "CALLF", [OP_RETF] = "RETF", [OP_ENTER] = "ENTER", [OP_LEAVE] = "LEAVE",
+    [OP_LOAD] = "LOAD", [OP_STORE] = "STORE", [OP_LOADF] = "LOADF", [OP_STOREF] = "STOREF",
+    [OP_STORE_ABS] = "STORE_ABS",
+    [OP_LOAD8] = "LOAD8", [OP_LOAD16] = "LOAD16", [OP_LOAD32] = "LOAD32",
+    [OP_STORE8] = "STORE8", [OP_STORE16] = "STORE16", [OP_STORE32] = "STORE32",
+    [OP_MEMCPY] = "MEMCPY", [OP_MEMSET] = "MEMSET", [OP_MEMCMP] = "MEMCMP",
+    [OP_SYSCALL] = "SYSCALL", [OP_BREAK] = "BREAK",
+    [OP_VADD] = "VADD", [OP_VSUB] = "VSUB", [OP_VMUL] = "VMUL", [OP_VMIN] = "VMIN",
+    [OP_VMAX] = "VMAX", [OP_VSUM] = "VSUM", [OP_VRMIN] = "VRMIN", [OP_VRMAX] = "VRMAX",
+    [OP_VDOT] = "VDOT", [OP_VCOUNTEQ] = "VCOUNTEQ", [OP_VCOUNTGT] = "VCOUNTGT",
+    [OP_VCOUNTLT] = "VCOUNTLT",
+    [OP_ADD64] = "ADD64", [OP_SUB64] = "SUB64", [OP_MUL64] = "MUL64", [OP_DIV64] = "DIV64",
+    [OP_MOD64] = "MOD64", [OP_CMP64] = "CMP64", [OP_EXT64] = "EXT64",
+    [OP_ADDC] = "ADDC", [OP_SUBC] = "SUBC", [OP_MULC] = "MULC",
+    [OP_ADD64C] = "ADD64C", [OP_SUB64C] = "SUB64C", [OP_MUL64C] = "MUL64C",
+    [OP_FMUL] = "FMUL", [OP_FDIV] = "FDIV",
+    [OP_DIVC] = "DIVC", [OP_MODC] = "MODC", [OP_DIV64C] = "DIV64C", [OP_MOD64C] = "MOD64C",
+};
+
+bool nvm_profile_open(const char* report, const char* folded) {
+    if(report && !(report_file = fopen(report, "w"))) {
+        return false;
+    }
+    if(folded && !(folded_file = fopen(folded, "w"))) {
+        if(report_file) {
+            fclose(report_file);
+            report_file = NULL;
+        }
+        return false;
+    }
+    nvm_profile_enabled = true;
+    return true;
+}
+
+void nvm_profile_close() {
+    if(report_file) {
+        fclose(report_file);
+        report_file = NULL;
+    }
+    if(folded_file) {
+        fclose(folded_file);
+        folded_file = NULL;
+    }
+}
+
+void nvm_profile_free(nvm_process_t* proc) {
+    nvm_profile_t* prof = proc->profile;
+    if(prof) {
+        free(prof->count);
+        free(prof->ticks);
+        free(prof->calls);
+        free(prof->leader);
+        free(prof->nodes);
+        free(prof);
+        proc->profile = NULL;
+    }
+}
+
+static uint32_t add_node(nvm_profile_t* prof, uint32_t parent, uint32_t func) {
+    if(prof->node_count == prof->node_cap) {
+        uint32_t cap = prof->node_cap ? prof->node_cap * 2 : 64;
+        profile_node_t* nodes = realloc(prof->nodes, cap * sizeof(profile_node_t));
+        if(!nodes) {
+            return NO_NODE;
+        }
+        prof->nodes = nodes;
+        prof->node_cap = cap;
+    }
+
+    uint32_t index = prof->node_count++;
+    profile_node_t* node = &prof->nodes[index];
+    node->parent = parent;
+    node->func = func;
+    node->child = NO_NODE;
+    node->sibling = NO_NODE;
+    node->self = 0;
+    node->total = 0;
+    if(parent != NO_NODE) {
+        node->sibling = prof->nodes[parent].child;
+        prof->nodes[parent].child = index;
+    }
+    return index;
+}
+
+static nvm_profile_t* profile_new(nvm_process_t* proc) {
+    nvm_profile_t* prof = calloc(1, sizeof(nvm_profile_t));
+    if(!prof) {
+        return NULL;
+    }
+    proc->profile = prof;
+
+    prof->count = calloc(proc->size, sizeof(uint64_t));
+    prof->ticks = calloc(proc->size, sizeof(uint64_t));
+    prof->calls = calloc(proc->size, sizeof(uint64_t));
+    prof->leader = calloc(proc->size, 1);
+    if(!prof->count || !prof->ticks || !prof->calls || !prof->leader || add_node(prof, NO_NODE, 0) != 0) {
+        nvm_profile_free(proc);
+        return NULL;
+    }
+    prof->node = 0;
+    if(proc->size > 4) {
+        prof->leader[4] = 1;
+    }
+    return prof;
+}
+
+// Enter the function at `func`, called from the current node
+static void enter(nvm_profile_t* prof, uint32_t func) {
+    if(prof->depth >= PROFILE_DEPTH || prof->overflow > 0) {
+        prof->overflow++;
+        return;
+    }
+
+    uint32_t index = prof->nodes[prof->node].child;
+    while(index != NO_NODE && prof->nodes[index].func != func) {
+        index = prof->nodes[index].sibling;
+    }
+    if(index == NO_NODE && (index = add_node(prof, prof->node, func)) == NO_NODE) {
+        prof->overflow++;
+        return;
+    }
+
+    prof->node = index;
+    prof->depth++;
+}
+
+static void leave(nvm_profile_t* prof) {
+    if(prof->overflow > 0) {
+        prof->overflow--;
+    } else if(prof->depth > 0) {
+        prof->node = prof->nodes[prof->node].parent;
+        prof->depth--;
+    }
+}
+
+void nvm_profile_run(nvm_process_t* proc) {
+    nvm_profile_t* prof = proc->profile;
+    if(!prof && !(prof = profile_new(proc))) {
+        LOG_WARN("Process %d: Cannot allocate profile counters\n", proc->pid);
+        proc->exit_code = -1;
+        proc->active = false;
+        return;
+    }
+
+    uint64_t last = ticks();
+    while(proc->active && !proc->blocked && proc->budget > 0) {
+        uint32_t at = (uint32_t)proc->ip;
+        if(at >= proc->size) {
+            // Let the reference core report it
+            nvm_execute_instruction(proc);
+            return;
+        }
+
+        uint8_t op = proc->bytecode[at];
+        uint32_t node = prof->node;
+        bool ok = nvm_execute_instruction(proc);
+
+        uint64_t now = ticks();
+        uint64_t spent = now - last;
+        last = now;
+        prof->op_ticks[op] += spent;
+        prof->ticks[at] += spent;
+        prof->nodes[node].self += spent;
+        if(proc->blocked) {
+            // A blocked syscall runs again once the process wakes up
+            return;
+        }
+        prof->op_count[op]++;
+        prof->count[at]++;
+        if(!ok) {
+            return;
+        }
+
+        uint32_t next = (uint32_t)proc->ip;
+        if(((nvm_opinfo[op].flags & OPF_END) || next != at + 1 + nvm_opinfo[op].operand) && next < proc->size) {
+            prof->leader[next] = 1;
+        }
+
+        // Same preemption points as the interpreter
+        switch(op) {
+            case OP_CALL:
+            case OP_CALLF:
+                prof->calls[next]++;
+                enter(prof, next);
+                proc->budget--;
+                break;
+            case OP_RET:
+            case OP_RETF:
+                leave(prof);
+                proc->budget--;
+                break;
+            default:
+                if(next <= at) {
+                    proc->budget--;
+                }
+                break;
+        }
+    }
+}
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;           // Offset after the last instruction
+    uint64_t entries;
+    uint64_t insns;
+    uint64_t ticks;
+} profile_block_t;
+
+typedef struct {
+    uint32_t func;
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+} profile_func_t;
+
+static int by_block_ticks(const void* a, const void* b) {
+    uint64_t x = ((const profile_block_t*)a)->ticks, y = ((const profile_block_t*)b)->ticks;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_func_total(const void* a, const void* b) {
+    uint64_t x = ((const profile_func_t*)a)->total, y = ((const profile_func_t*)b)->total;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static void report_opcodes(FILE* out, const nvm_profile_t* prof, uint64_t total) {
+    uint8_t order[256];
+    int used = 0;
+    for(int op = 0; op < 256; op++) {
+        if(prof->op_count[op] > 0 || prof->op_ticks[op] > 0) {
+            // Insertion sort by ticks, there are few opcodes
+            int i = used++;
+            while(i > 0 && prof->op_ticks[order[i - 1]] < prof->op_ticks[op]) {
+                order[i] = order[i - 1];
+                i--;
+            }
+            order[i] = (uint8_t)op;
+        }
+    }
+
+    fprintf(out, "\nOpcodes by %s:\n", TICK_UNIT);
+    fprintf(out, "  %-10s %14s %16s %7s %10s\n", "opcode", "count", TICK_UNIT, "%", "per insn");
+    for(int i = 0; i < used; i++) {
+        uint8_t op = order[i];
+        char unknown[8];
+        const char* name = op_names[op];
+        if(!name) {
+            snprintf(unknown, sizeof(unknown), "0x%02X", op);
+            name = unknown;
+        }
+        fprintf(out, "  %-10s %14" PRIu64 " %16" PRIu64 " %6.2f%% %10.1f\n", name,
+                prof->op_count[op], prof->op_ticks[op], percent(prof->op_ticks[op], total),
+                prof->op_count[op] ? (double)prof->op_ticks[op] / (double)prof->op_count[op] : 0.0);
+    }
+}
+
+static void report_blocks(FILE* out, const nvm_process_t* proc, const nvm_profile_t* prof, uint64_t total) {
+    uint32_t leaders = 0;
+    for(uint32_t at = 4; at < proc->size; at++) {
+        leaders += prof->leader[at] && prof->count[at] > 0;
+    }
+    profile_block_t* blocks = malloc((leaders ? leaders : 1) * sizeof(profile_block_t));
+    if(!blocks) {
+        return;
+    }
+
+    uint32_t count = 0;
+    for(uint32_t start = 4; start < proc->size; start++) {
+        if(!prof->leader[start] || prof->count[start] == 0) {
+            continue;
+        }
+
+        profile_block_t* block = &blocks[count++];
+        block->start = start;
+        block->entries = prof->count[start];
+        block->insns = 0;
+        block->ticks = 0;
+
+        // Executed instructions up to the next control transfer or block start
+        uint32_t at = start;
+        do {
+            uint8_t op = proc->bytecode[at];
+            block->insns += prof->count[at];
+            block->ticks += prof->ticks[at];
+            at += 1 + nvm_opinfo[op].operand;
+            if(nvm_opinfo[op].flags & OPF_END) {
+                break;
+            }
+        } while(at < proc->size && !prof->leader[at] && prof->count[at] > 0);
+        block->end = at;
+    }
+    qsort(blocks, count, sizeof(profile_block_t), by_block_ticks);
+
+    fprintf(out, "\nHottest basic blocks:\n");
+    fprintf(out, "  %-17s %14s %14s %16s %7s\n", "offsets", "entries", "instructions", TICK_UNIT, "%");
+    for(uint32_t i = 0; i < count && i < PROFILE_TOP; i++) {
+        char range[24];
+        snprintf(range, sizeof(range), "0x%04x-0x%04x", blocks[i].start, blocks[i].end - 1);
+        fprintf(out, "  %-17s %14" PRIu64 " %14" PRIu64 " %16" PRIu64 " %6.2f%%\n", range,
+                blocks[i].entries, blocks[i].insns, blocks[i].ticks, percent(blocks[i].ticks, total));
+    }
+    free(blocks);
+}
+
+// Whether a caller of `index` runs the same function, whose total then
+// already holds this one
+static bool recursive(const nvm_profile_t* prof, uint32_t index) {
+    uint32_t func = prof->nodes[index].func;
+    for(uint32_t up = prof->nodes[index].parent; up != NO_NODE; up = prof->nodes[up].parent) {
+        if(prof->nodes[up].func == func) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void report_functions(FILE* out, nvm_profile_t* prof, uint64_t total) {
+    profile_func_t* funcs = malloc(prof->node_count * sizeof(profile_func_t));
+    if(!funcs) {
+        return;
+    }
+
+    // Callees always come after their caller
+    for(uint32_t i = 0; i < prof->node_count; i++) {
+        prof->nodes[i].total = prof->nodes[i].self;
+    }
+    for(uint32_t i = prof->node_count - 1; i > 0; i--) {
+        prof->nodes[prof->nodes[i].parent].total += prof->nodes[i].total;
+    }
+
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < prof->node_count; i++) {
+        const profile_node_t* node = &prof->nodes[i];
+        uint32_t f = 0;
+        while(f < count && funcs[f].func != node->func) {
+            f++;
+        }
+        if(f == count) {
+            funcs[count++] = (profile_func_t){ .func = node->func, .calls = prof->calls[node->func] };
+        }
+        funcs[f].self += node->self;
+        if(!recursive(prof, i)) {
+            funcs[f].total += node->total;
+        }
+    }
+    qsort(funcs, count, sizeof(profile_func_t), by_func_total);
+
+    fprintf(out, "\nFunctions by total %s:\n", TICK_UNIT);
+    fprintf(out, "  %-10s %14s %16s %7s %16s %7s\n", "entry", "calls", "self", "%", "total", "%");
+    for(uint32_t i = 0; i < count && i < PROFILE_TOP; i++) {
+        char entry[16];
+        if(funcs[i].func == 0) {
+            snprintf(entry, sizeof(entry), "(top)");
+        } else {
+            snprintf(entry, sizeof(entry), "0x%04x", funcs[i].func);
+        }
+        fprintf(out, "  %-10s %14" PRIu64 " %16" PRIu64 " %6.2f%% %16" PRIu64 " %6.2f%%\n", entry,
+                funcs[i].calls, funcs[i].self, percent(funcs[i].self, total),
+                funcs[i].total, percent(funcs[i].total, total));
+    }
+    free(funcs);
+}
+
+// One line per calling context with ticks of its own:
+// "pid1;main;0x0040;0x0080 12345"
+static void write_folded(FILE* out, const nvm_process_t* proc, const nvm_profile_t* prof) {
+    uint32_t path[PROFILE_DEPTH + 1];
+    for(uint32_t i = 0; i < prof->node_count; i++) {
+        if(prof->nodes[i].self == 0) {
+            continue;
+        }
+
+        uint32_t depth = 0;
+        for(uint32_t up = i; up != 0; up = prof->nodes[up].parent) {
+            path[depth++] = prof->nodes[up].func;
+        }
+        fprintf(out, "pid%u;main", proc->pid);
+        while(depth > 0) {
+            fprintf(out, ";0x%04x", path[--depth]);
+        }
+        fprintf(out, " %" PRIu64 "\n", prof->nodes[i].self);
+    }
+}
+
+uint64_t nvm_profile_executed() {
+    return atomic_load(&executed);
+}
+
+void nvm_profile_report(nvm_process_t* proc) {
+    nvm_profile_t* prof = proc->profile;
+    if(!prof) {
+        return;
+    }
+
+    uint64_t insns = 0, total = 0;
+    for(int op = 0; op < 256; op++) {
+        insns += prof->op_count[op];
+        total += prof->op_ticks[op];
+    }
+    atomic_fetch_add(&executed, insns);
+
+    pthread_mutex_lock(&output_lock);
+    if(report_file) {
+        fprintf(report_file, "Process %u: %" PRIu64 " instructions, %" PRIu64 " %s\n",
+                proc->pid, insns, total, TICK_UNIT);
+        report_opcodes(report_file, prof, total);
+        report_blocks(report_file, proc, prof, total);
+        report_functions(report_file, prof, total);
+        fprintf(report_file, "\n");
+        fflush(report_file);
+    }
+    if(folded_file) {
+        write_folded(folded_file, proc, prof);
+        fflush(folded_file);
+    }
+    pthread_mutex_unlock(&output_lock);
+}
@@ -0,0 +1,32 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Set by nvm_profile_open; while it is false nothing here runs
+extern bool nvm_profile_enabled;
+
+// Start profiling every process. Reports go to `report`, folded stacks for
+// flamegraph.pl to `folded`; either may be NULL. False if a file cannot be
+// opened.
+bool nvm_profile_open(const char* report, const char* folded);
+
+// Flush and close the files
+void nvm_profile_close();
+
+// Run a slice of the process on the reference core, counting every
+// instruction it executes
+void nvm_profile_run(nvm_process_t* proc);
+
+// Instructions of every profiled process that has stopped
+uint64_t nvm_profile_executed();
+
+// Write the report and folded stacks of a process that stopped
+void nvm_profile_report(nvm_process_t* proc);
+
+// Drop the counters of a process
+void nvm_profile_free(nvm_process_t* proc);
+
+#endif // PROFILE_H
@@ -0,0 +1,533 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <nvm.h>
+#include <scheduler.h>
+#include <proctab.h>
+#include <message.h>
+#include <profile.h>
+
+// M:N scheduler.
+//
+// Each worker thread owns a Chase-Lev deque of runnable PIDs. A worker puts
+// a preempted process back at the bottom of its own deque and takes work
+// from the top, so its processes run round-robin, and idle workers steal
+// from the top of the others. New and woken processes go through a shared
+// injection deque whose producer side is serialized by a mutex.
+//
+// `queued` counts processes sitting in any deque. It is raised before a push
+// and lowered after a successful steal, so it never undercounts. A worker
+// only sleeps after announcing itself in `idle` and then seeing queued == 0
+// under idle_lock; producers raise queued before looking at idle, so a
+// wakeup cannot be lost.
+//
+// A process that blocks in a syscall is parked instead of requeued: the
+// worker publishes a fresh wait generation in `parked` and forgets it. Who
+// swaps that generation back to 0 owns the wakeup and enqueues the process,
+// so a message and a timeout racing for it wake it once. Deadlines sit in a
+// heap under timer_lock that workers drain before taking work and sleep
+// towards when idle; entries of processes woken otherwise are dropped when
+// they come due. Once every worker is idle with nothing queued and no
+// process waiting on a deadline, nothing can become runnable again and
+// nvm_scheduler_run returns.
+
+uint32_t nvm_workers = 0;
+
+#define DEQUE_INITIAL 64
+#define DEQUE_EMPTY   (-1)
+
+// Deque storage. A full deque moves to a buffer twice the size; thieves may
+// still be reading the old one, so it is only freed with the deque.
+typedef struct deque_buf {
+    int64_t mask;                           // Size - 1, size is a power of two
+    struct deque_buf* retired;              // Previous, smaller buffer
+    _Atomic uint32_t slots[];
+} deque_buf_t;
+
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;       // Next entry to take, shared by thieves
+    _Alignas(64) _Atomic int64_t bottom;    // Next free slot, written by the owner only
+    _Atomic(deque_buf_t*) buf;
+} nvm_deque_t;
+
+typedef struct {
+    nvm_deque_t deque;
+    pthread_t thread;
+    uint32_t seed;                          // Victim selection
+} nvm_worker_t;
+
+static nvm_deque_t inject;
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static nvm_worker_t* workers = NULL;
+static uint32_t worker_count = 0;
+static _Thread_local nvm_worker_t* self = NULL;
+
+static _Atomic int32_t queued = 0;
+static _Atomic uint32_t idle = 0;
+static uint32_t pool_size = 0;              // Running workers, under idle_lock
+static bool stopping = false;
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+#define NO_DEADLINE UINT64_MAX
+
+typedef struct {
+    uint64_t deadline;
+    uint32_t pid;
+    uint32_t gen;                           // Wait generation the timer belongs to
+} nvm_timer_t;
+
+static nvm_timer_t* timers = NULL;          // Binary min-heap on deadline
+static uint32_t timer_count = 0;
+static uint32_t timer_capacity = 0;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint64_t next_deadline = NO_DEADLINE;
+static _Atomic int32_t sleepers = 0;        // Parked processes with a deadline
+
+static deque_buf_t* deque_buf_new(int64_t size, deque_buf_t* retired) {
+    deque_buf_t* buf = malloc(sizeof(deque_buf_t) + size * sizeof(_Atomic uint32_t));
+    if(!buf) {
+        fprintf(stderr, "Error: Memory allocation failed in scheduler\n");
+        abort();
+    }
+
+    buf->mask = size - 1;
+    buf->retired = retired;
+    return buf;
+}
+
+static void deque_init(nvm_deque_t* q) {
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->buf, deque_buf_new(DEQUE_INITIAL, NULL));
+}
+
+static void deque_destroy(nvm_deque_t* q) {
+    deque_buf_t* buf = atomic_load(&q->buf);
+    while(buf) {
+        deque_buf_t* retired = buf->retired;
+        free(buf);
+        buf = retired;
+    }
+    atomic_store(&q->buf, NULL);
+}
+
+static void deque_push(nvm_deque_t* q, uint32_t pid) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    deque_buf_t* buf = atomic_load_explicit(&q->buf, memory_order_relaxed);
+
+    if(b - t > buf->mask) {
+        deque_buf_t* grown = deque_buf_new((buf->mask + 1) * 2, buf);
+        for(int64_t i = t; i < b; i++) {
+            atomic_store_explicit(&grown->slots[i & grown->mask],
+                                  atomic_load_explicit(&buf->slots[i & buf->mask], memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        atomic_store_explicit(&q->buf, grown, memory_order_release);
+        buf = grown;
+    }
+
+    atomic_store_explicit(&buf->slots[b & buf->mask], pid, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+static int64_t deque_steal(nvm_deque_t* q) {
+    for(;;) {
+        int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+        if(t >= b) {
+            return DEQUE_EMPTY;
+        }
+
+        deque_buf_t* buf = atomic_load_explicit(&q->buf, memory_order_acquire);
+        uint32_t pid = atomic_load_explicit(&buf->slots[t & buf->mask], memory_order_relaxed);
+        if(atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed)) {
+            return pid;
+        }
+    }
+}
+
+static void notify() {
+    if(atomic_load(&idle) > 0) {
+        pthread_mutex_lock(&idle_lock);
+        pthread_cond_signal(&idle_cond);
+        pthread_mutex_unlock(&idle_lock);
+    }
+}
+
+void nvm_scheduler_reset() {
+    deque_destroy(&inject);
+    deque_init(&inject);
+    atomic_store(&queued, 0);
+
+    pthread_mutex_lock(&timer_lock);
+    timer_count = 0;
+    atomic_store(&next_deadline, NO_DEADLINE);
+    atomic_store(&sleepers, 0);
+    pthread_mutex_unlock(&timer_lock);
+}
+
+void nvm_scheduler_enqueue(uint32_t pid) {
+    atomic_fetch_add(&queued, 1);
+    pthread_mutex_lock(&inject_lock);
+    deque_push(&inject, pid);
+    pthread_mutex_unlock(&inject_lock);
+    notify();
+}
+
+// Put a preempted or woken process back, on the current worker if there is
+// one. A worker takes its own preempted process straight back when nothing
+// else is queued, so no idle worker needs waking for it.
+static void requeue(uint32_t pid, bool preempted) {
+    if(!self) {
+        nvm_scheduler_enqueue(pid);
+        return;
+    }
+
+    int32_t before = atomic_fetch_add(&queued, 1);
+    deque_push(&self->deque, pid);
+    if(!preempted || before > 0) {
+        notify();
+    }
+}
+
+// Own deque first, then the injection deque, then steal from a random victim
+static int64_t take() {
+    int64_t pid = DEQUE_EMPTY;
+
+    if(self) {
+        pid = deque_steal(&self->deque);
+    }
+    if(pid == DEQUE_EMPTY) {
+        pid = deque_steal(&inject);
+    }
+    if(pid == DEQUE_EMPTY && self && worker_count > 1) {
+        self->seed = self->seed * 1103515245u + 12345u;
+        uint32_t start = (self->seed >> 16) % worker_count;
+        for(uint32_t i = 0; i < worker_count && pid == DEQUE_EMPTY; i++) {
+            nvm_worker_t* victim = &workers[(start + i) % worker_count];
+            if(victim != self) {
+                pid = deque_steal(&victim->deque);
+            }
+        }
+    }
+
+    if(pid != DEQUE_EMPTY) {
+        atomic_fetch_sub(&queued, 1);
+    }
+    return pid;
+}
+
+uint64_t nvm_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void timer_add(uint64_t deadline, uint32_t pid, uint32_t gen) {
+    pthread_mutex_lock(&timer_lock);
+    if(timer_count == timer_capacity) {
+        uint32_t capacity = timer_capacity ? timer_capacity * 2 : DEQUE_INITIAL;
+        nvm_timer_t* grown = realloc(timers, capacity * sizeof(nvm_timer_t));
+        if(!grown) {
+            fprintf(stderr, "Error: Memory allocation failed in scheduler\n");
+            abort();
+        }
+        timers = grown;
+        timer_capacity = capacity;
+    }
+
+    uint32_t i = timer_count++;
+    while(i > 0 && timers[(i - 1) / 2].deadline > deadline) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i] = (nvm_timer_t){deadline, pid, gen};
+
+    atomic_store(&next_deadline, timers[0].deadline);
+    pthread_mutex_unlock(&timer_lock);
+}
+
+static nvm_timer_t timer_pop() {
+    nvm_timer_t top = timers[0];
+    nvm_timer_t last = timers[--timer_count];
+
+    uint32_t i = 0;
+    for(;;) {
+        uint32_t child = i * 2 + 1;
+        if(child >= timer_count) {
+            break;
+        }
+        if(child + 1 < timer_count && timers[child + 1].deadline < timers[child].deadline) {
+            child++;
+        }
+        if(timers[child].deadline >= last.deadline) {
+            break;
+        }
+        timers[i] = timers[child];
+        i = child;
+    }
+    if(timer_count > 0) {
+        timers[i] = last;
+    }
+    return top;
+}
+
+// Wake the process if it is still parked on this wait
+static void unpark(nvm_process_t* proc, uint32_t gen, int8_t reason) {
+    if(gen == 0) {
+        gen = atomic_exchange(&proc->parked, 0);
+        if(gen == 0) {
+            return;
+        }
+    } else if(!atomic_compare_exchange_strong(&proc->parked, &gen, 0)) {
+        return;
+    }
+
+    // The process is ours until it is queued again
+    if(proc->wake_deadline) {
+        atomic_fetch_sub(&sleepers, 1);
+    }
+    proc->blocked = false;
+    proc->wakeup_reason = reason;
+    // Behind the waker in its own round-robin, the injection deque is only
+    // looked at once that runs dry
+    requeue(proc->pid, false);
+}
+
+static void expire_timers() {
+    if(atomic_load_explicit(&next_deadline, memory_order_relaxed) == NO_DEADLINE) {
+        return;
+    }
+
+    uint64_t now = nvm_now_ns();
+    if(now < atomic_load(&next_deadline)) {
+        return;
+    }
+
+    pthread_mutex_lock(&timer_lock);
+    while(timer_count > 0 && timers[0].deadline <= now) {
+        nvm_timer_t timer = timer_pop();
+        unpark(nvm_proctab_get(timer.pid), timer.gen, WAKE_TIMEOUT);
+    }
+    atomic_store(&next_deadline, timer_count > 0 ? timers[0].deadline : NO_DEADLINE);
+    pthread_mutex_unlock(&timer_lock);
+}
+
+// Stop scheduling a process that blocked until a wakeup. Everything needed
+// is read before publishing the wait; from then on a waker may own it.
+static void park(nvm_process_t* proc) {
+    uint32_t gen = ++proc->wait_gen;
+    if(gen == 0) {
+        gen = ++proc->wait_gen;
+    }
+    uint32_t pid = proc->pid;
+    uint64_t deadline = proc->wake_deadline;
+    nvm_mailbox_t* mailbox = proc->mailbox;
+
+    if(deadline) {
+        atomic_fetch_add(&sleepers, 1);
+    }
+    atomic_store(&proc->parked, gen);
+
+    if(deadline) {
+        timer_add(deadline, pid, gen);
+    }
+
+    // A message sent before the wait was published found nobody to wake
+    if(nvm_mailbox_pending(mailbox)) {
+        unpark(proc, gen, WAKE_MESSAGE);
+    }
+}
+
+// Run one time slice of a process taken off a deque
+static void run_slice(uint32_t pid) {
+    nvm_process_t* proc = nvm_proctab_get(pid);
+    if(!proc->active || proc->blocked) {
+        return;
+    }
+
+    current_process = pid;
+    proc->budget = proc->quantum;
+    uint64_t start = nvm_now_ns();
+
+#if NVM_THREADED
+    nvm_run(proc);
+#else
+    if(nvm_profile_enabled) {
+        nvm_profile_run(proc);
+    } else {
+        while(proc->active && !proc->blocked && proc->budget-- > 0) {
+            if(!nvm_execute_instruction(proc)) {
+                break;
+            }
+        }
+    }
+#endif
+
+    uint64_t elapsed = nvm_now_ns() - start;
+    proc->cpu_ns += elapsed;
+    proc->slices++;
+    atomic_fetch_add_explicit(&timer_ticks, 1, memory_order_relaxed);
+
+    if(!proc->active) {
+        nvm_process_finished(proc);
+        return;
+    }
+
+    // Preempted: size the next slice to take about TIME_SLICE_MS
+    if(proc->budget <= 0) {
+        uint64_t slice_ns = (uint64_t)TIME_SLICE_MS * 1000000ull;
+        if(elapsed < slice_ns / 2 && proc->quantum < QUANTUM_MAX) {
+            proc->quantum *= 2;
+        } else if(elapsed > slice_ns * 2 && proc->quantum > QUANTUM_MIN) {
+            proc->quantum /= 2;
+        }
+    }
+
+    if(proc->blocked) {
+        park(proc);
+    } else {
+        requeue(pid, true);
+    }
+}
+
+// Run one time slice of the next runnable process. Returns false when no
+// process is runnable.
+bool nvm_scheduler_tick() {
+    expire_timers();
+    int64_t pid = take();
+    if(pid == DEQUE_EMPTY) {
+        return false;
+    }
+
+    run_slice((uint32_t)pid);
+    return true;
+}
+
+static void* worker_main(void* arg) {
+    self = arg;
+
+    for(;;) {
+        expire_timers();
+        int64_t pid = take();
+        if(pid != DEQUE_EMPTY) {
+            run_slice((uint32_t)pid);
+            continue;
+        }
+
+        pthread_mutex_lock(&idle_lock);
+        atomic_fetch_add(&idle, 1);
+        while(!stopping && atomic_load(&queued) == 0) {
+            if(atomic_load(&idle) == pool_size && atomic_load(&sleepers) == 0) {
+                stopping = true;
+                pthread_cond_broadcast(&idle_cond);
+                break;
+            }
+
+            uint64_t deadline = atomic_load(&next_deadline);
+            if(deadline == NO_DEADLINE) {
+                pthread_cond_wait(&idle_cond, &idle_lock);
+                continue;
+            }
+
+            // Sleep until the next deadline; the condition waits on CLOCK_REALTIME
+            uint64_t now = nvm_now_ns();
+            if(deadline <= now) {
+                break;
+            }
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t wake = (uint64_t)ts.tv_nsec + (deadline - now);
+            ts.tv_sec += wake / 1000000000ull;
+            ts.tv_nsec = wake % 1000000000ull;
+            pthread_cond_timedwait(&idle_cond, &idle_lock, &ts);
+        }
+        atomic_fetch_sub(&idle, 1);
+        bool done = stopping;
+        pthread_mutex_unlock(&idle_lock);
+
+        if(done) {
+            break;
+        }
+    }
+
+    self = NULL;
+    return NULL;
+}
+
+// Run until no process is runnable, on nvm_workers threads including the
+// calling one. Workers beyond the processes that are runnable sleep in
+// worker_main until forks, messages or timeouts give them something to do.
+void nvm_scheduler_run() {
+    uint32_t count = nvm_workers;
+    if(count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+
+    // Even a single worker runs the pool loop so it can sleep on timers
+    workers = calloc(count, sizeof(nvm_worker_t));
+    if(!workers) {
+        while(nvm_scheduler_tick()) {
+        }
+        return;
+    }
+
+    worker_count = count;
+    for(uint32_t i = 0; i < count; i++) {
+        deque_init(&workers[i].deque);
+        workers[i].seed = i * 2654435761u + 1;
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    stopping = false;
+    pool_size = count;
+    pthread_mutex_unlock(&idle_lock);
+
+    uint32_t started = 1;
+    for(; started < count; started++) {
+        if(pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+            break;
+        }
+    }
+    if(started < count) {
+        pthread_mutex_lock(&idle_lock);
+        pool_size = started;
+        pthread_cond_broadcast(&idle_cond);
+        pthread_mutex_unlock(&idle_lock);
+    }
+
+    worker_main(&workers[0]);
+
+    for(uint32_t i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for(uint32_t i = 0; i < count; i++) {
+        deque_destroy(&workers[i].deque);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+// Make a parked process runnable again, a no-op for any other
+void nvm_scheduler_wake(uint32_t pid, int8_t reason) {
+    nvm_process_t* proc = nvm_proctab_get(pid);
+    if(proc) {
+        unpark(proc, 0, reason);
+    }
+}
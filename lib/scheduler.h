@@ -0,0 +1,24 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Worker threads started by nvm_scheduler_run, 0 means one per online CPU
+extern uint32_t nvm_workers;
+
+// Drop all queued processes, only while the scheduler is not running
+void nvm_scheduler_reset();
+
+// Make a new process runnable
+void nvm_scheduler_enqueue(uint32_t pid);
+
+// Monotonic clock in nanoseconds, the base of wake_deadline
+uint64_t nvm_now_ns();
+
+// Called by the scheduler once a process has stopped, implemented by the
+// VM core
+void nvm_process_finished(nvm_process_t* proc);
+
+#endif // SCHEDULER_H
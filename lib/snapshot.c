@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <log.h>
+#include <nvm.h>
+#include <heap.h>
+#include <image.h>
+#include <snapshot.h>
+
+// Snapshots.
+//
+// The small parts of a process (stack, locals, call stack and the used part
+// of the frame arena, a few KiB at most) are copied into the snapshot and
+// back: that is cheaper than any page trick, and they share pages with
+// other slots of the process table anyway. Linear memory, which can be
+// large, goes into an anonymous memory file once, written a page at a time
+// and skipping pages of zeros. A restore maps that file privately over the
+// new process's reservation, so it takes the same time however big the
+// memory is and each clone only copies the pages it writes.
+//
+// A fork is a snapshot of the parent restored once. The serialized form is
+// the header below followed by the copied slots and the memory up to its
+// last non-zero byte, in host byte order; it only restores against the
+// image it was taken from.
+
+#define SNAPSHOT_PAGE 4096
+
+typedef struct {
+    char magic[4];              // "NVS0"
+    uint32_t image_size;
+    uint64_t image_hash;
+    uint64_t caps;
+    int32_t ip;
+    int32_t sp;
+    uint32_t csp;
+    uint32_t frame;             // Offset of the current frame in the arena
+    uint32_t frame_size;
+    uint32_t arena;             // Arena slots in use
+    uint32_t heap_size;
+    uint32_t heap_stored;       // Bytes of memory in the buffer, the rest is zero
+} snapshot_header_t;
+
+struct nvm_snapshot {
+    nvm_image_t* image;
+    snapshot_header_t head;     // heap_stored is only used in buffers
+    int heap_fd;                // Memory file, -1 without linear memory
+    int32_t slots[];            // Stack, locals, call stack, arena
+};
+
+static uint32_t slot_count(const snapshot_header_t* head) {
+    return (uint32_t)head->sp + MAX_LOCALS + head->csp + head->arena;
+}
+
+static bool zero_page(const uint8_t* page) {
+    static const uint8_t zeros[SNAPSHOT_PAGE];
+    return memcmp(page, zeros, SNAPSHOT_PAGE) == 0;
+}
+
+// Memory file holding `stored` bytes from `bytes`, zero up to `size`
+static int heap_file(const uint8_t* bytes, uint32_t stored, uint32_t size) {
+    int fd = memfd_create("nvm-heap", MFD_CLOEXEC);
+    if(fd < 0) {
+        return -1;
+    }
+    if(ftruncate(fd, size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    for(uint32_t at = 0; at < stored; at += SNAPSHOT_PAGE) {
+        uint32_t len = stored - at < SNAPSHOT_PAGE ? stored - at : SNAPSHOT_PAGE;
+        if(len == SNAPSHOT_PAGE && zero_page(bytes + at)) {
+            continue;
+        }
+        if(pwrite(fd, bytes + at, len, at) != (ssize_t)len) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static nvm_snapshot_t* snapshot_new(nvm_image_t* image, const snapshot_header_t* head) {
+    nvm_snapshot_t* snap = malloc(sizeof(nvm_snapshot_t) + slot_count(head) * sizeof(int32_t));
+    if(!snap) {
+        return NULL;
+    }
+
+    nvm_image_retain(image);
+    snap->image = image;
+    snap->head = *head;
+    snap->head.heap_stored = 0;
+    snap->heap_fd = -1;
+    return snap;
+}
+
+nvm_snapshot_t* nvm_snapshot_take(nvm_process_t* proc) {
+    snapshot_header_t head = {
+        .magic = "NVS0",
+        .image_size = proc->image->size,
+        .image_hash = proc->image->hash,
+        .caps = atomic_load(&proc->caps),
+        .ip = proc->ip,
+        .sp = proc->sp,
+        .csp = proc->csp,
+        .frame = (uint32_t)(proc->frame - proc->arena),
+        .frame_size = proc->frame_size,
+        .arena = (uint32_t)(proc->frame - proc->arena) + proc->frame_size,
+        .heap_size = proc->heap_size,
+    };
+
+    nvm_snapshot_t* snap = snapshot_new(proc->image, &head);
+    if(!snap) {
+        return NULL;
+    }
+
+    int32_t* slot = snap->slots;
+    memcpy(slot, proc->stack, head.sp * sizeof(int32_t));
+    slot += head.sp;
+    memcpy(slot, proc->locals, MAX_LOCALS * sizeof(int32_t));
+    slot += MAX_LOCALS;
+    memcpy(slot, proc->calls, head.csp * sizeof(uint32_t));
+    slot += head.csp;
+    memcpy(slot, proc->arena, head.arena * sizeof(int32_t));
+
+    if(head.heap_size > 0 && (snap->heap_fd = heap_file(proc->heap, head.heap_size, head.heap_size)) < 0) {
+        nvm_snapshot_free(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+void nvm_snapshot_free(nvm_snapshot_t* snap) {
+    if(snap) {
+        if(snap->heap_fd >= 0) {
+            close(snap->heap_fd);
+        }
+        nvm_image_release(snap->image);
+        free(snap);
+    }
+}
+
+nvm_process_t* nvm_snapshot_restore(const nvm_snapshot_t* snap) {
+    const snapshot_header_t* head = &snap->head;
+    nvm_process_t* proc = nvm_process_create(snap->image, head->caps);
+    if(!proc) {
+        return NULL;
+    }
+
+    if(!nvm_heap_map(proc, snap->heap_fd, head->heap_size)) {
+        LOG_WARN("Process %d: Cannot map linear memory of the snapshot\n", proc->pid);
+        proc->active = false;
+        nvm_process_release(proc);
+        return NULL;
+    }
+
+    const int32_t* slot = snap->slots;
+    memcpy(proc->stack, slot, head->sp * sizeof(int32_t));
+    slot += head->sp;
+    memcpy(proc->locals, slot, MAX_LOCALS * sizeof(int32_t));
+    slot += MAX_LOCALS;
+    memcpy(proc->calls, slot, head->csp * sizeof(uint32_t));
+    slot += head->csp;
+    memcpy(proc->arena, slot, head->arena * sizeof(int32_t));
+
+    proc->ip = head->ip;
+    proc->sp = head->sp;
+    proc->csp = head->csp;
+    proc->frame = proc->arena + head->frame;
+    proc->frame_size = head->frame_size;
+    return proc;
+}
+
+nvm_process_t* nvm_process_fork(nvm_process_t* proc) {
+    nvm_snapshot_t* snap = nvm_snapshot_take(proc);
+    if(!snap) {
+        return NULL;
+    }
+
+    // The child's mapping keeps the memory file alive
+    nvm_process_t* child = nvm_snapshot_restore(snap);
+    nvm_snapshot_free(snap);
+    return child;
+}
+
+uint8_t* nvm_snapshot_encode(const nvm_snapshot_t* snap, uint32_t* size) {
+    snapshot_header_t head = snap->head;
+    const uint8_t* heap = NULL;
+    if(head.heap_size > 0) {
+        heap = mmap(NULL, head.heap_size, PROT_READ, MAP_SHARED, snap->heap_fd, 0);
+        if(heap == MAP_FAILED) {
+            return NULL;
+        }
+        head.heap_stored = head.heap_size;
+        while(head.heap_stored > 0 && heap[head.heap_stored - 1] == 0) {
+            head.heap_stored--;
+        }
+    }
+
+    size_t slots = slot_count(&head) * sizeof(int32_t);
+    size_t total = sizeof(head) + slots + head.heap_stored;
+    uint8_t* data = total <= UINT32_MAX ? malloc(total) : NULL;
+    if(data) {
+        memcpy(data, &head, sizeof(head));
+        memcpy(data + sizeof(head), snap->slots, slots);
+        if(head.heap_stored > 0) {
+            memcpy(data + sizeof(head) + slots, heap, head.heap_stored);
+        }
+        *size = (uint32_t)total;
+    }
+
+    if(heap) {
+        munmap((void*)heap, head.heap_size);
+    }
+    return data;
+}
+
+// Every frame link must lead back to the start of the arena
+static bool frames_ok(const int32_t* arena, uint32_t frame) {
+    while(frame > 0) {
+        uint32_t link = (uint32_t)arena[frame - 1];
+        if(link > frame - 1) {
+            return false;
+        }
+        frame = frame - 1 - link;
+    }
+    return true;
+}
+
+nvm_snapshot_t* nvm_snapshot_decode(nvm_image_t* image, const uint8_t* data, uint32_t size,
+                                    const char** error) {
+    snapshot_header_t head;
+    if(size < sizeof(head)) {
+        *error = "Snapshot truncated";
+        return NULL;
+    }
+    memcpy(&head, data, sizeof(head));
+
+    if(memcmp(head.magic, "NVS0", 4) != 0) {
+        *error = "Not a snapshot";
+        return NULL;
+    }
+    if(head.image_size != image->size || head.image_hash != image->hash) {
+        *error = "Snapshot of another image";
+        return NULL;
+    }
+    if(head.ip < 4 || (uint32_t)head.ip > image->size || head.sp < 0 || head.sp > STACK_SIZE ||
+       head.csp > CALL_DEPTH_MAX || head.arena > FRAME_ARENA || head.frame > head.arena ||
+       head.arena - head.frame != head.frame_size || head.heap_size % HEAP_PAGE != 0 ||
+       head.heap_size / HEAP_PAGE > HEAP_MAX_PAGES || head.heap_stored > head.heap_size) {
+        *error = "Snapshot state out of range";
+        return NULL;
+    }
+
+    size_t slots = slot_count(&head) * sizeof(int32_t);
+    if(size != sizeof(head) + slots + head.heap_stored) {
+        *error = "Snapshot size does not match its header";
+        return NULL;
+    }
+
+    nvm_snapshot_t* snap = snapshot_new(image, &head);
+    if(!snap) {
+        *error = "Out of memory";
+        return NULL;
+    }
+    memcpy(snap->slots, data + sizeof(head), slots);
+
+    // RETF and LEAVE trust the call stack and frame links. Verified code
+    // returns through index[] without a check, so a return offset has to
+    // start an instruction.
+    const uint32_t* calls = (const uint32_t*)snap->slots + head.sp + MAX_LOCALS;
+    const uint32_t* index = image->program ? image->program->index : NULL;
+    for(uint32_t i = 0; i < head.csp; i++) {
+        if(calls[i] < 4 || calls[i] >= image->size || (index && index[calls[i]] == NVM_NO_INSN)) {
+            *error = "Snapshot call stack out of range";
+            nvm_snapshot_free(snap);
+            return NULL;
+        }
+    }
+    if(!frames_ok((const int32_t*)(calls + head.csp), head.frame)) {
+        *error = "Snapshot frames out of range";
+        nvm_snapshot_free(snap);
+        return NULL;
+    }
+
+    if(head.heap_size > 0 &&
+       (snap->heap_fd = heap_file(data + sizeof(head) + slots, head.heap_stored, head.heap_size)) < 0) {
+        *error = "Cannot create snapshot memory";
+        nvm_snapshot_free(snap);
+        return NULL;
+    }
+    return snap;
+}
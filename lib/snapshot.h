@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+#include <image.h>
+
+// Frozen state of a process: ip, stack, locals, call stack, frames,
+// capabilities and linear memory, and a reference to its image. Any number
+// of processes can be restored from one snapshot.
+typedef struct nvm_snapshot nvm_snapshot_t;
+
+// Snapshot a process that is not running right now. NULL when out of memory.
+nvm_snapshot_t* nvm_snapshot_take(nvm_process_t* proc);
+
+void nvm_snapshot_free(nvm_snapshot_t* snap);
+
+// Start a new process in the state of the snapshot, not queued anywhere.
+// Its linear memory is copied on write from the snapshot.
+nvm_process_t* nvm_snapshot_restore(const nvm_snapshot_t* snap);
+
+// New process in the state of `proc`, sharing its image
+nvm_process_t* nvm_process_fork(nvm_process_t* proc);
+
+// Serialize a snapshot to a malloc'ed buffer of *size bytes, trailing zero
+// bytes of the linear memory left out
+uint8_t* nvm_snapshot_encode(const nvm_snapshot_t* snap, uint32_t* size);
+
+// Snapshot of `image` from a buffer made by nvm_snapshot_encode. On failure
+// returns NULL and sets *error.
+nvm_snapshot_t* nvm_snapshot_decode(nvm_image_t* image, const uint8_t* data, uint32_t size,
+                                    const char** error);
+
+#endif // SNAPSHOT_H
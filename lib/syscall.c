@@ -1,38 +1,401 @@
 #include <syscall.h>
+#include <message.h>
+#include <scheduler.h>
+#include <console.h>
+#include <caps.h>
+#include <proctab.h>
+#include <heap.h>
+#include <vm.h>
+#include <snapshot.h>
 #include <log.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 
-uint8_t value;
+// Syscall table.
+//
+// Syscalls are dispatched through a table indexed by id. Each entry names
+// the capability it needs and how many values it pops and may push, so the
+// dispatcher checks those once for every handler. A verified program does
+// not start without the capabilities of the syscalls it uses (see verify.c);
+// the check at dispatch is a single AND and catches revoked capabilities.
+//
+// Calls are counted per thread in blocks that are reused once their thread
+// exits, so counting never shares a cache line between workers; timing is
+// off unless nvm_syscall_timing is set.
 
-int32_t syscall_handler(int8_t syscall_id, nvm_process_t* proc) {
-    switch(syscall_id) {
-        case SYSCALL_EXIT:
-            // Exit with code from stack, or 0 if stack is empty
-            if(proc->sp > 0) {
-                proc->exit_code = proc->stack[--proc->sp];
-            } else {
-                proc->exit_code = 0;
-            }
-            proc->active = false;
-            LOG_DEBUG("Process %d: Exited with code %d\n", proc->pid, proc->exit_code);
-            break;
+// Park the process until it is woken and run the syscall again then; it
+// counts as executed once, when it completes
+static void block(nvm_process_t* proc, uint64_t deadline) {
+    proc->blocked = true;
+    proc->wake_deadline = deadline;
+    proc->ip -= 2;
+    proc->retired--;
+}
 
-        case SYSCALL_PRINT: // temporary, will be replace for /dev/console
-            if (proc->sp < 1) {
-                LOG_WARN("Process %d: Stack underflow for print\n", proc->pid);
-                return -1;
-            }
+static void push_message(nvm_process_t* proc, uint32_t from, int32_t value) {
+    proc->stack[proc->sp++] = (int32_t)from;
+    proc->stack[proc->sp++] = value;
+    proc->wakeup_reason = 0;
+    proc->wake_deadline = 0;
+}
 
-            value = proc->stack[proc->sp - 1] & 0xFF;
-            printf("%c", (char)value);
-            proc->sp -= 1;
-            break;
-        default:
-            LOG_WARN("Process %d: Unknown syscall %d\n", proc->pid, syscall_id);
-            proc->exit_code = -1;
-            proc->active = false;
-            return -1;
+// Low byte of each value as one character
+static void print_values(nvm_process_t* proc, const int32_t* values, int32_t count) {
+    char text[STACK_SIZE];
+    for (int32_t i = 0; i < count; i++) {
+        text[i] = (char)(values[i] & 0xFF);
+    }
+    nvm_console_write(proc->console, text, (uint32_t)count);
+}
+
+// Exit with code from stack, or 0 if stack is empty
+static int32_t sys_exit(nvm_process_t* proc) {
+    if(proc->sp > 0) {
+        proc->exit_code = proc->stack[--proc->sp];
+    } else {
+        proc->exit_code = 0;
+    }
+    proc->active = false;
+    LOG_DEBUG("Process %d: Exited with code %d\n", proc->pid, proc->exit_code);
+    return 0;
+}
+
+// temporary, will be replace for /dev/console
+static int32_t sys_print(nvm_process_t* proc) {
+    char value = (char)(proc->stack[proc->sp - 1] & 0xFF);
+    nvm_console_write(proc->console, &value, 1);
+    proc->sp -= 1;
+    return 0;
+}
+
+static int32_t sys_print_stack(nvm_process_t* proc) {
+    int32_t count = proc->stack[proc->sp - 1];
+    if (count < 0 || count > proc->sp - 1) {
+        LOG_WARN("Process %d: Invalid count %d for print\n", proc->pid, count);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
     }
 
+    print_values(proc, &proc->stack[proc->sp - 1 - count], count);
+    proc->sp -= count + 1;
+    return 0;
+}
+
+static int32_t sys_print_locals(nvm_process_t* proc) {
+    int32_t start = proc->stack[proc->sp - 2];
+    int32_t count = proc->stack[proc->sp - 1];
+    if (start < 0 || count < 0 || start > MAX_LOCALS || count > MAX_LOCALS - start) {
+        LOG_WARN("Process %d: Invalid locals range for print\n", proc->pid);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
+    }
+
+    print_values(proc, &proc->locals[start], count);
+    proc->sp -= 2;
+    return 0;
+}
+
+static int32_t sys_send(nvm_process_t* proc) {
+    proc->stack[proc->sp - 2] = nvm_send(proc->pid, (uint32_t)proc->stack[proc->sp - 2],
+                                         proc->stack[proc->sp - 1]);
+    proc->sp -= 1;
     return 0;
 }
+
+static int32_t sys_receive(nvm_process_t* proc) {
+    uint32_t from;
+    int32_t message;
+    if (nvm_mailbox_receive(proc->mailbox, &from, &message)) {
+        push_message(proc, from, message);
+    } else {
+        block(proc, 0);
+    }
+    return 0;
+}
+
+static int32_t sys_try_receive(nvm_process_t* proc) {
+    uint32_t from;
+    int32_t message;
+    if (nvm_mailbox_receive(proc->mailbox, &from, &message)) {
+        push_message(proc, from, message);
+        proc->stack[proc->sp++] = 1;
+    } else {
+        proc->stack[proc->sp++] = 0;
+    }
+    return 0;
+}
+
+static int32_t sys_receive_timeout(nvm_process_t* proc) {
+    // The timeout stays on the stack while blocked so the retry sees it
+    int32_t timeout = proc->stack[proc->sp - 1];
+    uint32_t from;
+    int32_t message;
+    if (nvm_mailbox_receive(proc->mailbox, &from, &message)) {
+        proc->sp -= 1;
+        push_message(proc, from, message);
+        proc->stack[proc->sp++] = 1;
+    } else if (timeout <= 0 || proc->wakeup_reason == WAKE_TIMEOUT) {
+        proc->stack[proc->sp - 1] = 0;
+        proc->wakeup_reason = 0;
+        proc->wake_deadline = 0;
+    } else {
+        uint64_t deadline = proc->wake_deadline;
+        if (deadline == 0) {
+            deadline = nvm_now_ns() + (uint64_t)timeout * 1000000ull;
+        }
+        block(proc, deadline);
+    }
+    return 0;
+}
+
+// Both take `pid cap` and leave a CAPS_* status. A process can only grant
+// what it holds itself.
+static int32_t sys_grant(nvm_process_t* proc) {
+    nvm_process_t* target = nvm_proctab_get((uint32_t)proc->stack[proc->sp - 2]);
+    nvm_caps_t bit = CAPS_BIT((uint16_t)proc->stack[proc->sp - 1]);
+    int32_t status = CAPS_OK;
+
+    if(!target || !target->active) {
+        status = CAPS_NO_PROC;
+    } else if((atomic_load_explicit(&proc->caps, memory_order_relaxed) & bit) != bit) {
+        status = CAPS_NOT_HELD;
+    } else {
+        atomic_fetch_or_explicit(&target->caps, bit, memory_order_relaxed);
+    }
+
+    proc->stack[proc->sp - 2] = status;
+    proc->sp -= 1;
+    return 0;
+}
+
+static int32_t sys_revoke(nvm_process_t* proc) {
+    nvm_process_t* target = nvm_proctab_get((uint32_t)proc->stack[proc->sp - 2]);
+    nvm_caps_t bit = CAPS_BIT((uint16_t)proc->stack[proc->sp - 1]);
+    int32_t status = CAPS_OK;
+
+    if(!target || !target->active) {
+        status = CAPS_NO_PROC;
+    } else {
+        atomic_fetch_and_explicit(&target->caps, ~bit, memory_order_relaxed);
+    }
+
+    proc->stack[proc->sp - 2] = status;
+    proc->sp -= 1;
+    return 0;
+}
+
+// The child starts right after the syscall, in the parent's VM if it has
+// one and on the scheduler otherwise
+static int32_t sys_fork(nvm_process_t* proc) {
+    nvm_process_t* child = nvm_process_fork(proc);
+    if(!child) {
+        proc->stack[proc->sp++] = -2;
+        return 0;
+    }
+
+    child->stack[child->sp++] = -1;
+    if(proc->vm) {
+        if(!nvm_vm_adopt(proc->vm, child)) {
+            proc->stack[proc->sp++] = -2;
+            return 0;
+        }
+    } else {
+        nvm_scheduler_enqueue(child->pid);
+    }
+    proc->stack[proc->sp++] = (int32_t)child->pid;
+    return 0;
+}
+
+// Low 32 bits of the monotonic clock in milliseconds; only differences mean
+// anything
+static int32_t sys_time(nvm_process_t* proc) {
+    proc->stack[proc->sp++] = (int32_t)(uint32_t)(nvm_now_ns() / 1000000ull);
+    return 0;
+}
+
+// xorshift64*, one generator per worker thread
+static _Thread_local uint64_t random_state = 0;
+
+static int32_t sys_random(nvm_process_t* proc) {
+    uint64_t x = random_state;
+    if(x == 0) {
+        x = (nvm_now_ns() ^ (uint64_t)(uintptr_t)&random_state) | 1;
+    }
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    random_state = x;
+    proc->stack[proc->sp++] = (int32_t)((x * 0x2545F4914F6CDD1Dull) >> 32);
+    return 0;
+}
+
+static int32_t sys_mem_grow(nvm_process_t* proc) {
+    int32_t pages = proc->stack[proc->sp - 1];
+    proc->stack[proc->sp - 1] = nvm_heap_grow(proc, pages);
+    return 0;
+}
+
+static int32_t sys_mem_size(nvm_process_t* proc) {
+    proc->stack[proc->sp++] = (int32_t)(proc->heap_size / HEAP_PAGE);
+    return 0;
+}
+
+#define SYSCALL(fn, name, cap, pop, push) { fn, name, cap, CAPS_BIT(cap), pop, push }
+
+nvm_syscall_t nvm_syscalls[SYSCALL_COUNT] = {
+    [SYSCALL_EXIT]            = SYSCALL(sys_exit,            "exit",            CAPS_NONE,     0, 0),
+    [SYSCALL_PRINT]           = SYSCALL(sys_print,           "print",           CAPS_NONE,     1, 0),
+    [SYSCALL_PRINT_STACK]     = SYSCALL(sys_print_stack,     "print_stack",     CAPS_NONE,     1, 0),
+    [SYSCALL_PRINT_LOCALS]    = SYSCALL(sys_print_locals,    "print_locals",    CAPS_NONE,     2, 0),
+    [SYSCALL_SEND]            = SYSCALL(sys_send,            "send",            CAPS_NONE,     2, 1),
+    [SYSCALL_RECEIVE]         = SYSCALL(sys_receive,         "receive",         CAPS_NONE,     0, 2),
+    [SYSCALL_TRY_RECEIVE]     = SYSCALL(sys_try_receive,     "try_receive",     CAPS_NONE,     0, 3),
+    [SYSCALL_RECEIVE_TIMEOUT] = SYSCALL(sys_receive_timeout, "receive_timeout", CAPS_NONE,     1, 3),
+    [SYSCALL_GRANT]           = SYSCALL(sys_grant,           "grant",           CAP_CAPS_MGMT, 2, 1),
+    [SYSCALL_REVOKE]          = SYSCALL(sys_revoke,          "revoke",          CAP_CAPS_MGMT, 2, 1),
+    [SYSCALL_FORK]            = SYSCALL(sys_fork,            "fork",            CAP_PROC_MGMT, 0, 1),
+    [SYSCALL_TIME]            = SYSCALL(sys_time,            "time",            CAPS_NONE,     0, 1),
+    [SYSCALL_RANDOM]          = SYSCALL(sys_random,          "random",          CAPS_NONE,     0, 1),
+    [SYSCALL_MEM_GROW]        = SYSCALL(sys_mem_grow,        "mem_grow",        CAP_MEM_MGMT,  1, 1),
+    [SYSCALL_MEM_SIZE]        = SYSCALL(sys_mem_size,        "mem_size",        CAPS_NONE,     0, 1),
+};
+
+bool nvm_syscall_timing = false;
+
+typedef struct syscall_stats {
+    _Alignas(64) uint64_t calls[SYSCALL_COUNT];
+    uint64_t ns[SYSCALL_COUNT];
+    _Atomic bool owned;                     // A live thread counts here
+    struct syscall_stats* next;
+} syscall_stats_t;
+
+static _Atomic(syscall_stats_t*) all_stats = NULL;
+static _Thread_local syscall_stats_t* own_stats = NULL;
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static void stats_disown(void* stats) {
+    atomic_store(&((syscall_stats_t*)stats)->owned, false);
+}
+
+static void stats_key_create() {
+    pthread_key_create(&stats_key, stats_disown);
+}
+
+static syscall_stats_t* stats_get() {
+    for(syscall_stats_t* stats = atomic_load(&all_stats); stats; stats = stats->next) {
+        bool owned = false;
+        if(atomic_compare_exchange_strong(&stats->owned, &owned, true)) {
+            own_stats = stats;
+            break;
+        }
+    }
+
+    if(!own_stats) {
+        syscall_stats_t* stats = aligned_alloc(64, sizeof(syscall_stats_t));
+        if(!stats) {
+            return NULL;
+        }
+        for(int i = 0; i < SYSCALL_COUNT; i++) {
+            stats->calls[i] = stats->ns[i] = 0;
+        }
+        atomic_init(&stats->owned, true);
+        stats->next = atomic_load(&all_stats);
+        while(!atomic_compare_exchange_weak(&all_stats, &stats->next, stats)) {
+        }
+        own_stats = stats;
+    }
+
+    pthread_once(&stats_once, stats_key_create);
+    pthread_setspecific(stats_key, own_stats);
+    return own_stats;
+}
+
+// Any pop or push count fits the stack, so only the dispatcher checks them
+_Static_assert(UINT8_MAX <= STACK_SIZE, "syscall stack counts must fit the stack");
+
+bool nvm_syscall_register(uint8_t id, const char* name, nvm_syscall_fn_t handler,
+                          uint16_t capability, uint8_t pop, uint8_t push) {
+    if(!handler || !name) {
+        return false;
+    }
+
+    nvm_syscalls[id] = (nvm_syscall_t)SYSCALL(handler, name, capability, pop, push);
+    return true;
+}
+
+void nvm_syscall_dump() {
+    for(int i = 0; i < SYSCALL_COUNT; i++) {
+        uint64_t calls = 0, ns = 0;
+        for(syscall_stats_t* stats = atomic_load(&all_stats); stats; stats = stats->next) {
+            calls += stats->calls[i];
+            ns += stats->ns[i];
+        }
+        if(calls == 0) {
+            continue;
+        }
+
+        const char* name = nvm_syscalls[i].name ? nvm_syscalls[i].name : "unknown";
+        if(nvm_syscall_timing) {
+            LOG_INFO("Syscall 0x%x %s: %u calls, %u us, %u ns per call\n", i, name,
+                     (uint32_t)calls, (uint32_t)(ns / 1000), (uint32_t)(ns / calls));
+        } else {
+            LOG_INFO("Syscall 0x%x %s: %u calls\n", i, name, (uint32_t)calls);
+        }
+    }
+}
+
+int32_t syscall_handler(int8_t syscall_id, nvm_process_t* proc) {
+    uint8_t id = (uint8_t)syscall_id;
+    const nvm_syscall_t* sys = &nvm_syscalls[id];
+
+    syscall_stats_t* stats = own_stats ? own_stats : stats_get();
+    if(stats) {
+        stats->calls[id]++;
+    }
+
+    // Host calls of an embedding VM come before the built-in syscalls
+    int32_t result;
+    if(proc->vm && nvm_vm_dispatch(proc, id, &result)) {
+        return result;
+    }
+
+    if(!sys->handler) {
+        LOG_WARN("Process %d: Unknown syscall %d\n", proc->pid, syscall_id);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
+    }
+
+    if((atomic_load_explicit(&proc->caps, memory_order_relaxed) & sys->caps) != sys->caps) {
+        LOG_WARN("Process %d: Required caps not received for %s\n", proc->pid, sys->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
+    }
+
+    if(proc->sp < sys->pop) {
+        LOG_WARN("Process %d: Stack underflow for %s\n", proc->pid, sys->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
+    }
+    if(proc->sp - sys->pop > STACK_SIZE - sys->push) {
+        LOG_WARN("Process %d: Stack overflow for %s\n", proc->pid, sys->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return -1;
+    }
+
+    if(!nvm_syscall_timing || !stats) {
+        return sys->handler(proc);
+    }
+
+    uint64_t start = nvm_now_ns();
+    result = sys->handler(proc);
+    stats->ns[id] += nvm_now_ns() - start;
+    return result;
+}
@@ -7,8 +7,63 @@
 
 #define SYSCALL_EXIT        0x00
 #define SYSCALL_PRINT       0x0E
+#define SYSCALL_PRINT_STACK 0x0F    // c1 .. cn n -> prints n characters, c1 first
+#define SYSCALL_PRINT_LOCALS 0x10   // start n -> prints locals start .. start+n-1
+
+// Message passing
+#define SYSCALL_SEND            0x20    // pid value -> status
+#define SYSCALL_RECEIVE         0x21    // -> sender value, blocks until a message arrives
+#define SYSCALL_TRY_RECEIVE     0x22    // -> sender value 1 | 0
+#define SYSCALL_RECEIVE_TIMEOUT 0x23    // ms -> sender value 1 | 0 after ms without a message
+
+// Capabilities, both need CAP_CAPS_MGMT
+#define SYSCALL_GRANT           0x28    // pid cap -> status, gives pid a capability the caller holds
+#define SYSCALL_REVOKE          0x29    // pid cap -> status
+
+// Processes, needs CAP_PROC_MGMT
+#define SYSCALL_FORK            0x2C    // -> child pid in the parent, -1 in the child, -2 on failure
+
+// Host services
+#define SYSCALL_TIME            0x30    // -> milliseconds since the VM started
+#define SYSCALL_RANDOM          0x31    // -> pseudo-random value
+
+// Linear memory, see heap.h
+#define SYSCALL_MEM_GROW        0x38    // pages -> previous pages | -1, needs CAP_MEM_MGMT
+#define SYSCALL_MEM_SIZE        0x39    // -> pages
+
+#define SYSCALL_COUNT 256
+
+// Handler for one syscall. Returns 0, or -1 after reporting an error and
+// stopping the process with exit code -1; every core stops running a
+// process once a syscall has cleared proc->active.
+typedef int32_t (*nvm_syscall_fn_t)(nvm_process_t* proc);
+
+typedef struct {
+    nvm_syscall_fn_t handler;   // NULL for an unknown syscall
+    const char* name;
+    uint16_t capability;        // Needed to call it, CAPS_NONE for none
+    nvm_caps_t caps;            // CAPS_BIT(capability)
+    uint8_t pop;                // Values that must be on the stack
+    uint8_t push;               // Most values left above those
+} nvm_syscall_t;
+
+extern nvm_syscall_t nvm_syscalls[SYSCALL_COUNT];
+
+// Time every syscall as well as counting it, see nvm_syscall_dump
+extern bool nvm_syscall_timing;
+
+// Install or replace a syscall. The dispatcher checks the capability and
+// the stack against pop and push before calling the handler. Only call
+// this before any image is loaded, verified programs resolve the
+// capabilities of their syscalls once.
+bool nvm_syscall_register(uint8_t id, const char* name, nvm_syscall_fn_t handler,
+                          uint16_t capability, uint8_t pop, uint8_t push);
+
+// Log call counts, and times when timing is on, of every syscall used so
+// far. Only call this while no process runs.
+void nvm_syscall_dump();
 
 // System call handler
 int32_t syscall_handler(int8_t syscall_id, nvm_process_t* proc);
 
-#endif // SYSCALL_H
\ No newline at end of file
+#endif // SYSCALL_H
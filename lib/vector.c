@@ -0,0 +1,561 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <nvm.h>
+#include <heap.h>
+#include <vector.h>
+
+#if NVM_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef NVM_CHECK_VECTOR
+#include <stdio.h>
+#endif
+
+// Vector operations.
+//
+// The 0x6X opcodes work on arrays of little-endian int32 in linear memory,
+// given as a byte address and an element count: element-wise add, sub,
+// mul, min and max into a destination array, sum/min/max reductions, a dot
+// product and counting the elements equal to, greater or less than a value.
+// Arithmetic wraps like ADD/SUB/MUL do. One opcode replaces a loop of
+// several interpreted instructions per element.
+//
+// Each operation has a scalar kernel and, on x86-64, SSE2 and AVX2 ones.
+// The best set the CPU supports is picked on first use (or by --simd).
+// Addresses need no alignment, all kernels use unaligned loads. Wrapping
+// sums do not depend on the order elements are added in, so the wide
+// kernels give the same results as the scalar ones. A destination that
+// partially overlaps an operand goes to the scalar kernel, which works
+// front to back like the equivalent loop; an exact overlap (dst = a) is
+// fine for every kernel.
+//
+// Build with -DNVM_CHECK_VECTOR to rerun every operation with the scalar
+// kernels on copies of the operands and abort on a different result.
+
+typedef void (*vec_map_t)(uint8_t* dst, const uint8_t* a, const uint8_t* b, uint32_t n);
+typedef int32_t (*vec_reduce_t)(const uint8_t* a, uint32_t n);
+typedef int32_t (*vec_dot_t)(const uint8_t* a, const uint8_t* b, uint32_t n);
+typedef int32_t (*vec_count_t)(const uint8_t* a, uint32_t n, int32_t k);
+
+typedef struct {
+    const char* name;
+    vec_map_t add, sub, mul, min, max;
+    vec_reduce_t sum, rmin, rmax;
+    vec_dot_t dot;
+    vec_count_t count_eq, count_gt, count_lt;
+} vec_kernels_t;
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void store_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Scalar kernels, also used for the tails the wide ones leave
+
+#define SCALAR_MAP(name, expr)                                                      \
+    static void scalar_##name(uint8_t* dst, const uint8_t* pa, const uint8_t* pb,   \
+                              uint32_t n) {                                         \
+        for(uint32_t i = 0; i < n; i++) {                                           \
+            uint32_t a = load_le32(pa + 4 * i), b = load_le32(pb + 4 * i);          \
+            store_le32(dst + 4 * i, (expr));                                        \
+        }                                                                           \
+    }
+
+SCALAR_MAP(add, a + b)
+SCALAR_MAP(sub, a - b)
+SCALAR_MAP(mul, a * b)
+SCALAR_MAP(min, (int32_t)a < (int32_t)b ? a : b)
+SCALAR_MAP(max, (int32_t)a > (int32_t)b ? a : b)
+
+static int32_t scalar_sum(const uint8_t* a, uint32_t n) {
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < n; i++) {
+        sum += load_le32(a + 4 * i);
+    }
+    return (int32_t)sum;
+}
+
+static int32_t scalar_rmin(const uint8_t* a, uint32_t n) {
+    int32_t min = INT32_MAX;
+    for(uint32_t i = 0; i < n; i++) {
+        int32_t v = (int32_t)load_le32(a + 4 * i);
+        if(v < min) min = v;
+    }
+    return min;
+}
+
+static int32_t scalar_rmax(const uint8_t* a, uint32_t n) {
+    int32_t max = INT32_MIN;
+    for(uint32_t i = 0; i < n; i++) {
+        int32_t v = (int32_t)load_le32(a + 4 * i);
+        if(v > max) max = v;
+    }
+    return max;
+}
+
+static int32_t scalar_dot(const uint8_t* a, const uint8_t* b, uint32_t n) {
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < n; i++) {
+        sum += load_le32(a + 4 * i) * load_le32(b + 4 * i);
+    }
+    return (int32_t)sum;
+}
+
+#define SCALAR_COUNT(name, cmp)                                                     \
+    static int32_t scalar_##name(const uint8_t* a, uint32_t n, int32_t k) {         \
+        int32_t count = 0;                                                          \
+        for(uint32_t i = 0; i < n; i++) {                                           \
+            count += (int32_t)load_le32(a + 4 * i) cmp k;                           \
+        }                                                                           \
+        return count;                                                               \
+    }
+
+SCALAR_COUNT(count_eq, ==)
+SCALAR_COUNT(count_gt, >)
+SCALAR_COUNT(count_lt, <)
+
+static const vec_kernels_t scalar_kernels = {
+    "scalar",
+    scalar_add, scalar_sub, scalar_mul, scalar_min, scalar_max,
+    scalar_sum, scalar_rmin, scalar_rmax,
+    scalar_dot,
+    scalar_count_eq, scalar_count_gt, scalar_count_lt,
+};
+
+#if NVM_SIMD
+
+// SSE2 kernels, 4 elements at a time. SSE2 is part of x86-64, but has no
+// 32-bit multiply or signed min/max, so those are built from other ops.
+
+static inline __m128i sse2_mul(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i sse2_min(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static inline __m128i sse2_max(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+static inline uint32_t sse2_hsum(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+static inline int32_t sse2_hmin(__m128i v) {
+    v = sse2_min(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = sse2_min(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline int32_t sse2_hmax(__m128i v) {
+    v = sse2_max(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = sse2_max(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+#define LOAD128(p) _mm_loadu_si128((const __m128i*)(p))
+
+#define SSE2_MAP(name, expr)                                                        \
+    static void sse2_##name##_map(uint8_t* dst, const uint8_t* pa, const uint8_t* pb, \
+                                  uint32_t n) {                                     \
+        uint32_t i = 0;                                                             \
+        for(; n - i >= 4; i += 4) {                                                 \
+            __m128i a = LOAD128(pa + 4 * i), b = LOAD128(pb + 4 * i);               \
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), (expr));                      \
+        }                                                                           \
+        scalar_##name(dst + 4 * i, pa + 4 * i, pb + 4 * i, n - i);                  \
+    }
+
+SSE2_MAP(add, _mm_add_epi32(a, b))
+SSE2_MAP(sub, _mm_sub_epi32(a, b))
+SSE2_MAP(mul, sse2_mul(a, b))
+SSE2_MAP(min, sse2_min(a, b))
+SSE2_MAP(max, sse2_max(a, b))
+
+static int32_t sse2_sum(const uint8_t* a, uint32_t n) {
+    __m128i acc = _mm_setzero_si128();
+    uint32_t i = 0;
+    for(; n - i >= 4; i += 4) {
+        acc = _mm_add_epi32(acc, LOAD128(a + 4 * i));
+    }
+    return (int32_t)(sse2_hsum(acc) + (uint32_t)scalar_sum(a + 4 * i, n - i));
+}
+
+static int32_t sse2_rmin(const uint8_t* a, uint32_t n) {
+    __m128i acc = _mm_set1_epi32(INT32_MAX);
+    uint32_t i = 0;
+    for(; n - i >= 4; i += 4) {
+        acc = sse2_min(acc, LOAD128(a + 4 * i));
+    }
+    int32_t min = sse2_hmin(acc), tail = scalar_rmin(a + 4 * i, n - i);
+    return tail < min ? tail : min;
+}
+
+static int32_t sse2_rmax(const uint8_t* a, uint32_t n) {
+    __m128i acc = _mm_set1_epi32(INT32_MIN);
+    uint32_t i = 0;
+    for(; n - i >= 4; i += 4) {
+        acc = sse2_max(acc, LOAD128(a + 4 * i));
+    }
+    int32_t max = sse2_hmax(acc), tail = scalar_rmax(a + 4 * i, n - i);
+    return tail > max ? tail : max;
+}
+
+static int32_t sse2_dot(const uint8_t* a, const uint8_t* b, uint32_t n) {
+    __m128i acc = _mm_setzero_si128();
+    uint32_t i = 0;
+    for(; n - i >= 4; i += 4) {
+        acc = _mm_add_epi32(acc, sse2_mul(LOAD128(a + 4 * i), LOAD128(b + 4 * i)));
+    }
+    return (int32_t)(sse2_hsum(acc) + (uint32_t)scalar_dot(a + 4 * i, b + 4 * i, n - i));
+}
+
+// A true comparison is -1 in every lane, so subtracting it counts
+#define SSE2_COUNT(name, cmp)                                                       \
+    static int32_t sse2_##name(const uint8_t* a, uint32_t n, int32_t k) {          \
+        __m128i acc = _mm_setzero_si128(), key = _mm_set1_epi32(k);                 \
+        uint32_t i = 0;                                                             \
+        for(; n - i >= 4; i += 4) {                                                 \
+            acc = _mm_sub_epi32(acc, cmp(LOAD128(a + 4 * i), key));                 \
+        }                                                                           \
+        return (int32_t)sse2_hsum(acc) + scalar_##name(a + 4 * i, n - i, k);        \
+    }
+
+SSE2_COUNT(count_eq, _mm_cmpeq_epi32)
+SSE2_COUNT(count_gt, _mm_cmpgt_epi32)
+SSE2_COUNT(count_lt, _mm_cmplt_epi32)
+
+static const vec_kernels_t sse2_kernels = {
+    "sse2",
+    sse2_add_map, sse2_sub_map, sse2_mul_map, sse2_min_map, sse2_max_map,
+    sse2_sum, sse2_rmin, sse2_rmax,
+    sse2_dot,
+    sse2_count_eq, sse2_count_gt, sse2_count_lt,
+};
+
+// AVX2 kernels, 8 elements at a time. Only called once the CPU is known
+// to have AVX2, the rest of the VM is built for plain x86-64.
+
+#define AVX2 __attribute__((target("avx2")))
+#define LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+
+#define AVX2_MAP(name, expr)                                                        \
+    static AVX2 void avx2_##name##_map(uint8_t* dst, const uint8_t* pa,            \
+                                       const uint8_t* pb, uint32_t n) {             \
+        uint32_t i = 0;                                                             \
+        for(; n - i >= 8; i += 8) {                                                 \
+            __m256i a = LOAD256(pa + 4 * i), b = LOAD256(pb + 4 * i);               \
+            _mm256_storeu_si256((__m256i*)(dst + 4 * i), (expr));                   \
+        }                                                                           \
+        scalar_##name(dst + 4 * i, pa + 4 * i, pb + 4 * i, n - i);                  \
+    }
+
+AVX2_MAP(add, _mm256_add_epi32(a, b))
+AVX2_MAP(sub, _mm256_sub_epi32(a, b))
+AVX2_MAP(mul, _mm256_mullo_epi32(a, b))
+AVX2_MAP(min, _mm256_min_epi32(a, b))
+AVX2_MAP(max, _mm256_max_epi32(a, b))
+
+// Halves of a 256-bit accumulator, folded for the SSE2 horizontal ops
+#define AVX2_LOW(v)  _mm256_castsi256_si128(v)
+#define AVX2_HIGH(v) _mm256_extracti128_si256((v), 1)
+
+static AVX2 int32_t avx2_sum(const uint8_t* a, uint32_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for(; n - i >= 8; i += 8) {
+        acc = _mm256_add_epi32(acc, LOAD256(a + 4 * i));
+    }
+    uint32_t sum = sse2_hsum(_mm_add_epi32(AVX2_LOW(acc), AVX2_HIGH(acc)));
+    return (int32_t)(sum + (uint32_t)scalar_sum(a + 4 * i, n - i));
+}
+
+static AVX2 int32_t avx2_rmin(const uint8_t* a, uint32_t n) {
+    __m256i acc = _mm256_set1_epi32(INT32_MAX);
+    uint32_t i = 0;
+    for(; n - i >= 8; i += 8) {
+        acc = _mm256_min_epi32(acc, LOAD256(a + 4 * i));
+    }
+    int32_t min = sse2_hmin(_mm_min_epi32(AVX2_LOW(acc), AVX2_HIGH(acc)));
+    int32_t tail = scalar_rmin(a + 4 * i, n - i);
+    return tail < min ? tail : min;
+}
+
+static AVX2 int32_t avx2_rmax(const uint8_t* a, uint32_t n) {
+    __m256i acc = _mm256_set1_epi32(INT32_MIN);
+    uint32_t i = 0;
+    for(; n - i >= 8; i += 8) {
+        acc = _mm256_max_epi32(acc, LOAD256(a + 4 * i));
+    }
+    int32_t max = sse2_hmax(_mm_max_epi32(AVX2_LOW(acc), AVX2_HIGH(acc)));
+    int32_t tail = scalar_rmax(a + 4 * i, n - i);
+    return tail > max ? tail : max;
+}
+
+static AVX2 int32_t avx2_dot(const uint8_t* a, const uint8_t* b, uint32_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for(; n - i >= 8; i += 8) {
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(LOAD256(a + 4 * i), LOAD256(b + 4 * i)));
+    }
+    uint32_t sum = sse2_hsum(_mm_add_epi32(AVX2_LOW(acc), AVX2_HIGH(acc)));
+    return (int32_t)(sum + (uint32_t)scalar_dot(a + 4 * i, b + 4 * i, n - i));
+}
+
+static AVX2 inline __m256i avx2_cmplt(__m256i a, __m256i b) {
+    return _mm256_cmpgt_epi32(b, a);
+}
+
+#define AVX2_COUNT(name, cmp)                                                       \
+    static AVX2 int32_t avx2_##name(const uint8_t* a, uint32_t n, int32_t k) {     \
+        __m256i acc = _mm256_setzero_si256(), key = _mm256_set1_epi32(k);           \
+        uint32_t i = 0;                                                             \
+        for(; n - i >= 8; i += 8) {                                                 \
+            acc = _mm256_sub_epi32(acc, cmp(LOAD256(a + 4 * i), key));              \
+        }                                                                           \
+        uint32_t count = sse2_hsum(_mm_add_epi32(AVX2_LOW(acc), AVX2_HIGH(acc)));   \
+        return (int32_t)count + scalar_##name(a + 4 * i, n - i, k);                 \
+    }
+
+AVX2_COUNT(count_eq, _mm256_cmpeq_epi32)
+AVX2_COUNT(count_gt, _mm256_cmpgt_epi32)
+AVX2_COUNT(count_lt, avx2_cmplt)
+
+static const vec_kernels_t avx2_kernels = {
+    "avx2",
+    avx2_add_map, avx2_sub_map, avx2_mul_map, avx2_min_map, avx2_max_map,
+    avx2_sum, avx2_rmin, avx2_rmax,
+    avx2_dot,
+    avx2_count_eq, avx2_count_gt, avx2_count_lt,
+};
+
+#endif // NVM_SIMD
+
+// Set before any process runs (nvm_vector_select) or by the first vector
+// opcode; racing first uses all store the same pointer.
+static const vec_kernels_t* _Atomic kernels;
+
+static const vec_kernels_t* best_kernels() {
+#if NVM_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    return &sse2_kernels;
+#else
+    return &scalar_kernels;
+#endif
+}
+
+static inline const vec_kernels_t* current_kernels() {
+    const vec_kernels_t* k = atomic_load_explicit(&kernels, memory_order_relaxed);
+    if(!k) {
+        k = best_kernels();
+        atomic_store_explicit(&kernels, k, memory_order_relaxed);
+    }
+    return k;
+}
+
+bool nvm_vector_select(const char* name) {
+    const vec_kernels_t* k = NULL;
+
+    if(strcmp(name, "auto") == 0) {
+        k = best_kernels();
+    } else if(strcmp(name, "scalar") == 0) {
+        k = &scalar_kernels;
+    }
+#if NVM_SIMD
+    else if(strcmp(name, "sse2") == 0) {
+        k = &sse2_kernels;
+    } else if(strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            k = &avx2_kernels;
+        }
+    }
+#endif
+
+    if(!k) {
+        return false;
+    }
+    atomic_store_explicit(&kernels, k, memory_order_relaxed);
+    return true;
+}
+
+const char* nvm_vector_kernels() {
+    return current_kernels()->name;
+}
+
+uint8_t nvm_vector_pop(uint8_t op) {
+    switch(op) {
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VMIN: case OP_VMAX:
+            return 4;
+        case OP_VSUM: case OP_VRMIN: case OP_VRMAX:
+            return 2;
+        case OP_VDOT: case OP_VCOUNTEQ: case OP_VCOUNTGT: case OP_VCOUNTLT:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// `n` int32 elements from `addr` lie inside the linear memory
+static inline bool vector_ok(nvm_process_t* proc, uint32_t addr, uint32_t n) {
+    return n <= proc->heap_size / 4 && nvm_heap_ok(proc, addr, n * 4);
+}
+
+static inline bool partial_overlap(uint32_t dst, uint32_t src, uint32_t bytes) {
+    return dst != src && dst < (uint64_t)src + bytes && src < (uint64_t)dst + bytes;
+}
+
+static vec_map_t map_kernel(const vec_kernels_t* k, uint8_t op) {
+    switch(op) {
+        case OP_VADD: return k->add;
+        case OP_VSUB: return k->sub;
+        case OP_VMUL: return k->mul;
+        case OP_VMIN: return k->min;
+        default:      return k->max;
+    }
+}
+
+#ifdef NVM_CHECK_VECTOR
+// Result of a reduction, dot product or count on the scalar kernels
+static int32_t scalar_result(uint8_t op, const uint8_t* a, const uint8_t* b, uint32_t n, int32_t k) {
+    switch(op) {
+        case OP_VSUM:     return scalar_sum(a, n);
+        case OP_VRMIN:    return scalar_rmin(a, n);
+        case OP_VRMAX:    return scalar_rmax(a, n);
+        case OP_VDOT:     return scalar_dot(a, b, n);
+        case OP_VCOUNTEQ: return scalar_count_eq(a, n, k);
+        case OP_VCOUNTGT: return scalar_count_gt(a, n, k);
+        default:          return scalar_count_lt(a, n, k);
+    }
+}
+
+// Partial overlaps always run on the scalar kernels, whose results depend
+// on the order elements are written in; copies cannot reproduce them.
+static void check_map(const vec_kernels_t* k, uint8_t op, uint8_t* dst, const uint8_t* a,
+                      const uint8_t* b, uint32_t n) {
+    size_t bytes = (size_t)n * 4;
+    uint8_t* copy = k != &scalar_kernels ? malloc(bytes * 3 + 1) : NULL;
+    if(!copy) {
+        map_kernel(k, op)(dst, a, b, n);
+        return;
+    }
+    memcpy(copy + bytes, a, bytes);
+    memcpy(copy + bytes * 2, b, bytes);
+    map_kernel(&scalar_kernels, op)(copy, copy + bytes, copy + bytes * 2, n);
+    map_kernel(k, op)(dst, a, b, n);
+    if(memcmp(copy, dst, bytes) != 0) {
+        fprintf(stderr, "NVM_CHECK_VECTOR: %s kernel for opcode 0x%02X differs from scalar (n=%u)\n",
+                k->name, op, n);
+        abort();
+    }
+    free(copy);
+}
+#endif
+
+bool nvm_vector_exec(nvm_process_t* proc, uint8_t op) {
+    const vec_kernels_t* k = current_kernels();
+    int32_t* top = &proc->stack[proc->sp];
+    uint8_t* heap = proc->heap;
+    int32_t result;
+
+    switch(op) {
+        case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VMIN: case OP_VMAX: {
+            uint32_t dst = (uint32_t)top[-4], a = (uint32_t)top[-3], b = (uint32_t)top[-2];
+            uint32_t n = (uint32_t)top[-1];
+            if(!vector_ok(proc, dst, n) || !vector_ok(proc, a, n) || !vector_ok(proc, b, n)) {
+                return false;
+            }
+            if(partial_overlap(dst, a, n * 4) || partial_overlap(dst, b, n * 4)) {
+                k = &scalar_kernels;
+            }
+#ifdef NVM_CHECK_VECTOR
+            check_map(k, op, heap + dst, heap + a, heap + b, n);
+#else
+            map_kernel(k, op)(heap + dst, heap + a, heap + b, n);
+#endif
+            proc->sp -= 4;
+            return true;
+        }
+
+        case OP_VSUM: case OP_VRMIN: case OP_VRMAX: {
+            uint32_t a = (uint32_t)top[-2], n = (uint32_t)top[-1];
+            if(!vector_ok(proc, a, n)) {
+                return false;
+            }
+            result = op == OP_VSUM ? k->sum(heap + a, n)
+                   : op == OP_VRMIN ? k->rmin(heap + a, n)
+                   : k->rmax(heap + a, n);
+#ifdef NVM_CHECK_VECTOR
+            if(result != scalar_result(op, heap + a, NULL, n, 0)) goto mismatch;
+#endif
+            proc->sp -= 1;
+            break;
+        }
+
+        case OP_VDOT: {
+            uint32_t a = (uint32_t)top[-3], b = (uint32_t)top[-2], n = (uint32_t)top[-1];
+            if(!vector_ok(proc, a, n) || !vector_ok(proc, b, n)) {
+                return false;
+            }
+            result = k->dot(heap + a, heap + b, n);
+#ifdef NVM_CHECK_VECTOR
+            if(result != scalar_result(op, heap + a, heap + b, n, 0)) goto mismatch;
+#endif
+            proc->sp -= 2;
+            break;
+        }
+
+        case OP_VCOUNTEQ: case OP_VCOUNTGT: case OP_VCOUNTLT: {
+            uint32_t a = (uint32_t)top[-3], n = (uint32_t)top[-2];
+            int32_t key = top[-1];
+            if(!vector_ok(proc, a, n)) {
+                return false;
+            }
+            result = op == OP_VCOUNTEQ ? k->count_eq(heap + a, n, key)
+                   : op == OP_VCOUNTGT ? k->count_gt(heap + a, n, key)
+                   : k->count_lt(heap + a, n, key);
+#ifdef NVM_CHECK_VECTOR
+            if(result != scalar_result(op, heap + a, NULL, n, key)) goto mismatch;
+#endif
+            proc->sp -= 2;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    proc->stack[proc->sp - 1] = result;
+    return true;
+
+#ifdef NVM_CHECK_VECTOR
+mismatch:
+    fprintf(stderr, "NVM_CHECK_VECTOR: %s kernel for opcode 0x%02X differs from scalar\n",
+            k->name, op);
+    abort();
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// SIMD kernels for the vector opcodes, override with -DNVM_SIMD=0 in CFLAGS
+// to build only the scalar ones
+#ifndef NVM_SIMD
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NVM_SIMD 1
+#else
+#define NVM_SIMD 0
+#endif
+#endif
+
+// Values vector opcode `op` takes from the stack, 0 for any other opcode
+uint8_t nvm_vector_pop(uint8_t op);
+
+// Use the kernels called `name` ("avx2", "sse2" or "scalar"), or the best
+// the CPU supports for "auto". False if they are unknown or the CPU lacks
+// them. Only call this while no process runs.
+bool nvm_vector_select(const char* name);
+
+// Name of the kernels in use
+const char* nvm_vector_kernels();
+
+// Execute vector opcode `op` on the top of the stack, which must hold its
+// operands. Returns false and leaves the process untouched when an array
+// does not lie inside the linear memory.
+bool nvm_vector_exec(nvm_process_t* proc, uint8_t op);
+
+#endif // VECTOR_H
@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <verify.h>
+#include <syscall.h>
+#include <caps.h>
+#include <jit.h>
+
+#define OP(f, operand, pop, delta, peak) { OPF_VALID | (f), operand, pop, delta, peak }
+
+const nvm_opinfo_t nvm_opinfo[256] = {
+    [OP_HALT]      = OP(OPF_END | OPF_STOP,   0, 0,  0, 0),
+    [OP_NOP]       = OP(0,                    0, 0,  0, 0),
+    [OP_PUSH]      = OP(0,                    4, 0,  1, 1),
+    [OP_POP]       = OP(0,                    0, 1, -1, 0),
+    [OP_DUP]       = OP(0,                    0, 1,  1, 1),
+    [OP_SWAP]      = OP(0,                    0, 2,  0, 0),
+    [OP_ADD]       = OP(0,                    0, 2, -1, 0),
+    [OP_SUB]       = OP(0,                    0, 2, -1, 0),
+    [OP_MUL]       = OP(0,                    0, 2, -1, 0),
+    [OP_DIV]       = OP(0,                    0, 2, -1, 0),
+    [OP_MOD]       = OP(0,                    0, 2, -1, 0),
+    [OP_CMP]       = OP(0,                    0, 2, -1, 0),
+    [OP_EQ]        = OP(0,                    0, 2, -1, 0),
+    [OP_NEQ]       = OP(0,                    0, 2, -1, 0),
+    [OP_GT]        = OP(0,                    0, 2, -1, 0),
+    [OP_LT]        = OP(0,                    0, 2, -1, 0),
+    [OP_JMP]       = OP(OPF_TARGET | OPF_END | OPF_STOP, 4, 0, 0, 0),
+    [OP_JZ]        = OP(OPF_TARGET | OPF_END, 4, 1, -1, 0),
+    [OP_JNZ]       = OP(OPF_TARGET | OPF_END, 4, 1, -1, 0),
+    [OP_CALL]      = OP(OPF_TARGET | OPF_END, 4, 0,  1, 2),  // CALL keeps one spare slot
+    [OP_RET]       = OP(OPF_END | OPF_STOP,   0, 1, -1, 0),
+    [OP_CALLF]     = OP(OPF_TARGET | OPF_END, 4, 0,  0, 0),
+    [OP_RETF]      = OP(OPF_END | OPF_STOP,   0, 0,  0, 0),
+    [OP_ENTER]     = OP(0,                    1, 0,  0, 0),
+    [OP_LEAVE]     = OP(0,                    0, 0,  0, 0),
+    [OP_LOAD]      = OP(OPF_LOCAL,            1, 0,  1, 1),
+    [OP_STORE]     = OP(OPF_LOCAL,            1, 1, -1, 0),
+    [OP_LOADF]     = OP(0,                    1, 0,  1, 1),  // Frame index checked at run time
+    [OP_STOREF]    = OP(0,                    1, 1, -1, 0),
+    [OP_STORE_ABS] = OP(0,                    0, 2, -2, 0),
+    [OP_LOAD8]     = OP(0,                    0, 1,  0, 0),  // Addresses checked at run time
+    [OP_LOAD16]    = OP(0,                    0, 1,  0, 0),
+    [OP_LOAD32]    = OP(0,                    0, 1,  0, 0),
+    [OP_STORE8]    = OP(0,                    0, 2, -2, 0),
+    [OP_STORE16]   = OP(0,                    0, 2, -2, 0),
+    [OP_STORE32]   = OP(0,                    0, 2, -2, 0),
+    [OP_MEMCPY]    = OP(0,                    0, 3, -3, 0),
+    [OP_MEMSET]    = OP(0,                    0, 3, -3, 0),
+    [OP_MEMCMP]    = OP(0,                    0, 3, -2, 0),
+    [OP_SYSCALL]   = OP(OPF_END,              1, 0,  0, 0),
+    [OP_BREAK]     = OP(0,                    0, 0,  0, 0),
+    [OP_VADD]      = OP(0,                    0, 4, -4, 0),  // Ranges checked at run time
+    [OP_VSUB]      = OP(0,                    0, 4, -4, 0),
+    [OP_VMUL]      = OP(0,                    0, 4, -4, 0),
+    [OP_VMIN]      = OP(0,                    0, 4, -4, 0),
+    [OP_VMAX]      = OP(0,                    0, 4, -4, 0),
+    [OP_VSUM]      = OP(0,                    0, 2, -1, 0),
+    [OP_VRMIN]     = OP(0,                    0, 2, -1, 0),
+    [OP_VRMAX]     = OP(0,                    0, 2, -1, 0),
+    [OP_VDOT]      = OP(0,                    0, 3, -2, 0),
+    [OP_VCOUNTEQ]  = OP(0,                    0, 3, -2, 0),
+    [OP_VCOUNTGT]  = OP(0,                    0, 3, -2, 0),
+    [OP_VCOUNTLT]  = OP(0,                    0, 3, -2, 0),
+    [OP_ADD64]     = OP(0,                    0, 4, -2, 0),
+    [OP_SUB64]     = OP(0,                    0, 4, -2, 0),
+    [OP_MUL64]     = OP(0,                    0, 4, -2, 0),
+    [OP_DIV64]     = OP(0,                    0, 4, -2, 0),
+    [OP_MOD64]     = OP(0,                    0, 4, -2, 0),
+    [OP_CMP64]     = OP(0,                    0, 4, -3, 0),
+    [OP_EXT64]     = OP(0,                    0, 1,  1, 1),
+    [OP_ADDC]      = OP(0,                    0, 2, -1, 0),
+    [OP_SUBC]      = OP(0,                    0, 2, -1, 0),
+    [OP_MULC]      = OP(0,                    0, 2, -1, 0),
+    [OP_ADD64C]    = OP(0,                    0, 4, -2, 0),
+    [OP_SUB64C]    = OP(0,                    0, 4, -2, 0),
+    [OP_MUL64C]    = OP(0,                    0, 4, -2, 0),
+    [OP_FMUL]      = OP(0,                    1, 2, -1, 0),
+    [OP_FDIV]      = OP(0,                    1, 2, -1, 0),
+    [OP_DIVC]      = OP(0,                    0, 2, -1, 0),
+    [OP_MODC]      = OP(0,                    0, 2, -1, 0),
+    [OP_DIV64C]    = OP(0,                    0, 4, -2, 0),
+    [OP_MOD64C]    = OP(0,                    0, 4, -2, 0),
+};
+
+static uint32_t operand32(const uint8_t* at) {
+    return ((uint32_t)at[0] << 24) | ((uint32_t)at[1] << 16) |
+           ((uint32_t)at[2] << 8) | (uint32_t)at[3];
+}
+
+// Capability bits an instruction needs to run
+static nvm_caps_t insn_caps(uint8_t op, int32_t arg) {
+    if(op == OP_STORE_ABS) {
+        return CAPS_BIT(CAP_DRV_ACCESS);
+    }
+    if(op == OP_SYSCALL) {
+        return CAPS_BIT(nvm_syscalls[arg].capability);
+    }
+    return 0;
+}
+
+// Whether execution can run off the end after the last instruction
+static bool falls_off(uint8_t op, int32_t arg) {
+    return !(nvm_opinfo[op].flags & OPF_STOP) && !(op == OP_SYSCALL && arg == SYSCALL_EXIT);
+}
+
+// Step a run check one instruction back: (need, grow) of the run from the
+// next instruction becomes that of the run from this one
+static void run_step(const nvm_opinfo_t* info, int32_t* need, int32_t* grow) {
+    if(info->flags & OPF_END) {
+        *need = info->pop;
+        *grow = info->peak;
+    } else {
+        int32_t nn = *need - info->delta;
+        int32_t ng = *grow + info->delta;
+        *need = nn > info->pop ? nn : info->pop;
+        *grow = ng > info->peak ? ng : info->peak;
+    }
+}
+
+void nvm_program_free(nvm_program_t* program) {
+    if(!program) {
+        return;
+    }
+
+    if(!program->mapped) {
+        free(program->code);
+        free(program->blocks);
+        free(program->offsets);
+        free(program->index);
+    }
+    nvm_jit_free(program->jit);
+    free(program);
+}
+
+// Decode the image, check operands and targets, then compute for every
+// instruction where a run can start the stack depth it needs and the most
+// it can grow before the next control transfer. Instructions that are not
+// run starts get NVM_BLOCK_NONE so entering them always fails the check.
+nvm_program_t* nvm_verify(const uint8_t* bytecode, uint32_t size, const char** reason) {
+    nvm_program_t* program = calloc(1, sizeof(nvm_program_t));
+    uint8_t* entry = NULL;
+
+    if(!program || !(program->index = malloc(size * sizeof(uint32_t)))) {
+        *reason = "out of memory";
+        goto fail;
+    }
+    program->size = size;
+    program->jit_countdown = NVM_JIT_THRESHOLD;
+
+    // Pass 1: linear decode, number the instructions
+    uint32_t count = 0;
+    uint32_t off;
+    for(off = 0; off < size && off < 4; off++) {
+        program->index[off] = NVM_NO_INSN;
+    }
+    while(off < size) {
+        const nvm_opinfo_t* info = &nvm_opinfo[bytecode[off]];
+
+        if(!(info->flags & OPF_VALID)) {
+            *reason = "unknown opcode";
+            goto fail;
+        }
+        if(off + info->operand >= size) {
+            *reason = "truncated operand";
+            goto fail;
+        }
+        if((info->flags & OPF_LOCAL) && bytecode[off + 1] >= MAX_LOCALS) {
+            *reason = "invalid local index";
+            goto fail;
+        }
+
+        program->index[off] = count++;
+        for(uint32_t i = 1; i <= info->operand; i++) {
+            program->index[off + i] = NVM_NO_INSN;
+        }
+        off += 1 + info->operand;
+    }
+
+    if(count == 0) {
+        *reason = "empty program";
+        goto fail;
+    }
+
+    program->count = count;
+    program->code = malloc(count * sizeof(nvm_insn_t));
+    program->blocks = malloc(count * sizeof(nvm_block_t));
+    program->offsets = malloc(count * sizeof(uint32_t));
+    entry = calloc(count, 1);
+    if(!program->code || !program->blocks || !program->offsets || !entry) {
+        *reason = "out of memory";
+        goto fail;
+    }
+
+    // Pass 2: translate, targets must be instruction starts
+    uint32_t n = 0;
+    for(off = 4; off < size; off += 1 + nvm_opinfo[bytecode[off]].operand, n++) {
+        uint8_t op = bytecode[off];
+        const nvm_opinfo_t* info = &nvm_opinfo[op];
+        nvm_insn_t* insn = &program->code[n];
+
+        program->offsets[n] = off;
+        insn->op = op;
+        insn->aux[0] = insn->aux[1] = insn->aux[2] = 0;
+        insn->arg = 0;
+
+        if(info->operand == 4) {
+            insn->arg = (int32_t)operand32(&bytecode[off + 1]);
+        } else if(info->operand == 1) {
+            insn->arg = bytecode[off + 1];
+        }
+
+        if(info->flags & OPF_TARGET) {
+            uint32_t addr = (uint32_t)insn->arg;
+
+            if(addr < 4 || addr >= size || program->index[addr] == NVM_NO_INSN) {
+                *reason = "invalid jump target";
+                goto fail;
+            }
+            insn->arg = (int32_t)program->index[addr];
+            entry[insn->arg] = 1;
+        }
+
+        // Resolve what the program needs to run, checked when a process starts
+        program->caps |= insn_caps(op, insn->arg);
+
+        if((info->flags & OPF_END) && n + 1 < count) {
+            entry[n + 1] = 1;
+        }
+    }
+    entry[0] = 1;
+
+    // Execution must not run off the end of the image
+    const nvm_insn_t* last = &program->code[count - 1];
+    if(falls_off(last->op, last->arg)) {
+        *reason = "falls off the end";
+        goto fail;
+    }
+
+    // Pass 3: walk backwards so each run start sees the rest of its run
+    int32_t need = 0, grow = 0;
+    for(n = count; n-- > 0;) {
+        run_step(&nvm_opinfo[program->code[n].op], &need, &grow);
+
+        if(entry[n]) {
+            program->blocks[n].need = need < NVM_BLOCK_NONE ? need : NVM_BLOCK_NONE;
+            program->blocks[n].grow = grow < NVM_BLOCK_NONE ? grow : NVM_BLOCK_NONE;
+        } else {
+            program->blocks[n].need = program->blocks[n].grow = NVM_BLOCK_NONE;
+        }
+    }
+
+    free(entry);
+    return program;
+
+fail:
+    free(entry);
+    nvm_program_free(program);
+    return NULL;
+}
+
+// Decoded operand of original instruction `n`, false for a target that is
+// not an instruction start
+static bool original_arg(const nvm_program_t* program, const uint8_t* bytecode, uint32_t n, int32_t* arg) {
+    uint32_t off = program->offsets[n];
+    const nvm_opinfo_t* info = &nvm_opinfo[bytecode[off]];
+
+    *arg = 0;
+    if(info->operand == 4) {
+        *arg = (int32_t)operand32(&bytecode[off + 1]);
+    } else if(info->operand == 1) {
+        *arg = bytecode[off + 1];
+    }
+
+    if(info->flags & OPF_TARGET) {
+        uint32_t addr = (uint32_t)*arg;
+        if(addr < 4 || addr >= program->size || program->index[addr] == NVM_NO_INSN) {
+            return false;
+        }
+        *arg = (int32_t)program->index[addr];
+    }
+    return true;
+}
+
+// Whether instruction `n` is a fusion nvm_fuse could have made of the
+// originals starting there
+static bool fused_ok(const nvm_program_t* program, const uint8_t* bytecode, uint32_t n) {
+    const nvm_insn_t* insn = &program->code[n];
+    uint8_t ops[4] = { 0 };
+    for(uint32_t k = 0; k < 4 && n + k < program->count; k++) {
+        ops[k] = bytecode[program->offsets[n + k]];
+    }
+    uint8_t local = ops[0] == OP_LOAD ? bytecode[program->offsets[n] + 1] : 0;
+    int32_t value = ops[1] == OP_PUSH ? (int32_t)operand32(&bytecode[program->offsets[n + 1] + 1]) : 0;
+
+    switch(insn->op) {
+        case OP_LOAD_PUSH_CMP_BRANCH:
+            return ops[0] == OP_LOAD && ops[1] == OP_PUSH &&
+                   (ops[2] == OP_GT || ops[2] == OP_LT || ops[2] == OP_EQ || ops[2] == OP_NEQ) &&
+                   (ops[3] == OP_JZ || ops[3] == OP_JNZ) &&
+                   insn->aux[0] == ops[2] && insn->aux[1] == (ops[3] == OP_JNZ) &&
+                   insn->aux[2] == local && insn->arg == value;
+
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL:
+            return ops[0] == OP_LOAD && ops[1] == OP_PUSH &&
+                   ops[2] == (insn->op == OP_INC_LOCAL ? OP_ADD : OP_SUB) && ops[3] == OP_STORE &&
+                   bytecode[program->offsets[n + 3] + 1] == local &&
+                   insn->aux[0] == 0 && insn->aux[1] == 0 && insn->aux[2] == local && insn->arg == value;
+
+        case OP_PUSH_ADD:
+            return ops[0] == OP_PUSH && ops[1] == OP_ADD &&
+                   insn->aux[0] == 0 && insn->aux[1] == 0 && insn->aux[2] == 0 &&
+                   insn->arg == (int32_t)operand32(&bytecode[program->offsets[n] + 1]);
+
+        default:
+            return false;
+    }
+}
+
+// Linear passes over the bytecode, the index and the decoded program. The
+// arrays are not trusted, so every one is checked before it is used to
+// look up another.
+bool nvm_verify_decoded(nvm_program_t* program, const uint8_t* bytecode, const char** reason) {
+    const uint32_t size = program->size;
+    const uint32_t count = program->count;
+
+    // Offsets and index: exactly the instruction starts of the bytecode
+    uint32_t n = 0;
+    uint32_t off;
+    for(off = 0; off < size && off < 4; off++) {
+        if(program->index[off] != NVM_NO_INSN) {
+            *reason = "invalid offset map";
+            return false;
+        }
+    }
+    while(off < size) {
+        const nvm_opinfo_t* info = &nvm_opinfo[bytecode[off]];
+
+        if(!(info->flags & OPF_VALID)) {
+            *reason = "unknown opcode";
+            return false;
+        }
+        if(off + info->operand >= size) {
+            *reason = "truncated operand";
+            return false;
+        }
+        if((info->flags & OPF_LOCAL) && bytecode[off + 1] >= MAX_LOCALS) {
+            *reason = "invalid local index";
+            return false;
+        }
+        if(n == count || program->offsets[n] != off || program->index[off] != n) {
+            *reason = "invalid offset map";
+            return false;
+        }
+        for(uint32_t i = 1; i <= info->operand; i++) {
+            if(program->index[off + i] != NVM_NO_INSN) {
+                *reason = "invalid offset map";
+                return false;
+            }
+        }
+        off += 1 + info->operand;
+        n++;
+    }
+    if(n != count || count == 0) {
+        *reason = "invalid offset map";
+        return false;
+    }
+
+    // Instructions: the decoded originals, or fusions of them
+    nvm_caps_t caps = 0;
+    int32_t arg = 0;
+    for(n = 0; n < count; n++) {
+        const nvm_insn_t* insn = &program->code[n];
+        uint8_t op = bytecode[program->offsets[n]];
+
+        if(!original_arg(program, bytecode, n, &arg)) {
+            *reason = "invalid jump target";
+            return false;
+        }
+        bool same = insn->op == op && insn->arg == arg &&
+                    insn->aux[0] == 0 && insn->aux[1] == 0 && insn->aux[2] == 0;
+        if(!same && !fused_ok(program, bytecode, n)) {
+            *reason = "decoded instruction does not match the bytecode";
+            return false;
+        }
+        caps |= insn_caps(op, arg);
+    }
+    // arg is still that of the last instruction
+    if(falls_off(bytecode[program->offsets[count - 1]], arg)) {
+        *reason = "falls off the end";
+        return false;
+    }
+
+    // Run checks: never weaker than the ones nvm_verify computes
+    int32_t need = 0, grow = 0;
+    for(n = count; n-- > 0;) {
+        run_step(&nvm_opinfo[bytecode[program->offsets[n]]], &need, &grow);
+
+        const nvm_block_t* block = &program->blocks[n];
+        if(block->need != NVM_BLOCK_NONE && block->grow != NVM_BLOCK_NONE &&
+           (block->need < need || block->grow < grow)) {
+            *reason = "run check weaker than the verifier's";
+            return false;
+        }
+    }
+
+    program->caps = caps;
+    return true;
+}
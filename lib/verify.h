@@ -0,0 +1,48 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+
+// Opcode flags
+#define OPF_VALID   0x01    // Known opcode
+#define OPF_TARGET  0x02    // 32-bit operand is a jump/call target
+#define OPF_END     0x04    // Ends a straight-line run (control transfer or syscall)
+#define OPF_STOP    0x08    // Never falls through to the next instruction
+#define OPF_LOCAL   0x10    // 8-bit operand is a local variable index
+
+typedef struct {
+    uint8_t flags;
+    uint8_t operand;    // Operand bytes after the opcode
+    uint8_t pop;        // Values required on the stack
+    int8_t delta;       // Net stack effect
+    uint8_t peak;       // Highest depth above entry reached while executing
+} nvm_opinfo_t;
+
+extern const nvm_opinfo_t nvm_opinfo[256];
+
+// Verify a whole NVM0 image and translate it to decoded form. On failure
+// returns NULL and sets *reason.
+nvm_program_t* nvm_verify(const uint8_t* bytecode, uint32_t size, const char** reason);
+
+// Check a decoded program that did not come from nvm_verify, such as one
+// mapped from a compiled image, against its bytecode: the same offsets,
+// index, operands and targets as nvm_verify would produce, fusions that
+// nvm_fuse could have made and run checks at least as strict. Recomputes
+// program->caps from the bytecode. On failure returns false and sets
+// *reason.
+bool nvm_verify_decoded(nvm_program_t* program, const uint8_t* bytecode, const char** reason);
+void nvm_program_free(nvm_program_t* program);
+
+// Superinstruction fusion
+#define NVM_FUSION_KINDS 4
+
+extern bool nvm_fuse_enabled;
+extern const char* const nvm_fusion_names[NVM_FUSION_KINDS];
+
+// Rewrite common sequences of a decoded program into fused instructions and
+// count each kind in counts[]. Returns the total number of fusions.
+uint32_t nvm_fuse(nvm_program_t* program, uint32_t counts[NVM_FUSION_KINDS]);
+
+#endif // VERIFY_H
@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <log.h>
+#include <nvm.h>
+#include <caps.h>
+#include <syscall.h>
+#include <scheduler.h>
+#include <proctab.h>
+#include <message.h>
+#include <console.h>
+#include <snapshot.h>
+#include <vm.h>
+
+// Embedding.
+//
+// A VM owns the processes it spawned and a table of host calls. Its
+// processes live in the shared process table like any other, but are never
+// queued on the scheduler: nvm_vm_step and nvm_vm_run execute them on the
+// calling thread with the same cores run_slice uses. A process that blocks
+// stays where it is; the next call checks its mailbox and deadline itself
+// and retries the syscall, which is what a wakeup would have done.
+//
+// Each process records its VM and its index in the VM's list, so lookups
+// and releases take constant time however many processes are live.
+
+typedef struct {
+    nvm_host_fn_t fn;       // NULL to use the built-in syscall
+    void* user;
+    const char* name;
+    uint8_t pop;
+    uint8_t push;
+} nvm_host_call_t;
+
+struct nvm_vm {
+    nvm_host_call_t hosts[SYSCALL_COUNT];
+    uint32_t* pids;         // Processes of this VM, in no particular order
+    uint32_t count;
+    uint32_t capacity;
+};
+
+nvm_vm_t* nvm_vm_create() {
+    return calloc(1, sizeof(nvm_vm_t));
+}
+
+void nvm_vm_reset(nvm_vm_t* vm) {
+    while(vm->count > 0) {
+        nvm_vm_release(vm, vm->pids[vm->count - 1]);
+    }
+}
+
+void nvm_vm_destroy(nvm_vm_t* vm) {
+    if(vm) {
+        nvm_vm_reset(vm);
+        free(vm->pids);
+        free(vm);
+    }
+}
+
+bool nvm_vm_host_call(nvm_vm_t* vm, uint8_t id, const char* name, nvm_host_fn_t fn, void* user,
+                      uint8_t pop, uint8_t push) {
+    if(!fn || !name || nvm_syscalls[id].capability != CAPS_NONE) {
+        return false;
+    }
+
+    vm->hosts[id] = (nvm_host_call_t){ fn, user, name, pop, push };
+    return true;
+}
+
+bool nvm_vm_dispatch(nvm_process_t* proc, uint8_t id, int32_t* result) {
+    const nvm_host_call_t* host = &proc->vm->hosts[id];
+    if(!host->fn) {
+        return false;
+    }
+
+    // Same checks as syscall_handler makes for built-in syscalls
+    *result = -1;
+    if(proc->sp < host->pop) {
+        LOG_WARN("Process %d: Stack underflow for %s\n", proc->pid, host->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return true;
+    }
+    if(proc->sp - host->pop > STACK_SIZE - host->push) {
+        LOG_WARN("Process %d: Stack overflow for %s\n", proc->pid, host->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return true;
+    }
+
+    int32_t results[UINT8_MAX];
+    if(!host->fn(host->user, proc->pid, &proc->stack[proc->sp - host->pop], results)) {
+        LOG_WARN("Process %d: Host call %s failed\n", proc->pid, host->name);
+        proc->exit_code = -1;
+        proc->active = false;
+        return true;
+    }
+
+    proc->sp -= host->pop;
+    memcpy(&proc->stack[proc->sp], results, host->push * sizeof(int32_t));
+    proc->sp += host->push;
+    *result = 0;
+    return true;
+}
+
+bool nvm_vm_adopt(nvm_vm_t* vm, nvm_process_t* proc) {
+    if(vm->count == vm->capacity) {
+        uint32_t capacity = vm->capacity ? vm->capacity * 2 : 16;
+        uint32_t* pids = realloc(vm->pids, capacity * sizeof(uint32_t));
+        if(!pids) {
+            proc->active = false;
+            nvm_process_release(proc);
+            return false;
+        }
+        vm->pids = pids;
+        vm->capacity = capacity;
+    }
+
+    proc->vm = vm;
+    proc->vm_slot = vm->count;
+    vm->pids[vm->count++] = proc->pid;
+    return true;
+}
+
+int nvm_vm_spawn(nvm_vm_t* vm, nvm_image_t* image, uint16_t* capabilities, uint8_t caps_count) {
+    nvm_process_t* proc = nvm_process_create(image, caps_from_list(capabilities, caps_count));
+    return proc && nvm_vm_adopt(vm, proc) ? (int)proc->pid : -1;
+}
+
+static nvm_process_t* vm_process(nvm_vm_t* vm, uint32_t pid) {
+    nvm_process_t* proc = nvm_proctab_get(pid);
+    return proc && proc->vm == vm ? proc : NULL;
+}
+
+// Let a blocked process retry its syscall once a message or its deadline
+// has come. False while it still has to wait.
+static bool vm_wake(nvm_process_t* proc) {
+    if(!proc->blocked) {
+        return true;
+    }
+
+    if(nvm_mailbox_pending(proc->mailbox)) {
+        proc->wakeup_reason = WAKE_MESSAGE;
+    } else if(proc->wake_deadline && nvm_now_ns() >= proc->wake_deadline) {
+        proc->wakeup_reason = WAKE_TIMEOUT;
+    } else {
+        return false;
+    }
+    proc->blocked = false;
+    return true;
+}
+
+static nvm_vm_status_t vm_status(const nvm_process_t* proc) {
+    if(!proc->active) {
+        return NVM_VM_EXITED;
+    }
+    return proc->blocked ? NVM_VM_BLOCKED : NVM_VM_READY;
+}
+
+nvm_vm_status_t nvm_vm_step(nvm_vm_t* vm, uint32_t pid, uint32_t count) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    if(!proc) {
+        return NVM_VM_NO_PROCESS;
+    }
+
+    if(proc->active && vm_wake(proc)) {
+        current_process = pid;
+        for(uint32_t i = 0; i < count && proc->active && !proc->blocked; i++) {
+            if(!nvm_execute_instruction(proc)) {
+                break;
+            }
+        }
+    }
+    return vm_status(proc);
+}
+
+nvm_vm_status_t nvm_vm_run(nvm_vm_t* vm, uint32_t pid, int32_t budget) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    if(!proc) {
+        return NVM_VM_NO_PROCESS;
+    }
+
+    if(proc->active && vm_wake(proc)) {
+        current_process = pid;
+        proc->budget = budget;
+        nvm_run(proc);
+    }
+    return vm_status(proc);
+}
+
+int nvm_vm_fork(nvm_vm_t* vm, uint32_t pid) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    if(!proc || !proc->active) {
+        return -1;
+    }
+
+    nvm_process_t* child = nvm_process_fork(proc);
+    return child && nvm_vm_adopt(vm, child) ? (int)child->pid : -1;
+}
+
+nvm_snapshot_t* nvm_vm_snapshot(nvm_vm_t* vm, uint32_t pid) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    return proc && proc->active ? nvm_snapshot_take(proc) : NULL;
+}
+
+int nvm_vm_restore(nvm_vm_t* vm, const nvm_snapshot_t* snap) {
+    nvm_process_t* proc = nvm_snapshot_restore(snap);
+    return proc && nvm_vm_adopt(vm, proc) ? (int)proc->pid : -1;
+}
+
+int32_t nvm_vm_exit_code(nvm_vm_t* vm, uint32_t pid) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    return proc && !proc->active ? proc->exit_code : -1;
+}
+
+void nvm_vm_release(nvm_vm_t* vm, uint32_t pid) {
+    nvm_process_t* proc = vm_process(vm, pid);
+    if(!proc) {
+        return;
+    }
+
+    if(proc->active) {
+        proc->active = false;
+        proc->exit_code = -1;
+    }
+
+    // Move the last process of the list into the hole
+    uint32_t last = vm->pids[--vm->count];
+    vm->pids[proc->vm_slot] = last;
+    nvm_proctab_get(last)->vm_slot = proc->vm_slot;
+
+    nvm_console_flush(proc->console);
+    nvm_process_release(proc);
+}
@@ -0,0 +1,78 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <nvm.h>
+#include <image.h>
+#include <snapshot.h>
+
+// Embedding API, built into libnvm.a. A host loads each script once with
+// nvm_image_load or nvm_image_open, starts any number of processes from it
+// in a VM and runs them on its own thread with nvm_vm_step or nvm_vm_run;
+// nothing here starts the scheduler. One thread at a time may use a VM,
+// separate VMs may run on separate threads. PIDs are unique across VMs, so
+// SEND reaches processes of other VMs too.
+
+// State of a process after a call
+typedef enum {
+    NVM_VM_READY,       // Can run further
+    NVM_VM_BLOCKED,     // Waiting for a message or a timeout, try again later
+    NVM_VM_EXITED,      // Stopped, see nvm_vm_exit_code
+    NVM_VM_NO_PROCESS,  // No such process in this VM
+} nvm_vm_status_t;
+
+// Host call: `args` holds the `pop` values the syscall takes, deepest first,
+// and the host writes the `push` values it leaves to `results`. Return false
+// to stop the process with exit code -1.
+typedef bool (*nvm_host_fn_t)(void* user, uint32_t pid, const int32_t* args, int32_t* results);
+
+nvm_vm_t* nvm_vm_create();
+
+// Release every process of the VM, keeping its host calls
+void nvm_vm_reset(nvm_vm_t* vm);
+
+void nvm_vm_destroy(nvm_vm_t* vm);
+
+// Serve syscall `id` of this VM's processes with `fn` instead of the
+// built-in one. False for a syscall that needs a capability, whose check
+// verified programs have already made.
+bool nvm_vm_host_call(nvm_vm_t* vm, uint8_t id, const char* name, nvm_host_fn_t fn, void* user,
+                      uint8_t pop, uint8_t push);
+
+// Start a process from `image` holding the listed capabilities. Returns its
+// PID, -1 if the image is invalid or lacks capabilities, or on no slots.
+int nvm_vm_spawn(nvm_vm_t* vm, nvm_image_t* image, uint16_t* capabilities, uint8_t caps_count);
+
+// Execute up to `count` instructions one at a time on the reference core
+nvm_vm_status_t nvm_vm_step(nvm_vm_t* vm, uint32_t pid, uint32_t count);
+
+// Run on the fastest core until the process stops, blocks or has passed
+// `budget` backward jumps, calls and returns
+nvm_vm_status_t nvm_vm_run(nvm_vm_t* vm, uint32_t pid, int32_t budget);
+
+// Start a copy of a process that has not stopped, in the same VM. Its
+// linear memory is copied on write. Returns the new PID, -1 on failure.
+int nvm_vm_fork(nvm_vm_t* vm, uint32_t pid);
+
+// Snapshot a process to start clones from later, NULL on failure
+nvm_snapshot_t* nvm_vm_snapshot(nvm_vm_t* vm, uint32_t pid);
+
+// Start a process from a snapshot. Returns its PID, -1 on failure.
+int nvm_vm_restore(nvm_vm_t* vm, const nvm_snapshot_t* snap);
+
+// Exit code of a stopped process, -1 while it runs or for no such process
+int32_t nvm_vm_exit_code(nvm_vm_t* vm, uint32_t pid);
+
+// Write out its buffered output and free the process, stopping it first if
+// it still runs
+void nvm_vm_release(nvm_vm_t* vm, uint32_t pid);
+
+// Make a new process part of the VM; releases it on failure
+bool nvm_vm_adopt(nvm_vm_t* vm, nvm_process_t* proc);
+
+// For syscall_handler: run the host call for syscall `id` of a VM process
+// and set *result. False if the VM has none.
+bool nvm_vm_dispatch(nvm_process_t* proc, uint8_t id, int32_t* result);
+
+#endif // VM_H
@@ -0,0 +1,40 @@
+#ifndef WIDE_H
+#define WIDE_H
+
+#include <stdint.h>
+
+// 64-bit values take two stack slots, the low word below the high one, so
+// the pair reads as one little-endian int64 in memory. `push lo; push hi`
+// is a 64-bit literal and EXT64 sign-extends a 32-bit value.
+
+static inline int64_t nvm_wide_get(const int32_t* at) {
+    return (int64_t)(((uint64_t)(uint32_t)at[1] << 32) | (uint32_t)at[0]);
+}
+
+static inline void nvm_wide_set(int32_t* at, int64_t value) {
+    at[0] = (int32_t)(uint32_t)(uint64_t)value;
+    at[1] = (int32_t)(uint32_t)((uint64_t)value >> 32);
+}
+
+// Wrapping arithmetic; the divisor of DIV64/MOD64 must not be 0, and
+// INT64_MIN / -1 wraps like the 32-bit DIV. DIV64C and MOD64C stop the
+// process there instead.
+static inline int64_t nvm_wide_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t nvm_wide_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t nvm_wide_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t nvm_wide_div(int64_t a, int64_t b) { return b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b; }
+static inline int64_t nvm_wide_mod(int64_t a, int64_t b) { return b == -1 ? 0 : a % b; }
+
+// Fixed-point with `shift` fraction bits (taken mod 32): the product is
+// shifted right and the dividend left at 64 bits, then truncated to 32.
+// The divisor of FDIV must not be 0.
+static inline int32_t nvm_fixed_mul(int32_t a, int32_t b, int32_t shift) {
+    return (int32_t)(uint32_t)(uint64_t)(((int64_t)a * b) >> (shift & 31));
+}
+
+static inline int32_t nvm_fixed_div(int32_t a, int32_t b, int32_t shift) {
+    int64_t dividend = (int64_t)((uint64_t)(int64_t)a << (shift & 31));
+    return (int32_t)(uint32_t)(uint64_t)(dividend / b);
+}
+
+#endif // WIDE_H
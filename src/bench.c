@@ -0,0 +1,528 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <log.h>
+#include <nvm.h>
+#include <caps.h>
+#include <scheduler.h>
+#include <console.h>
+#include <heap.h>
+#include <profile.h>
+
+// Interpreter benchmarks.
+//
+// Every workload is bytecode generated here, so runs are reproducible
+// without any files. A workload is counted once under the profiler, which
+// gives the bytecode instructions it executes, then run a few times to warm
+// up the image cache and the JIT and timed over the repetitions. Each timed
+// run is nvm_execute, or for several processes nvm_spawn for each and one
+// scheduler run, so it measures what a launch of nvm measures minus reading
+// files. Program output goes to /dev/null.
+
+#define BENCH_MAX_PROCS 8
+#define BENCH_THRESHOLD 5.0     // Percent slower than the baseline that counts as a regression
+
+typedef struct {
+    uint8_t* code;
+    uint32_t size;
+    uint32_t cap;
+} emit_t;
+
+typedef struct {
+    const char* name;
+    const char* about;
+    uint32_t procs;
+    int32_t iterations;         // Of the main loop at scale 1
+    void (*build)(emit_t* programs, int32_t n);
+} workload_t;
+
+typedef struct {
+    const workload_t* workload;
+    uint64_t instructions;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t mean_ns;
+    double ns_per_insn;
+    double insns_per_sec;
+} result_t;
+
+static void emit(emit_t* e, const uint8_t* bytes, uint32_t count) {
+    if(e->size + count > e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 256;
+        e->code = realloc(e->code, e->cap);
+        if(!e->code) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    memcpy(e->code + e->size, bytes, count);
+    e->size += count;
+}
+
+static void op(emit_t* e, uint8_t opcode) {
+    emit(e, &opcode, 1);
+}
+
+static void op8(emit_t* e, uint8_t opcode, uint8_t arg) {
+    uint8_t bytes[2] = { opcode, arg };
+    emit(e, bytes, 2);
+}
+
+// Returns the offset of the operand, for patch
+static uint32_t op32(emit_t* e, uint8_t opcode, int32_t arg) {
+    uint32_t v = (uint32_t)arg;
+    uint8_t bytes[5] = { opcode, (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    emit(e, bytes, 5);
+    return e->size - 4;
+}
+
+static void patch(emit_t* e, uint32_t at, uint32_t target) {
+    e->code[at] = (uint8_t)(target >> 24);
+    e->code[at + 1] = (uint8_t)(target >> 16);
+    e->code[at + 2] = (uint8_t)(target >> 8);
+    e->code[at + 3] = (uint8_t)target;
+}
+
+static void header(emit_t* e) {
+    emit(e, (const uint8_t*)"NVM0", 4);
+}
+
+// Loop head on local 0 counting down from n; returns the offset to patch
+// with the loop exit
+static uint32_t loop_begin(emit_t* e, int32_t n, uint32_t* top) {
+    op32(e, OP_PUSH, n);
+    op8(e, OP_STORE, 0);
+    *top = e->size;
+    op8(e, OP_LOAD, 0);
+    return op32(e, OP_JZ, 0);
+}
+
+static void loop_end(emit_t* e, uint32_t top, uint32_t exit) {
+    op8(e, OP_LOAD, 0);
+    op32(e, OP_PUSH, 1);
+    op(e, OP_SUB);
+    op8(e, OP_STORE, 0);
+    op32(e, OP_JMP, (int32_t)top);
+    patch(e, exit, e->size);
+    op32(e, OP_PUSH, 0);
+    op8(e, OP_SYSCALL, SYSCALL_EXIT);
+}
+
+static void build_arith(emit_t* e, int32_t n) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op8(e, OP_LOAD, 0);
+    op32(e, OP_PUSH, 3);
+    op(e, OP_MUL);
+    op32(e, OP_PUSH, 7);
+    op(e, OP_ADD);
+    op8(e, OP_LOAD, 0);
+    op32(e, OP_PUSH, 5);
+    op(e, OP_MOD);
+    op(e, OP_SUB);
+    op8(e, OP_STORE, 1);
+    loop_end(e, top, exit);
+}
+
+// r(n) calls itself n deep with CALL and RET; the return offsets are on
+// the data stack
+static void build_recursion(emit_t* e, int32_t n) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op32(e, OP_PUSH, 200);
+    uint32_t call = op32(e, OP_CALL, 0);
+    op(e, OP_POP);
+    uint32_t done = op32(e, OP_JMP, 0);
+
+    // r: n ret -> 0
+    uint32_t r = e->size;
+    op(e, OP_SWAP);
+    op(e, OP_DUP);
+    uint32_t base = op32(e, OP_JZ, 0);
+    op32(e, OP_PUSH, 1);
+    op(e, OP_SUB);
+    op32(e, OP_CALL, (int32_t)r);
+    op(e, OP_SWAP);
+    op(e, OP_RET);
+    patch(e, base, e->size);
+    op(e, OP_SWAP);
+    op(e, OP_RET);
+
+    patch(e, call, r);
+    patch(e, done, e->size);
+    loop_end(e, top, exit);
+}
+
+// Locals rotated through a temporary, and a counter per word of the first
+// 4000 bytes of linear memory
+static void build_memory(emit_t* e, int32_t n) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op8(e, OP_LOAD, 1);
+    op32(e, OP_PUSH, 1);
+    op(e, OP_ADD);
+    op8(e, OP_STORE, 3);
+    op8(e, OP_LOAD, 2);
+    op8(e, OP_STORE, 1);
+    op8(e, OP_LOAD, 3);
+    op8(e, OP_STORE, 2);
+    op8(e, OP_LOAD, 0);
+    op32(e, OP_PUSH, 1000);
+    op(e, OP_MOD);
+    op32(e, OP_PUSH, 4);
+    op(e, OP_MUL);
+    op(e, OP_DUP);
+    op(e, OP_LOAD32);
+    op32(e, OP_PUSH, 1);
+    op(e, OP_ADD);
+    op(e, OP_STORE32);
+    loop_end(e, top, exit);
+}
+
+static void build_print(emit_t* e, int32_t n) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op8(e, OP_LOAD, 0);
+    op32(e, OP_PUSH, 26);
+    op(e, OP_MOD);
+    op32(e, OP_PUSH, 'a');
+    op(e, OP_ADD);
+    op8(e, OP_SYSCALL, SYSCALL_PRINT);
+    loop_end(e, top, exit);
+}
+
+// Sends to `peer` and waits for the reply, n times
+static void build_ping(emit_t* e, int32_t n, int32_t peer) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op32(e, OP_PUSH, peer);
+    op8(e, OP_LOAD, 0);
+    op8(e, OP_SYSCALL, SYSCALL_SEND);
+    op(e, OP_POP);
+    op8(e, OP_SYSCALL, SYSCALL_RECEIVE);
+    op(e, OP_POP);
+    op(e, OP_POP);
+    loop_end(e, top, exit);
+}
+
+// Sends every message back to its sender, n times
+static void build_pong(emit_t* e, int32_t n) {
+    uint32_t top;
+    header(e);
+    uint32_t exit = loop_begin(e, n, &top);
+    op8(e, OP_SYSCALL, SYSCALL_RECEIVE);
+    op8(e, OP_SYSCALL, SYSCALL_SEND);
+    op(e, OP_POP);
+    loop_end(e, top, exit);
+}
+
+// Two of each compute workload and a ping-pong pair, at a quarter of their
+// own sizes; PIDs follow the order of the programs
+static void build_mix(emit_t* e, int32_t n) {
+    build_arith(&e[0], 125000 * n);
+    build_arith(&e[1], 125000 * n);
+    build_recursion(&e[2], 1250 * n);
+    build_recursion(&e[3], 1250 * n);
+    build_memory(&e[4], 62500 * n);
+    build_memory(&e[5], 62500 * n);
+    build_ping(&e[6], 6250 * n, 7);
+    build_pong(&e[7], 6250 * n);
+}
+
+static void build_messages(emit_t* e, int32_t n) {
+    build_ping(&e[0], n, 1);
+    build_pong(&e[1], n);
+}
+
+static const workload_t workloads[] = {
+    { "arith",     "ADD/MUL/MOD loop on locals",                 1, 500000, build_arith },
+    { "recursion", "CALL/RET recursion 200 deep",                1, 5000,   build_recursion },
+    { "memory",    "LOAD/STORE locals and LOAD32/STORE32",       1, 250000, build_memory },
+    { "print",     "one PRINT syscall per iteration",            1, 125000, build_print },
+    { "messages",  "SEND/RECEIVE ping-pong between 2 processes", 2, 25000,  build_messages },
+    { "mix",       "6 compute processes and a ping-pong pair",   8, 1,      build_mix },
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+static void run(const workload_t* w, emit_t* programs) {
+    uint16_t capabilities[1] = {CAPS_NONE};
+    nvm_init();
+    if(w->procs == 1) {
+        nvm_execute(programs[0].code, programs[0].size, capabilities, 1);
+        return;
+    }
+    for(uint32_t i = 0; i < w->procs; i++) {
+        nvm_spawn(programs[i].code, programs[i].size, capabilities, 1);
+    }
+    nvm_scheduler_run();
+    nvm_stop_blocked();
+}
+
+static int by_value(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted times
+static uint64_t percentile(const uint64_t* sorted, uint32_t count, uint32_t p) {
+    uint32_t rank = (count * p + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void measure(const workload_t* w, uint32_t scale, uint32_t warmup, uint32_t reps, result_t* r) {
+    emit_t programs[BENCH_MAX_PROCS] = { 0 };
+    w->build(programs, w->iterations * (int32_t)scale);
+
+    // Count once on the profiler, then time without it
+    uint64_t before = nvm_profile_executed();
+    nvm_profile_open(NULL, NULL);
+    run(w, programs);
+    nvm_profile_enabled = false;
+    r->workload = w;
+    r->instructions = nvm_profile_executed() - before;
+
+    for(uint32_t i = 0; i < warmup; i++) {
+        run(w, programs);
+    }
+
+    uint64_t* times = malloc(reps * sizeof(uint64_t));
+    if(!times) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i < reps; i++) {
+        uint64_t start = nvm_now_ns();
+        run(w, programs);
+        times[i] = nvm_now_ns() - start;
+        sum += times[i];
+    }
+
+    qsort(times, reps, sizeof(uint64_t), by_value);
+    r->p50_ns = percentile(times, reps, 50);
+    r->p99_ns = percentile(times, reps, 99);
+    r->mean_ns = sum / reps;
+    r->ns_per_insn = r->instructions ? (double)r->p50_ns / (double)r->instructions : 0;
+    r->insns_per_sec = r->p50_ns ? (double)r->instructions * 1e9 / (double)r->p50_ns : 0;
+
+    free(times);
+    for(uint32_t i = 0; i < w->procs; i++) {
+        free(programs[i].code);
+    }
+}
+
+static void write_csv(FILE* out, const result_t* results, uint32_t count, uint32_t reps) {
+    fprintf(out, "workload,processes,instructions,reps,p50_us,p99_us,mean_us,ns_per_insn,insns_per_sec\n");
+    for(uint32_t i = 0; i < count; i++) {
+        const result_t* r = &results[i];
+        fprintf(out, "%s,%u,%" PRIu64 ",%u,%.1f,%.1f,%.1f,%.3f,%.0f\n", r->workload->name,
+                r->workload->procs, r->instructions, reps, r->p50_ns / 1e3, r->p99_ns / 1e3,
+                r->mean_ns / 1e3, r->ns_per_insn, r->insns_per_sec);
+    }
+}
+
+static void write_json(FILE* out, const result_t* results, uint32_t count, uint32_t reps) {
+    fprintf(out, "[\n");
+    for(uint32_t i = 0; i < count; i++) {
+        const result_t* r = &results[i];
+        fprintf(out, "  {\"workload\": \"%s\", \"processes\": %u, \"instructions\": %" PRIu64 ", "
+                "\"reps\": %u, \"p50_us\": %.1f, \"p99_us\": %.1f, \"mean_us\": %.1f, "
+                "\"ns_per_insn\": %.3f, \"insns_per_sec\": %.0f}%s\n", r->workload->name,
+                r->workload->procs, r->instructions, reps, r->p50_ns / 1e3, r->p99_ns / 1e3,
+                r->mean_ns / 1e3, r->ns_per_insn, r->insns_per_sec, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+// Compare ns per instruction with a CSV file written by an earlier run.
+// Returns the number of workloads that got slower than the threshold.
+static int compare(const char* path, const result_t* results, uint32_t count, double threshold) {
+    FILE* file = fopen(path, "r");
+    if(!file) {
+        fprintf(stderr, "Error: Cannot open baseline: '%s'\n", path);
+        return -1;
+    }
+
+    // Find the columns by name, so baselines survive added columns
+    char line[1024];
+    int name_col = -1, value_col = -1;
+    if(fgets(line, sizeof(line), file)) {
+        int col = 0;
+        for(char* field = strtok(line, ",\r\n"); field; field = strtok(NULL, ",\r\n"), col++) {
+            if(strcmp(field, "workload") == 0) {
+                name_col = col;
+            } else if(strcmp(field, "ns_per_insn") == 0) {
+                value_col = col;
+            }
+        }
+    }
+    if(name_col < 0 || value_col < 0) {
+        fprintf(stderr, "Error: Not a benchmark CSV file: '%s'\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    int regressions = 0;
+    while(fgets(line, sizeof(line), file)) {
+        const char* name = NULL;
+        double before = 0;
+        int col = 0;
+        for(char* field = strtok(line, ",\r\n"); field; field = strtok(NULL, ",\r\n"), col++) {
+            if(col == name_col) {
+                name = field;
+            } else if(col == value_col) {
+                before = strtod(field, NULL);
+            }
+        }
+
+        for(uint32_t i = 0; name && before > 0 && i < count; i++) {
+            if(strcmp(results[i].workload->name, name) != 0) {
+                continue;
+            }
+            double change = (results[i].ns_per_insn / before - 1) * 100;
+            bool slower = change > threshold;
+            fprintf(stderr, "%-10s %8.3f -> %8.3f ns/insn %+6.1f%%%s\n", name, before,
+                    results[i].ns_per_insn, change, slower ? "  REGRESSION" : "");
+            regressions += slower;
+        }
+    }
+
+    fclose(file);
+    return regressions;
+}
+
+static bool parse_count(const char* arg, uint32_t min, uint32_t* value) {
+    char* end;
+    long n = strtol(arg, &end, 10);
+    if(*arg == '\0' || *end != '\0' || n < min || n > 1000000) {
+        return false;
+    }
+    *value = (uint32_t)n;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t warmup = 3, reps = 20, scale = 1;
+    const char* format = "csv";
+    const char* output = "-";
+    const char* baseline = NULL;
+    double threshold = BENCH_THRESHOLD;
+    bool selected[WORKLOAD_COUNT] = { false };
+    bool any = false;
+
+    int arg_index = 1;
+    while (arg_index < argc) {
+        const char* arg = argv[arg_index];
+        const char* value = arg_index + 1 < argc ? argv[arg_index + 1] : NULL;
+        bool valid = true;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            fprintf(stderr, "Usage: %s [--warmup N] [--reps N] [--scale N] [--workers N] [--format csv|json] [--out FILE] [--baseline FILE] [--threshold PCT] [workload]...\n", argv[0]);
+            fprintf(stderr, "  --warmup N      : Untimed runs first (default: 3)\n");
+            fprintf(stderr, "  --reps N        : Timed runs (default: 20)\n");
+            fprintf(stderr, "  --scale N       : Multiply every loop count by N (default: 1)\n");
+            fprintf(stderr, "  --workers N     : Worker threads (default: one per CPU)\n");
+            fprintf(stderr, "  --format F      : csv (default) or json\n");
+            fprintf(stderr, "  --out FILE      : Write results to FILE (default: stdout)\n");
+            fprintf(stderr, "  --baseline FILE : Compare ns per instruction with an earlier CSV, exit 2\n");
+            fprintf(stderr, "                    if a workload got slower than the threshold\n");
+            fprintf(stderr, "  --threshold PCT : Slowdown counted as a regression (default: 5)\n");
+            fprintf(stderr, "Workloads:\n");
+            for(uint32_t i = 0; i < WORKLOAD_COUNT; i++) {
+                fprintf(stderr, "  %-10s: %s\n", workloads[i].name, workloads[i].about);
+            }
+            return 0;
+        }
+
+        if (strcmp(arg, "--warmup") == 0) {
+            valid = value && parse_count(value, 0, &warmup);
+        } else if (strcmp(arg, "--reps") == 0) {
+            valid = value && parse_count(value, 1, &reps);
+        } else if (strcmp(arg, "--scale") == 0) {
+            valid = value && parse_count(value, 1, &scale) && scale <= 100;
+        } else if (strcmp(arg, "--workers") == 0) {
+            valid = value && parse_count(value, 1, &nvm_workers) && nvm_workers <= 1024;
+        } else if (strcmp(arg, "--format") == 0) {
+            valid = value && (strcmp(value, "csv") == 0 || strcmp(value, "json") == 0);
+            format = value;
+        } else if (strcmp(arg, "--out") == 0) {
+            valid = value != NULL;
+            output = value;
+        } else if (strcmp(arg, "--baseline") == 0) {
+            valid = value != NULL;
+            baseline = value;
+        } else if (strcmp(arg, "--threshold") == 0) {
+            char* end;
+            valid = value && (threshold = strtod(value, &end)) >= 0 && *end == '\0' && *value != '\0';
+        } else {
+            // This should be a workload name
+            uint32_t i = 0;
+            while(i < WORKLOAD_COUNT && strcmp(workloads[i].name, arg) != 0) {
+                i++;
+            }
+            if (i == WORKLOAD_COUNT) {
+                fprintf(stderr, "Error: Unknown workload: %s\n", arg);
+                return 1;
+            }
+            selected[i] = any = true;
+            arg_index++;
+            continue;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Error: Invalid %s argument%s%s\n", arg, value ? ": " : "", value ? value : "");
+            return 1;
+        }
+        arg_index += 2;
+    }
+
+    // Keep the results and silence the programs
+    FILE* out = strcmp(output, "-") == 0 ? fdopen(dup(STDOUT_FILENO), "w") : fopen(output, "w");
+    int null = open("/dev/null", O_WRONLY);
+    if(!out || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Error: Cannot open output: '%s'\n", output);
+        return 1;
+    }
+    close(null);
+
+    log_set_output(LOG_OUTPUT_NONE, NULL);
+    nvm_console_policy = CONSOLE_FLUSH_FULL;
+    nvm_heap_initial = 1;
+
+    result_t results[WORKLOAD_COUNT];
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if(!any || selected[i]) {
+            measure(&workloads[i], scale, warmup, reps, &results[count++]);
+        }
+    }
+
+    if(strcmp(format, "json") == 0) {
+        write_json(out, results, count, reps);
+    } else {
+        write_csv(out, results, count, reps);
+    }
+    fclose(out);
+
+    if(baseline) {
+        int regressions = compare(baseline, results, count, threshold);
+        if(regressions != 0) {
+            return regressions < 0 ? 1 : 2;
+        }
+    }
+    return 0;
+}
@@ -5,674 +5,269 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 #include <syscall.h>
 #include <log.h>
 #include <nvm.h>
 #include <caps.h>
+#include <verify.h>
+#include <jit.h>
+#include <scheduler.h>
+#include <image.h>
+#include <console.h>
+#include <heap.h>
+#include <vector.h>
+#include <profile.h>
+#include <batch.h>
 
-nvm_process_t processes[MAX_PROCESSES];
-uint8_t current_process = 0;
-uint32_t timer_ticks = 0;
-
-void nvm_init() {
-    for(int i = 0; i < MAX_PROCESSES; i++) {
-        processes[i].active = false;
-        processes[i].sp = 0;
-        processes[i].ip = 0;
-        processes[i].exit_code = 0;
-        processes[i].caps_count = 0;
-    }
-}
-
-// Signature checking and process creation
-int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[], uint8_t caps_count) {
-    if(bytecode[0] != 0x4E || bytecode[1] != 0x56 || 
-       bytecode[2] != 0x4D || bytecode[3] != 0x30) {
-        LOG_WARN("Invalid NVM signature\n");
-        return -1;
-    }
-    
-    for(int i = 0; i < MAX_PROCESSES; i++) {
-        if(!processes[i].active) {
-            processes[i].bytecode = bytecode;
-            processes[i].ip = 4;
-            processes[i].size = size;
-            processes[i].sp = 0;
-            processes[i].active = true;
-            processes[i].exit_code = 0;
-            processes[i].pid = i;
-            processes[i].caps_count = 0;
-
-            // Initializing capabilities
-            for(int j = 0; j < caps_count && j < MAX_CAPS; j++) {
-                processes[i].capabilities[j] = initial_caps[j];
-            }
-            processes[i].caps_count = caps_count;
-            
-            for(int j = 0; j < MAX_LOCALS; j++) {
-                processes[i].locals[j] = 0;
-            }
-
-            return i;
-        }
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s [--log <output>] [--log-level <level>] [--flush <policy>] [--flush-size N] [--fuse <on|off>] [--jit <on|off>] [--workers N] [--call-depth N] [--heap N] [--simd K] [--profile FILE] [--profile-folded FILE] [--syscall-stats] [--batch PATH [--results FILE]] [--compile] <bytecode_file>...\n", argv[0]);
+        fprintf(stderr, "  --log file    : Log to 'nvm.log' file\n");
+        fprintf(stderr, "  --log stdio   : Log to stdout (default)\n");
+        fprintf(stderr, "  --log no      : Disable logging\n");
+        fprintf(stderr, "  --log-level L : Log up to level L: fatal, error, warn, info, debug, trace (default)\n");
+        fprintf(stderr, "  --flush P     : Write program output after every print (none), line (line),\n");
+        fprintf(stderr, "                  full buffer (full) or at exit (exit); default line on a\n");
+        fprintf(stderr, "                  terminal, full otherwise\n");
+        fprintf(stderr, "  --flush-size N: Bytes of output buffered before a write (default: %d)\n", CONSOLE_BUFFER);
+        fprintf(stderr, "  --fuse off    : Disable superinstruction fusion\n");
+        fprintf(stderr, "  --jit off     : Disable the JIT compiler\n");
+        fprintf(stderr, "  --workers N   : Worker threads (default: one per CPU)\n");
+        fprintf(stderr, "  --call-depth N: CALLF nesting allowed per process (default: 1024)\n");
+        fprintf(stderr, "  --heap N      : Pages of linear memory each process starts with (default: 0)\n");
+        fprintf(stderr, "  --simd K      : Vector kernels: avx2, sse2, scalar or auto (default)\n");
+        fprintf(stderr, "  --profile FILE: Count and time every instruction, write hot opcodes, blocks\n");
+        fprintf(stderr, "                  and functions to FILE at exit\n");
+        fprintf(stderr, "  --profile-folded FILE : Write folded call stacks for flamegraph.pl to FILE\n");
+        fprintf(stderr, "  --syscall-stats : Time syscalls and log their counts and times at exit\n");
+        fprintf(stderr, "  --batch PATH  : Run every *.nvm file of a directory, or every line of a\n");
+        fprintf(stderr, "                  manifest: file [caps [expected_exit_code]]\n");
+        fprintf(stderr, "  --results FILE: Write batch results to FILE (default: stdout)\n");
+        fprintf(stderr, "  --compile     : Write each prog.nvm verified and fused to prog.nvmc, which\n");
+        fprintf(stderr, "                  later runs of prog.nvm load instead while it is up to date\n");
+        fprintf(stderr, "Several bytecode files run as concurrent processes\n");
+        return 1;
     }
-    
-    LOG_WARN("No free process slots\n");
-    return -1;
-}
 
-// Execute one instruction
-bool nvm_execute_instruction(nvm_process_t* proc) {
-    if(proc->ip >= proc->size) {
-        LOG_WARN("Process %d: Instruction pointer out of bounds\n", proc->pid);
-        proc->exit_code = -1;
-        proc->active = false;
-        return false;
+    const char** filenames = malloc(argc * sizeof(const char*));
+    int file_count = 0;
+    if(!filenames) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
     }
-    
-    uint8_t opcode = proc->bytecode[proc->ip++];
-    
-    switch(opcode) {
-        // Basic:
-        case 0x00: // HALT
-            proc->active = false;
-            proc->exit_code = 0;
-            LOG_DEBUG("Process %d: Halted\n", proc->pid);
-            return false;
-        
-        case 0x01: // NOP
-            break;
-            
-        case 0x02: // PUSH
-            if(proc->ip + 3 < proc->size) {
-                uint32_t value = (proc->bytecode[proc->ip] << 24) |
-                                (proc->bytecode[proc->ip + 1] << 16) |
-                                (proc->bytecode[proc->ip + 2] << 8) |
-                                proc->bytecode[proc->ip + 3];
-                proc->ip += 4;
-                
-                if(proc->sp < STACK_SIZE) {
-                    proc->stack[proc->sp++] = (int32_t)value;
-                    
-                    // TODO: switch to core/kernel/log.h features
-                    /* char dbg[64];
-                    serial_print("DEBUG PUSH32: value=0x");
-                    itoa(value, dbg, 16);
-                    serial_print(dbg);
-                    serial_print(" (");
-                    itoa((int32_t)value, dbg, 10);
-                    serial_print(dbg);
-                    serial_print(") at ip=");
-                    itoa(proc->ip, dbg, 10);
-                    serial_print(dbg);
-                    serial_print("\n"); */
+    log_output_t log_output = LOG_OUTPUT_FILE;
+    bool flush_set = false;
+    const char* profile_report = NULL;
+    const char* profile_folded = NULL;
+    const char* batch = NULL;
+    const char* results = "-";
+    bool compile = false;
+    const char* log_filename = "nvm.log";
 
-                } else {
-                    LOG_WARN("Process %d: Stack overflow in PUSH32\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: Not enough bytes\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+    // Parse arguments
+    int arg_index = 1;
+    while (arg_index < argc) {
+        if (strcmp(argv[arg_index], "--log") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --log requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x04: // POP
-            if(proc->sp > 0) {
-                proc->sp--;
+            const char* log_arg = argv[arg_index + 1];
+            if (strcmp(log_arg, "file") == 0) {
+                log_output = LOG_OUTPUT_FILE;
+            } else if (strcmp(log_arg, "stdio") == 0) {
+                log_output = LOG_OUTPUT_STDOUT;
+            } else if (strcmp(log_arg, "no") == 0) {
+                log_output = LOG_OUTPUT_NONE;
             } else {
-                LOG_WARN("Process %d: Stack underflow in POP\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
-            }
-            break;
-
-        case 0x05: // DUP
-            if(proc->sp == 0) {
-                LOG_WARN("Process %d: Stack underflow in DUP\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
-            }
-            if(proc->sp >= STACK_SIZE) {
-                LOG_WARN("Process %d: Stack overflow in DUP\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+                fprintf(stderr, "Error: Invalid --log argument: %s\n", log_arg);
+                fprintf(stderr, "Valid options: file, stdio, no\n");
+                return 1;
             }
-            
-            proc->stack[proc->sp] = proc->stack[proc->sp - 1];
-            proc->sp++;
-            break;
-        
-        case 0x06: // SWAP
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                proc->stack[proc->sp - 2] = top;
-                proc->stack[proc->sp - 1] = second;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in SWAP\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--log-level") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --log-level requires an argument\n");
+                return 1;
             }
-            break;
 
-        // Arithmetic:
-        case 0x10: // ADD
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = top + second; 
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in ADD\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            int level = log_level_from_name(argv[arg_index + 1]);
+            if (level < 0) {
+                fprintf(stderr, "Error: Invalid --log-level argument: %s\n", argv[arg_index + 1]);
+                fprintf(stderr, "Valid options: fatal, error, warn, info, debug, trace\n");
+                return 1;
             }
-            break;
-
-        case 0x11: // SUB
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = second - top;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in SUB\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            log_set_level(level);
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--flush") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --flush requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x12: // MUL
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = second * top;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
+            const char* flush_arg = argv[arg_index + 1];
+            if (strcmp(flush_arg, "none") == 0) {
+                nvm_console_policy = CONSOLE_FLUSH_NONE;
+            } else if (strcmp(flush_arg, "line") == 0) {
+                nvm_console_policy = CONSOLE_FLUSH_LINE;
+            } else if (strcmp(flush_arg, "full") == 0) {
+                nvm_console_policy = CONSOLE_FLUSH_FULL;
+            } else if (strcmp(flush_arg, "exit") == 0) {
+                nvm_console_policy = CONSOLE_FLUSH_EXIT;
             } else {
-                LOG_WARN("Process %d: Stack underflow in MUL\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+                fprintf(stderr, "Error: Invalid --flush argument: %s\n", flush_arg);
+                fprintf(stderr, "Valid options: none, line, full, exit\n");
+                return 1;
             }
-            break;
-
-        case 0x13: // DIV
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result;
-
-                if(top != 0) {
-                    result = second / top;
-                    proc->stack[proc->sp - 2] = result;
-                    proc->sp--;
-                } else {
-                    LOG_WARN("Process %d: Zero division DIV. Terminate process. \n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: Stack underflow in DIV\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            flush_set = true;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--flush-size") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --flush-size requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x14: // MOD
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                
-                if (top == 0) {
-                    LOG_WARN("Process %d: Zero division MOD. Terminate process. \n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-
-                int32_t result = second % top;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in MOD\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            char* end;
+            long size = strtol(argv[arg_index + 1], &end, 10);
+            if (*argv[arg_index + 1] == '\0' || *end != '\0' || size < 1 || size > CONSOLE_BUFFER) {
+                fprintf(stderr, "Error: Invalid --flush-size argument: %s\n", argv[arg_index + 1]);
+                return 1;
             }
-            break;
-        
-        // Comparisons:
-        case 0x20: // CMP
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result;
-
-                if(second < top) {
-                    result = -1;
-                } else if (top == second) {
-                    result = 0;
-                } else {
-                    result = 1;
-                }
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in CMP\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            nvm_console_size = (uint32_t)size;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--fuse") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --fuse requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x21: // EQ
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = (top == second) ? 1 : 0;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
+            const char* fuse_arg = argv[arg_index + 1];
+            if (strcmp(fuse_arg, "on") == 0) {
+                nvm_fuse_enabled = true;
+            } else if (strcmp(fuse_arg, "off") == 0) {
+                nvm_fuse_enabled = false;
             } else {
-                LOG_WARN("Process %d: Stack underflow in EQ\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+                fprintf(stderr, "Error: Invalid --fuse argument: %s\n", fuse_arg);
+                fprintf(stderr, "Valid options: on, off\n");
+                return 1;
             }
-            break;
-
-        case 0x22: // NEQ
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = (top != second) ? 1 : 0;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in NEQ\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--jit") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --jit requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x23: // GT
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = (second > top) ? 1 : 0;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
+            const char* jit_arg = argv[arg_index + 1];
+            if (strcmp(jit_arg, "on") == 0) {
+                nvm_jit_enabled = true;
+            } else if (strcmp(jit_arg, "off") == 0) {
+                nvm_jit_enabled = false;
             } else {
-                LOG_WARN("Process %d: Stack underflow in GT\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+                fprintf(stderr, "Error: Invalid --jit argument: %s\n", jit_arg);
+                fprintf(stderr, "Valid options: on, off\n");
+                return 1;
             }
-            break;
-
-        case 0x24: // LT
-            if(proc->sp >= 2) {
-                int32_t top = proc->stack[proc->sp - 1];
-                int32_t second = proc->stack[proc->sp - 2];
-                int32_t result = (second < top) ? 1 : 0;
-                
-                proc->stack[proc->sp - 2] = result;
-                proc->sp--;
-            } else {
-                LOG_WARN("Process %d: Stack underflow in LT\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--workers") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --workers requires an argument\n");
+                return 1;
             }
-            break;
 
-        // Flow control (32-bit addresses):
-        case 0x30: // JMP
-            if(proc->ip + 3 < proc->size) {
-                uint32_t addr = (proc->bytecode[proc->ip] << 24) |
-                               (proc->bytecode[proc->ip + 1] << 16) |
-                               (proc->bytecode[proc->ip + 2] << 8) |
-                               proc->bytecode[proc->ip + 3];
-                proc->ip += 4;
-                
-                if(addr >= 4 && addr < proc->size) {
-                    proc->ip = addr;
-                } else {
-                    LOG_WARN("Process %d: Invalid address for JMP\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
+            char* end;
+            long count = strtol(argv[arg_index + 1], &end, 10);
+            if (*argv[arg_index + 1] == '\0' || *end != '\0' || count < 1 || count > 1024) {
+                fprintf(stderr, "Error: Invalid --workers argument: %s\n", argv[arg_index + 1]);
+                return 1;
             }
-            break;
-
-        case 0x31: // JZ
-            if (proc->sp > 0) {
-                int32_t value = proc->stack[--proc->sp];
-                if (proc->ip + 3 < proc->size) {
-                    uint32_t addr = (proc->bytecode[proc->ip] << 24) |
-                                   (proc->bytecode[proc->ip + 1] << 16) |
-                                   (proc->bytecode[proc->ip + 2] << 8) |
-                                   proc->bytecode[proc->ip + 3];
-                    proc->ip += 4;
-                    
-                    if (value == 0) {
-                        if (addr >= 4 && addr < proc->size) {
-                            proc->ip = addr;
-                        } else {
-                            LOG_WARN("Process %d: Invalid address for JZ\n", proc->pid);
-                            proc->exit_code = -1;
-                            proc->active = false;
-                            return false;
-                        }
-                    }
-                } else {
-                    LOG_WARN("Process %d: Not enough bytes for address JZ32\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: Stack underflow in JZ32\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            nvm_workers = (uint32_t)count;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--call-depth") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --call-depth requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x32: // JNZ
-            if (proc->sp > 0) {
-                int32_t value = proc->stack[--proc->sp];
-                if (proc->ip + 3 < proc->size) {
-                    uint32_t addr = (proc->bytecode[proc->ip] << 24) |
-                                   (proc->bytecode[proc->ip + 1] << 16) |
-                                   (proc->bytecode[proc->ip + 2] << 8) |
-                                   proc->bytecode[proc->ip + 3];
-                    proc->ip += 4;
-                    
-                    if (value != 0) {
-                        if (addr >= 4 && addr < proc->size) {
-                            proc->ip = addr;
-                        } else {
-                            LOG_WARN("Process %d: Invalid address for JNZ\n", proc->pid);
-                            proc->exit_code = -1;
-                            proc->active = false;
-                            return false;
-                        }
-                    }
-                } else {
-                    LOG_WARN("Process %d: Not enough bytes for address JNZ\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: Stack underflow in JNZ32\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            char* end;
+            long depth = strtol(argv[arg_index + 1], &end, 10);
+            if (*argv[arg_index + 1] == '\0' || *end != '\0' || depth < 1 || depth > CALL_DEPTH_MAX) {
+                fprintf(stderr, "Error: Invalid --call-depth argument: %s\n", argv[arg_index + 1]);
+                return 1;
             }
-            break;
-
-        case 0x33: // CALL
-            if(proc->ip + 3 < proc->size) {
-                int32_t addr = (proc->bytecode[proc->ip] << 24) |
-                               (proc->bytecode[proc->ip + 1] << 16) |
-                               (proc->bytecode[proc->ip + 2] << 8) |
-                               proc->bytecode[proc->ip + 3];
-                proc->ip += 4;
-                
-                if(proc->sp < STACK_SIZE - 1) {
-                    proc->stack[proc->sp++] = proc->ip;
-                    
-                    if(addr >= 4 && addr < proc->size) {
-                        proc->ip = addr;
-                    } else {
-                        LOG_WARN("Process %d: Invalid address for CALL\n", proc->pid);
-                        proc->exit_code = -1;
-                        proc->active = false;
-                        return false;
-                    }
-                } else {
-                    LOG_WARN("Process %d: Stack overflow in CALL\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: Not enough bytes for address CALL\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            nvm_call_depth = (uint32_t)depth;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--heap") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --heap requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x34: // RET
-            if(proc->sp > 0) {
-                uint32_t return_addr = (int32_t)proc->stack[--proc->sp];
-                
-                if(return_addr >= 4 && return_addr < proc->size) {
-                    proc->ip = return_addr;
-                } else {
-                    LOG_WARN("Process %d: invalid return address\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
-            } else {
-                LOG_WARN("Process %d: stack underflow in RET\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            char* end;
+            long pages = strtol(argv[arg_index + 1], &end, 10);
+            if (*argv[arg_index + 1] == '\0' || *end != '\0' || pages < 0 || pages > HEAP_MAX_PAGES) {
+                fprintf(stderr, "Error: Invalid --heap argument: %s\n", argv[arg_index + 1]);
+                return 1;
             }
-            break;
-
-        // Memory:
-        case 0x40: // LOAD
-            if(proc->ip < proc->size) {
-                uint8_t var_index = proc->bytecode[proc->ip++];
-                
-                if(var_index < MAX_LOCALS) {
-                    int32_t value = proc->locals[var_index];
-                    
-                    if(proc->sp < STACK_SIZE) {
-                        proc->stack[proc->sp++] = value;
-                    } else {
-                        LOG_WARN("Process %d: Stack overflow in LOAD\n", proc->pid);
-                        proc->exit_code = -1;
-                        proc->active = false;
-                        return false;
-                    }
-                } else {
-                    LOG_WARN("Process %d: invalid variable index in LOAD\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
+            nvm_heap_initial = (uint32_t)pages;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--simd") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: --simd requires an argument\n");
+                return 1;
             }
-            break;
 
-        case 0x41: // STORE
-            if(proc->ip < proc->size) {
-                uint8_t var_index = proc->bytecode[proc->ip++];
-                
-                if(var_index < MAX_LOCALS && proc->sp > 0) {
-                    int32_t value = proc->stack[--proc->sp];
-                    proc->locals[var_index] = value;
-                } else {
-                    LOG_WARN("Process %d: invalid index or stack underflow in STORE\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
+            if (!nvm_vector_select(argv[arg_index + 1])) {
+                fprintf(stderr, "Error: Vector kernels not available: %s\n", argv[arg_index + 1]);
+                return 1;
             }
-            break;
-
-        // Memory absolute access
-        case 0x45: // STORE_ABS - store to absolute memory address
-            if (!caps_has_capability(proc, CAP_DRV_ACCESS)) {
-                LOG_WARN("Procces %d: Required caps not receivedn\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--profile") == 0 ||
+                   strcmp(argv[arg_index], "--profile-folded") == 0) {
+            if (arg_index + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires an argument\n", argv[arg_index]);
+                return 1;
             }
 
-            if(proc->sp >= 2) {
-                uint32_t addr = (uint32_t)proc->stack[proc->sp - 2]; // address
-                int32_t value = proc->stack[proc->sp - 1]; // value
-
-                if((addr >= 0x100000 && addr < 0xFFFFFFFF) || 
-                (addr >= 0xB8000 && addr <= 0xB8FA0)) {
-                    // Special handling for VGA text buffer - write only 16 bits (char + attribute)
-                    if (addr >= 0xB8000 && addr <= 0xB8FA0) {
-                        *(uint16_t*)addr = (uint16_t)(value & 0xFFFF);
-                    } else {
-                        *(int32_t*)addr = value;
-                    }
-                    proc->sp -= 2;
-                } else {
-                    LOG_WARN("Procces %d: Invalid memory address in STORE_ABS\n", proc->pid);
-                    proc->exit_code = -1;
-                    proc->active = false;
-                    return false;
-                }
+            if (strcmp(argv[arg_index], "--profile") == 0) {
+                profile_report = argv[arg_index + 1];
             } else {
-                LOG_WARN("Procces %d: Stack underflow in STORE_ABS\n", proc->pid);
-                proc->exit_code = -1;
-                proc->active = false;
-                return false;
-            }
-            break;
-
-        // System calls:
-        case 0x50: // SYSCALL
-            if(proc->ip < proc->size) {
-                uint8_t syscall_id = proc->bytecode[proc->ip++];
-                syscall_handler(syscall_id, proc);
-            }
-            break;
-
-        // System calls:
-        case 0x51: // BREAK
-            LOG_DEBUG("Process %d: Stop from BREAK at IP=%d, SP=%d\n", proc->pid, proc->ip, proc->sp);
-            break;
-            
-        default:
-            char buffer[32];
-            LOG_WARN("Process %d: Unknown opcode: 0x%s", proc->pid, buffer);
-            proc->exit_code = -1;
-            proc->active = false;
-            return false;
-    }
-    
-    return true;
-}
-
-void nvm_execute(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count) {
-    int pid = nvm_create_process(bytecode, size, capabilities, caps_count);
-    if(pid >= 0) {
-        LOG_INFO("NVM process started with PID: %d\n", pid);
-
-        // Execute the process until completion
-        while(processes[pid].active) {
-            if(!nvm_execute_instruction(&processes[pid])) {
-                break;
+                profile_folded = argv[arg_index + 1];
             }
-        }
-
-        LOG_INFO("NVM process %d finished with exit code: %d\n", pid, processes[pid].exit_code);
-    } else {
-        LOG_ERROR("Failed to create NVM process\n");
-    }
-}
-
-// Function for get exit code
-int32_t nvm_get_exit_code(uint8_t pid) {
-    if(pid < MAX_PROCESSES && !processes[pid].active) {
-        return processes[pid].exit_code;
-    }
-    return -1;
-}
-
-// Function for check process activity
-bool nvm_is_process_active(uint8_t pid) {
-    if(pid < MAX_PROCESSES) {
-        return processes[pid].active;
-    }
-    return false;
-}
-
-int main(int argc, char* argv[]) {
-    if(argc < 2 || argc > 4) {
-        fprintf(stderr, "Usage: %s [--log <output>] <bytecode_file>\n", argv[0]);
-        fprintf(stderr, "  --log file    : Log to 'nvm.log' file\n");
-        fprintf(stderr, "  --log stdio   : Log to stdout (default)\n");
-        fprintf(stderr, "  --log no      : Disable logging\n");
-        return 1;
-    }
-
-    const char* filename = NULL;
-    log_output_t log_output = LOG_OUTPUT_FILE;
-    const char* log_filename = "nvm.log";
-
-    // Parse arguments
-    int arg_index = 1;
-    while (arg_index < argc) {
-        if (strcmp(argv[arg_index], "--log") == 0) {
+            arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--batch") == 0 ||
+                   strcmp(argv[arg_index], "--results") == 0) {
             if (arg_index + 1 >= argc) {
-                fprintf(stderr, "Error: --log requires an argument\n");
+                fprintf(stderr, "Error: %s requires an argument\n", argv[arg_index]);
                 return 1;
             }
 
-            const char* log_arg = argv[arg_index + 1];
-            if (strcmp(log_arg, "file") == 0) {
-                log_output = LOG_OUTPUT_FILE;
-            } else if (strcmp(log_arg, "stdio") == 0) {
-                log_output = LOG_OUTPUT_STDOUT;
-            } else if (strcmp(log_arg, "no") == 0) {
-                log_output = LOG_OUTPUT_NONE;
+            if (strcmp(argv[arg_index], "--batch") == 0) {
+                batch = argv[arg_index + 1];
             } else {
-                fprintf(stderr, "Error: Invalid --log argument: %s\n", log_arg);
-                fprintf(stderr, "Valid options: file, stdio, no\n");
-                return 1;
+                results = argv[arg_index + 1];
             }
             arg_index += 2;
+        } else if (strcmp(argv[arg_index], "--compile") == 0) {
+            compile = true;
+            arg_index++;
+        } else if (strcmp(argv[arg_index], "--syscall-stats") == 0) {
+            nvm_syscall_timing = true;
+            arg_index++;
         } else {
-            // This should be the filename
-            if (filename != NULL) {
-                fprintf(stderr, "Error: Multiple filenames specified\n");
-                return 1;
-            }
-            filename = argv[arg_index];
+            // This should be a filename
+            filenames[file_count++] = argv[arg_index];
             arg_index++;
         }
     }
 
-    if (filename == NULL) {
+    if (batch && file_count > 0) {
+        fprintf(stderr, "Error: --batch takes no bytecode files\n");
+        return 1;
+    }
+    if (!batch && file_count == 0) {
         fprintf(stderr, "Error: No bytecode file specified\n");
         return 1;
     }
@@ -680,51 +275,101 @@ int main(int argc, char* argv[]) {
     // Configure logging
     log_set_output(log_output, log_filename);
 
-    // Open and read the bytecode file
-    FILE* file = fopen(filename, "rb");
-    if(!file) {
-        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
-        return 1;
+    // Like stdio: whole lines on a terminal, full buffers otherwise
+    if (!flush_set) {
+        nvm_console_policy = isatty(STDOUT_FILENO) ? CONSOLE_FLUSH_LINE : CONSOLE_FLUSH_FULL;
     }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    if(file_size < 4) {
-        fprintf(stderr, "Error: File too small to contain NVM bytecode\n");
-        fclose(file);
+    if ((profile_report || profile_folded) && !nvm_profile_open(profile_report, profile_folded)) {
+        fprintf(stderr, "Error: Cannot open profile output\n");
         return 1;
     }
 
-    // Allocate memory for bytecode
-    int8_t* bytecode = (int8_t*)malloc(file_size);
-    if(!bytecode) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        fclose(file);
-        return 1;
+    if (compile) {
+        int status = 0;
+        for(int i = 0; i < file_count; i++) {
+            size_t len = strlen(filenames[i]);
+            char* output = malloc(len + 6);
+            if(!output) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                return 1;
+            }
+            bool sidecar = len >= 4 && strcmp(filenames[i] + len - 4, ".nvm") == 0;
+            sprintf(output, sidecar ? "%sc" : "%s.nvmc", filenames[i]);
+
+            const char* error;
+            nvm_image_t* image = nvm_image_open(filenames[i], &error);
+            if(!image || !nvm_image_compile(image, output, &error)) {
+                fprintf(stderr, "Error: %s: '%s'\n", error, filenames[i]);
+                status = 1;
+            }
+            if(image) {
+                nvm_image_release(image);
+            }
+            free(output);
+        }
+        free(filenames);
+        return status;
     }
 
-    // Read the file
-    size_t bytes_read = fread(bytecode, 1, file_size, file);
-    fclose(file);
+    if (batch) {
+        const char* error;
+        if (!nvm_batch_load(batch, &error)) {
+            fprintf(stderr, "Error: %s: '%s'\n", error, batch);
+            return 1;
+        }
 
-    if(bytes_read != (size_t)file_size) {
-        fprintf(stderr, "Error: Failed to read entire file\n");
-        free(bytecode);
+        nvm_init();
+        nvm_batch_start();
+        nvm_scheduler_run();
+        nvm_stop_blocked();
+        if (nvm_syscall_timing) {
+            nvm_syscall_dump();
+        }
+        nvm_profile_close();
+
+        free(filenames);
+        return nvm_batch_report(results) ? 0 : 1;
+    }
+
+    // Map all bytecode files before anything runs; identical files share
+    // one image
+    nvm_image_t** images = malloc(file_count * sizeof(nvm_image_t*));
+    if(!images) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
         return 1;
     }
+    for(int i = 0; i < file_count; i++) {
+        const char* error;
+        images[i] = nvm_image_open(filenames[i], &error);
+        if(!images[i]) {
+            fprintf(stderr, "Error: %s: '%s'\n", error, filenames[i]);
+            while(i-- > 0) {
+                nvm_image_release(images[i]);
+            }
+            return 1;
+        }
+    }
 
     // Initialize NVM
     nvm_init();
 
-    // Execute the bytecode with no special capabilities
-    int16_t capabilities[1] = {CAPS_NONE};
-    nvm_execute(bytecode, file_size, capabilities, 1);
+    // Start every image with no special capabilities and run them together
+    uint16_t capabilities[1] = {CAPS_NONE};
+    for(int i = 0; i < file_count; i++) {
+        nvm_spawn_image(images[i], capabilities, 1);
+        nvm_image_release(images[i]);
+    }
+    nvm_scheduler_run();
+    nvm_stop_blocked();
+    if (nvm_syscall_timing) {
+        nvm_syscall_dump();
+    }
+    nvm_profile_close();
 
     // Cleanup
-    free(bytecode);
+    free(images);
+    free(filenames);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#!/bin/sh
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Runs every test program on the default build and compares it with the
+# legacy nvm_execute_instruction loop (NVM_THREADED=0), the switch dispatch
+# (NVM_NO_COMPUTED_GOTO) and --fuse off. Every core has to end every program
+# the same way.
+
+. "$(dirname "$0")/lib.sh"
+
+build_nvm default
+build_nvm legacy -DNVM_THREADED=0
+build_nvm switch -DNVM_NO_COMPUTED_GOTO
+
+for asm in "$root"/test/*.asm; do
+    nvm=$(assemble "$asm")
+    compare "NVM_THREADED=0" "$nvm" "$work/default/nvm" "--heap 1" "$work/legacy/nvm" "--heap 1"
+    compare "NVM_NO_COMPUTED_GOTO" "$nvm" "$work/default/nvm" "--heap 1" "$work/switch/nvm" "--heap 1"
+    compare "--fuse off" "$nvm" "$work/default/nvm" "--heap 1" "$work/default/nvm" "--heap 1 --fuse off"
+done
+
+finish cores
@@ -0,0 +1,18 @@
+#!/bin/sh
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Runs programs from test/jitfuzz.py with --jit on and --jit off. Their loops
+# pass NVM_JIT_THRESHOLD, so the first run spends most of its time in native
+# code. JIT_CASES programs are generated from JIT_SEED (200 and 1 by default).
+
+. "$(dirname "$0")/lib.sh"
+
+build_nvm default
+python3 "$root/test/jitfuzz.py" "$work/jit" "${JIT_CASES:-200}" "${JIT_SEED:-1}" || exit 1
+
+for asm in "$work"/jit/*.asm; do
+    nvm=$(assemble "$asm")
+    compare "--jit off" "$nvm" "$work/default/nvm" "--heap 1 --jit on" "$work/default/nvm" "--heap 1 --jit off"
+done
+
+finish jit
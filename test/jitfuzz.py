@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Generator for the JIT test programs.
+#
+# Every program runs a loop between 1000 and 4000 times, so it passes
+# NVM_JIT_THRESHOLD and most iterations run as native code. The loop body is
+# a random list of statements that each leave the stack as they found it:
+# arithmetic on locals 1..7, checked and wide arithmetic, forward branches,
+# CALL/RET and CALLF/RETF subroutines with frames, linear memory and vector
+# opcodes on the first page, and a PRINT or BREAK every few hundred
+# iterations. Division by zero, overflow in a checked opcode or an access past
+# the first page stops a process part way through the loop, which exercises
+# the JIT's exits as well. The loop ends by printing all locals.
+#
+#   jitfuzz.py DIR COUNT [SEED]
+#
+# writes DIR/jit_000.asm and so on; the same seed gives the same programs.
+
+import os
+import random
+import sys
+
+LOCALS = range(1, 8)
+COUNTER = 0
+VALUES = [0, 1, 2, 3, 7, -1, -5, 100, 255, 65536, 0x7FFFFFFF, -0x80000000]
+BINARY = ["add", "sub", "mul", "div", "mod", "cmp", "eq", "neq", "gt", "lt", "addc", "subc", "mulc",
+          "divc", "modc"]
+COMPARE = ["gt", "lt", "eq", "neq"]
+
+
+class Program:
+    def __init__(self, rng):
+        self.rng = rng
+        self.labels = 0
+        self.subroutines = []
+
+    def label(self):
+        self.labels += 1
+        return "l%d" % self.labels
+
+    def local(self):
+        return self.rng.choice(LOCALS)
+
+    def value(self):
+        if self.rng.random() < 0.5:
+            return self.rng.choice(VALUES)
+        return self.rng.randint(-50, 50)
+
+    def operand(self):
+        if self.rng.random() < 0.6:
+            return ["load %d" % self.local()]
+        return ["push %d" % self.value()]
+
+    # Addresses stay mostly inside the first 64 KiB page
+    def address(self):
+        if self.rng.random() < 0.02:
+            return ["push %d" % self.rng.choice([65536, 65535, -4])]
+        return ["load %d" % self.local(), "push 4000", "mod", "dup", "mul", "push 60000", "mod"]
+
+    # Every 256th iteration, or every 512th with a different offset
+    def now_and_then(self, body):
+        end = self.label()
+        mask = self.rng.choice([255, 511])
+        return ["load %d" % COUNTER, "push %d" % (mask + 1), "mod", "push %d" % self.rng.randint(0, mask),
+                "eq", "jz %s" % end] + body + ["%s:" % end]
+
+    def statement(self, depth=0):
+        r = self.rng.random()
+        if r < 0.30:
+            return self.operand() + self.operand() + [self.rng.choice(BINARY), "store %d" % self.local()]
+        if r < 0.38:
+            n = self.local()
+            return ["load %d" % n, "push %d" % self.rng.randint(-3, 3),
+                    self.rng.choice(["add", "sub"]), "store %d" % n]
+        if r < 0.45:
+            return ["load %d" % self.local(), "dup", "mul", "load %d" % self.local(), "swap", "sub",
+                    "store %d" % self.local()]
+        if r < 0.50:
+            return self.operand() + self.operand() + ["%s %d" % (self.rng.choice(["fmul", "fdiv"]), self.rng.randint(0, 31)),
+                                                      "store %d" % self.local()]
+        if r < 0.56:
+            op = self.rng.choice(["add64", "sub64", "mul64", "div64", "mod64", "add64c", "sub64c", "mul64c",
+                                  "div64c", "mod64c"])
+            return (self.operand() + self.operand() + self.operand() + self.operand() +
+                    [op, "store %d" % self.local(), "store %d" % self.local()])
+        if r < 0.59:
+            return (self.operand() + ["ext64"] + self.operand() + ["ext64", "cmp64", "store %d" % self.local()])
+        if r < 0.66 and depth < 2:
+            skip = self.label()
+            body = []
+            for _ in range(self.rng.randint(1, 3)):
+                body += self.statement(depth + 1)
+            return (["load %d" % self.local(), "push %d" % self.value(), self.rng.choice(COMPARE),
+                     "%s %s" % (self.rng.choice(["jz", "jnz"]), skip)] + body + ["%s:" % skip])
+        if r < 0.71 and depth < 2:
+            return self.subroutine(depth)
+        if r < 0.78:
+            return self.address() + self.operand() + [self.rng.choice(["store8", "store16", "store32"])]
+        if r < 0.84:
+            return self.address() + [self.rng.choice(["load8", "load16", "load32"]), "store %d" % self.local()]
+        if r < 0.87:
+            n = ["push %d" % self.rng.randint(0, 40)]
+            op = self.rng.choice(["memcpy", "memset", "memcmp"])
+            code = self.address() + (self.address() if op != "memset" else self.operand()) + n + [op]
+            return code + (["store %d" % self.local()] if op == "memcmp" else [])
+        if r < 0.92:
+            n = ["push %d" % self.rng.choice([0, 1, 3, 4, 7, 8, 9, 17, 33])]
+            op = self.rng.choice(["vadd", "vsub", "vmul", "vmin", "vmax", "vsum", "vrmin", "vrmax", "vdot",
+                                  "vcounteq", "vcountgt", "vcountlt"])
+            if op in ("vadd", "vsub", "vmul", "vmin", "vmax"):
+                return self.address() + self.address() + self.address() + n + [op]
+            if op == "vdot":
+                return self.address() + self.address() + n + [op, "store %d" % self.local()]
+            if op.startswith("vcount"):
+                return self.address() + n + self.operand() + [op, "store %d" % self.local()]
+            return self.address() + n + [op, "store %d" % self.local()]
+        if r < 0.96:
+            return self.now_and_then(["load %d" % self.local(), "push 26", "mod", "dup", "mul", "push 26", "mod",
+                                      "push 97", "add", "syscall print"])
+        return self.now_and_then(self.operand() + ["break", "pop"])
+
+    def subroutine(self, depth):
+        name = self.label()
+        body = []
+        for _ in range(self.rng.randint(1, 4)):
+            body += self.statement(depth + 1)
+        if self.rng.random() < 0.5:
+            # Return address on the data stack
+            self.subroutines.append(["%s:" % name] + body + ["ret"])
+            return ["call %s" % name]
+        frame = self.rng.randint(1, 4)
+        slot = self.rng.randrange(frame)
+        self.subroutines.append(["%s:" % name, "enter %d" % frame] + self.operand() +
+                                ["storef %d" % slot] + body +
+                                ["loadf %d" % slot, "store %d" % self.local(), "leave", "retf"])
+        return ["callf %s" % name]
+
+    def generate(self):
+        code = [".NVM0"]
+        code += ["push %d" % self.rng.randint(1000, 4000), "store %d" % COUNTER]
+        for n in LOCALS:
+            code += ["push %d" % self.value(), "store %d" % n]
+        code += ["loop:"]
+        for _ in range(self.rng.randint(2, 12)):
+            code += self.statement()
+        code += ["load %d" % COUNTER, "push 1", "sub", "store %d" % COUNTER,
+                 "load %d" % COUNTER, "push 0", "gt", "jnz loop",
+                 "push 1", "push 7", "syscall print_locals",
+                 "load 1", "syscall exit"]
+        for subroutine in self.subroutines:
+            code += subroutine
+        return "\n".join(code) + "\n"
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (3, 4):
+        sys.exit("usage: jitfuzz.py DIR COUNT [SEED]")
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) == 4 else 1)
+    os.makedirs(sys.argv[1], exist_ok=True)
+    for i in range(int(sys.argv[2])):
+        with open(os.path.join(sys.argv[1], "jit_%03d.asm" % i), "w") as out:
+            out.write(Program(rng).generate())
@@ -0,0 +1,61 @@
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Shared by the test scripts: builds nvm variants from the sources, assembles
+# the test programs and compares how runs under two configurations ended.
+#
+# A run is recorded as its output, its log without the timing and fusion
+# lines and the exit status of nvm, so two runs compare equal only if the
+# programs printed the same, stopped at the same BREAKs and exited with the
+# same codes.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d "${TMPDIR:-/tmp}/nvm-test.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+failures=0
+runs=0
+
+# build_nvm NAME [CFLAGS...]: builds $work/NAME/nvm
+build_nvm() {
+    local name=$1
+    shift
+    mkdir -p "$work/$name"
+    ${CC:-gcc} -I"$root/lib" -Wall -pthread $TEST_CFLAGS "$@" "$root/src/main.c" "$root"/lib/*.c \
+        -o "$work/$name/nvm" || exit 1
+}
+
+# assemble FILE.asm: assembles into $work and prints the path of the bytecode
+assemble() {
+    local out="$work/$(basename "$1" .asm).nvm"
+    python3 "$root/test/nvmasm.py" "$1" "$out" || exit 1
+    echo "$out"
+}
+
+# record OUT NVM FILE [ARGS...]: runs FILE and writes what happened to OUT
+record() {
+    local out=$1 nvm=$2 file=$3 dir
+    shift 3
+    dir=$(mktemp -d "$work/run.XXXXXX")
+    (cd "$dir" && timeout "${TEST_TIMEOUT:-20}" "$nvm" --log file "$@" "$file" > output 2>&1; echo "status $?" >> output)
+    { cat "$dir/output"; grep -av -e "CPU time" -e "Fused" "$dir/nvm.log"; } > "$out"
+    rm -rf "$dir"
+}
+
+# compare LABEL FILE NVM-A "ARGS-A" NVM-B "ARGS-B": runs FILE both ways and reports a difference
+compare() {
+    local label=$1 file=$2
+    record "$work/a" "$3" "$file" $4
+    record "$work/b" "$5" "$file" $6
+    runs=$((runs + 1))
+    if ! cmp -s "$work/a" "$work/b"; then
+        echo "FAIL $label: $(basename "$file")"
+        diff "$work/a" "$work/b" | head -20
+        failures=$((failures + 1))
+    fi
+}
+
+# finish NAME: prints the totals and exits non-zero after any failure
+finish() {
+    echo "$1: $runs runs, $failures failed"
+    [ "$failures" -eq 0 ]
+    exit
+}
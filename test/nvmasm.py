@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Assembler for the test programs.
+#
+# Reads the NVMa subset the programs in this directory use: a ".NVM0" header,
+# one instruction per line, "name:" labels and ";" comments. Operands are
+# numbers, labels or, for SYSCALL, syscall names. Writes the bytecode to the
+# output file, or to stdout.
+
+import struct
+import sys
+
+OPCODES = {
+    "halt": (0x00, 0), "nop": (0x01, 0), "push": (0x02, 4), "pop": (0x04, 0),
+    "dup": (0x05, 0), "swap": (0x06, 0),
+    "add": (0x10, 0), "sub": (0x11, 0), "mul": (0x12, 0), "div": (0x13, 0), "mod": (0x14, 0),
+    "cmp": (0x20, 0), "eq": (0x21, 0), "neq": (0x22, 0), "gt": (0x23, 0), "lt": (0x24, 0),
+    "jmp": (0x30, 4), "jz": (0x31, 4), "jnz": (0x32, 4), "call": (0x33, 4), "ret": (0x34, 0),
+    "callf": (0x35, 4), "retf": (0x36, 0), "enter": (0x37, 1), "leave": (0x38, 0),
+    "load": (0x40, 1), "store": (0x41, 1), "loadf": (0x42, 1), "storef": (0x43, 1),
+    "store_abs": (0x45, 0),
+    "load8": (0x46, 0), "load16": (0x47, 0), "load32": (0x48, 0),
+    "store8": (0x49, 0), "store16": (0x4A, 0), "store32": (0x4B, 0),
+    "memcpy": (0x4C, 0), "memset": (0x4D, 0), "memcmp": (0x4E, 0),
+    "syscall": (0x50, 1), "break": (0x51, 0),
+    "vadd": (0x60, 0), "vsub": (0x61, 0), "vmul": (0x62, 0), "vmin": (0x63, 0), "vmax": (0x64, 0),
+    "vsum": (0x68, 0), "vrmin": (0x69, 0), "vrmax": (0x6A, 0), "vdot": (0x6B, 0),
+    "vcounteq": (0x6C, 0), "vcountgt": (0x6D, 0), "vcountlt": (0x6E, 0),
+    "add64": (0x70, 0), "sub64": (0x71, 0), "mul64": (0x72, 0), "div64": (0x73, 0),
+    "mod64": (0x74, 0), "cmp64": (0x75, 0), "ext64": (0x76, 0),
+    "addc": (0x78, 0), "subc": (0x79, 0), "mulc": (0x7A, 0),
+    "add64c": (0x7B, 0), "sub64c": (0x7C, 0), "mul64c": (0x7D, 0),
+    "fmul": (0x7E, 1), "fdiv": (0x7F, 1),
+    "divc": (0x80, 0), "modc": (0x81, 0), "div64c": (0x82, 0), "mod64c": (0x83, 0),
+}
+
+SYSCALLS = {
+    "exit": 0x00, "print": 0x0E, "print_stack": 0x0F, "print_locals": 0x10,
+    "send": 0x20, "receive": 0x21, "try_receive": 0x22, "receive_timeout": 0x23,
+    "grant": 0x28, "revoke": 0x29, "fork": 0x2C, "time": 0x30, "random": 0x31,
+    "mem_grow": 0x38, "mem_size": 0x39,
+}
+
+
+def fail(name, number, message):
+    sys.exit("%s:%d: %s" % (name, number, message))
+
+
+def assemble(source, name="-"):
+    # First pass: instruction offsets and labels
+    labels = {}
+    lines = []
+    offset = 4
+    for number, line in enumerate(source.splitlines(), 1):
+        line = line.split(";", 1)[0].strip()
+        if not line or line.startswith("."):
+            continue
+        while ":" in line:
+            label, line = line.split(":", 1)
+            if label.strip() in labels:
+                fail(name, number, "duplicate label '%s'" % label.strip())
+            labels[label.strip()] = offset
+            line = line.strip()
+        if not line:
+            continue
+        fields = line.split()
+        mnemonic = fields[0].lower()
+        if mnemonic not in OPCODES:
+            fail(name, number, "unknown instruction '%s'" % fields[0])
+        opcode, size = OPCODES[mnemonic]
+        if len(fields) != (2 if size else 1):
+            fail(name, number, "'%s' takes %s operand" % (mnemonic, "one" if size else "no"))
+        lines.append((number, opcode, size, fields[1:]))
+        offset += 1 + size
+
+    # Second pass: encode
+    out = bytearray(b"NVM0")
+    for number, opcode, size, operands in lines:
+        out.append(opcode)
+        if not size:
+            continue
+        operand = operands[0]
+        if operand in labels:
+            value = labels[operand]
+        elif opcode == 0x50 and operand.lower() in SYSCALLS:
+            value = SYSCALLS[operand.lower()]
+        else:
+            try:
+                value = int(operand, 0)
+            except ValueError:
+                fail(name, number, "unknown label '%s'" % operand)
+        if size == 4:
+            if not -0x80000000 <= value <= 0xFFFFFFFF:
+                fail(name, number, "operand out of range: %s" % operand)
+            out += struct.pack(">I", value & 0xFFFFFFFF)
+        else:
+            if not -0x80 <= value <= 0xFF:
+                fail(name, number, "operand out of range: %s" % operand)
+            out.append(value & 0xFF)
+    return bytes(out)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        sys.exit("usage: nvmasm.py FILE.asm [FILE.nvm]")
+    with open(sys.argv[1]) as source:
+        code = assemble(source.read(), sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "wb") as out:
+            out.write(code)
+    else:
+        sys.stdout.buffer.write(code)
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// Snapshot decoding through the embedding API.
+//
+// A process is stopped inside a CALLF, snapshotted and encoded. With an
+// empty stack, no frames and no linear memory the call stack is the last
+// slot of the buffer, so each case overwrites the return offset there and
+// checks whether nvm_snapshot_decode takes it. Snapshots that decode are
+// restored and run to their end.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <vm.h>
+
+static const uint8_t program[] = {
+    'N', 'V', 'M', '0',
+    0x35, 0x00, 0x00, 0x00, 0x10,   //  4: callf 16
+    0x02, 0x00, 0x00, 0x00, 0x2A,   //  9: push 42
+    0x50, 0x00,                     // 14: syscall exit
+    0x36,                           // 16: retf
+};
+
+static int runs = 0;
+static int failures = 0;
+
+// Decode `data` with its return offset set to `ret`. A snapshot that is
+// accepted has to run to exit code `expected`.
+static void check(nvm_vm_t* vm, nvm_image_t* image, const uint8_t* data, uint32_t size,
+                  uint32_t ret, bool accept, int32_t expected) {
+    uint8_t* forged = malloc(size);
+    memcpy(forged, data, size);
+    memcpy(forged + size - sizeof(uint32_t), &ret, sizeof(uint32_t));
+
+    const char* error = NULL;
+    nvm_snapshot_t* snap = nvm_snapshot_decode(image, forged, size, &error);
+    free(forged);
+    runs++;
+
+    if(!snap) {
+        if(accept) {
+            printf("FAIL return offset %u: rejected (%s)\n", ret, error);
+            failures++;
+        }
+        return;
+    }
+    if(!accept) {
+        printf("FAIL return offset %u: accepted\n", ret);
+        failures++;
+        nvm_snapshot_free(snap);
+        return;
+    }
+
+    int pid = nvm_vm_restore(vm, snap);
+    nvm_snapshot_free(snap);
+    if(pid < 0) {
+        printf("FAIL return offset %u: cannot restore\n", ret);
+        failures++;
+        return;
+    }
+    while(nvm_vm_run(vm, (uint32_t)pid, 1000) == NVM_VM_READY) {
+    }
+    int32_t code = nvm_vm_exit_code(vm, (uint32_t)pid);
+    nvm_vm_release(vm, (uint32_t)pid);
+    if(code != expected) {
+        printf("FAIL return offset %u: exit code %d, expected %d\n", ret, code, expected);
+        failures++;
+    }
+}
+
+int main() {
+    nvm_vm_t* vm = nvm_vm_create();
+    nvm_image_t* image = nvm_image_load(program, sizeof(program));
+    if(!vm || !image) {
+        printf("FAIL cannot load the program\n");
+        return 1;
+    }
+
+    // Stop right after the CALLF
+    int pid = nvm_vm_spawn(vm, image, NULL, 0);
+    if(pid < 0 || nvm_vm_step(vm, (uint32_t)pid, 1) != NVM_VM_READY) {
+        printf("FAIL cannot start the program\n");
+        return 1;
+    }
+    nvm_snapshot_t* snap = nvm_vm_snapshot(vm, (uint32_t)pid);
+    nvm_vm_release(vm, (uint32_t)pid);
+
+    uint32_t size;
+    uint8_t* data = snap ? nvm_snapshot_encode(snap, &size) : NULL;
+    if(!data) {
+        printf("FAIL cannot encode the snapshot\n");
+        return 1;
+    }
+    nvm_snapshot_free(snap);
+
+    check(vm, image, data, size, 9, true, 42);          // As taken
+    check(vm, image, data, size, 14, true, 0);          // Another instruction
+    check(vm, image, data, size, 5, false, 0);          // Inside the CALLF operand
+    check(vm, image, data, size, 10, false, 0);         // Inside the PUSH operand
+    check(vm, image, data, size, 3, false, 0);          // In the header
+    check(vm, image, data, size, sizeof(program), false, 0);
+
+    free(data);
+    nvm_image_release(image);
+    nvm_vm_destroy(vm);
+
+    printf("snapshot: %d runs, %d failed\n", runs, failures);
+    return failures == 0 ? 0 : 1;
+}
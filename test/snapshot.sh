@@ -0,0 +1,12 @@
+#!/bin/sh
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Builds test/snapshot.c against the library and runs it: snapshots with
+# forged call stacks have to be rejected by nvm_snapshot_decode, the others
+# have to restore and run to the end.
+
+. "$(dirname "$0")/lib.sh"
+
+${CC:-gcc} -I"$root/lib" -Wall -pthread $TEST_CFLAGS "$root/test/snapshot.c" "$root"/lib/*.c \
+    -o "$work/snapshot" || exit 1
+(cd "$work" && timeout "${TEST_TIMEOUT:-20}" ./snapshot)
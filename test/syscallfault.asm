@@ -0,0 +1,28 @@
+.NVM0
+; A syscall that fails stops the process on every core
+; Prints "ok" 1500 times (hot enough for the JIT), then asks
+; print_stack for more values than the stack holds
+
+push 1500
+store 0
+
+loop:
+    push 111
+    push 107
+    push 2
+    syscall print_stack
+    load 0
+    push 1
+    sub
+    store 0
+    load 0
+    push 0
+    gt
+    jnz loop
+
+push 65
+push 5
+syscall print_stack     ; fails, only 1 value below the count
+
+push 7
+syscall exit            ; not reached, exits with -1
@@ -0,0 +1,37 @@
+#!/bin/sh
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+# Runs the vector test programs with --simd scalar and compares them with the
+# SSE2 and AVX2 kernels, skipping a set this CPU or build lacks. The programs
+# also check their results and exit with the number of wrong ones, which has
+# to be 0 on the scalar kernels.
+
+. "$(dirname "$0")/lib.sh"
+
+build_nvm default
+nvm="$work/default/nvm"
+
+kernels=""
+for simd in sse2 avx2; do
+    if "$nvm" --log no --simd $simd /dev/null 2>&1 | grep -q "not available"; then
+        echo "skipping --simd $simd"
+    else
+        kernels="$kernels $simd"
+    fi
+done
+
+for asm in "$root"/test/vector_*.asm; do
+    program=$(assemble "$asm")
+    record "$work/scalar" "$nvm" "$program" --heap 1 --simd scalar
+    runs=$((runs + 1))
+    if ! grep -q "finished with exit code: 0$" "$work/scalar"; then
+        echo "FAIL --simd scalar: $(basename "$program")"
+        grep -a "exit code" "$work/scalar"
+        failures=$((failures + 1))
+    fi
+    for simd in $kernels; do
+        compare "--simd $simd" "$program" "$nvm" "--heap 1 --simd scalar" "$nvm" "--heap 1 --simd $simd"
+    done
+done
+
+finish vector
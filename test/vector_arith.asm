@@ -0,0 +1,1490 @@
+.NVM0
+; Element-wise vector opcodes on every tail length, n = 0 included
+; Prints "." for every check that passes and "F" for one that fails, then
+; exits with the number of failures. Needs --heap 1.
+
+
+; a: INT32_MIN and on, wrapping
+push 4096
+push 40
+push -2147483648
+push 610839777
+callf fill
+; b: INT32_MAX and down, wrapping
+push 8192
+push 40
+push 2147483647
+push -324508639
+callf fill
+
+; vadd, n = 0
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 0
+vadd
+push 16384
+push 0
+vsum
+push 0
+callf check
+push 16384
+load32
+push -1414812757
+callf check
+
+; vadd, n = 1
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 1
+vadd
+push 16384
+push 1
+vsum
+push -1
+callf check
+push 16384
+load32
+push -1
+callf check
+push 16388
+load32
+push -1414812757
+callf check
+
+; vadd, n = 3
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 3
+vadd
+push 16384
+push 3
+vsum
+push 858993411
+callf check
+push 16392
+load32
+push 572662275
+callf check
+push 16396
+load32
+push -1414812757
+callf check
+
+; vadd, n = 4
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 4
+vadd
+push 16384
+push 4
+vsum
+push 1717986824
+callf check
+push 16396
+load32
+push 858993413
+callf check
+push 16400
+load32
+push -1414812757
+callf check
+
+; vadd, n = 5
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 5
+vadd
+push 16384
+push 5
+vsum
+push -1431655921
+callf check
+push 16400
+load32
+push 1145324551
+callf check
+push 16404
+load32
+push -1414812757
+callf check
+
+; vadd, n = 7
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 7
+vadd
+push 16384
+push 7
+vsum
+push 1717986595
+callf check
+push 16408
+load32
+push 1717986827
+callf check
+push 16412
+load32
+push -1414812757
+callf check
+
+; vadd, n = 8
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 8
+vadd
+push 16384
+push 8
+vsum
+push -572662736
+callf check
+push 16412
+load32
+push 2004317965
+callf check
+push 16416
+load32
+push -1414812757
+callf check
+
+; vadd, n = 9
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 9
+vadd
+push 16384
+push 9
+vsum
+push 1717986367
+callf check
+push 16416
+load32
+push -2004318193
+callf check
+push 16420
+load32
+push -1414812757
+callf check
+
+; vadd, n = 15
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 15
+vadd
+push 16384
+push 15
+vsum
+push -1597
+callf check
+push 16440
+load32
+push -286331365
+callf check
+push 16444
+load32
+push -1414812757
+callf check
+
+; vadd, n = 16
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 16
+vadd
+push 16384
+push 16
+vsum
+push -1824
+callf check
+push 16444
+load32
+push -227
+callf check
+push 16448
+load32
+push -1414812757
+callf check
+
+; vadd, n = 17
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 17
+vadd
+push 16384
+push 17
+vsum
+push 286329087
+callf check
+push 16448
+load32
+push 286330911
+callf check
+push 16452
+load32
+push -1414812757
+callf check
+
+; vadd, n = 33
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 33
+vadd
+push 16384
+push 33
+vsum
+push 858985471
+callf check
+push 16512
+load32
+push 572661823
+callf check
+push 16516
+load32
+push -1414812757
+callf check
+
+; vsub, n = 0
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 0
+vsub
+push 16384
+push 0
+vsum
+push 0
+callf check
+push 16384
+load32
+push -1414812757
+callf check
+
+; vsub, n = 1
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 1
+vsub
+push 16384
+push 1
+vsum
+push 1
+callf check
+push 16384
+load32
+push 1
+callf check
+push 16388
+load32
+push -1414812757
+callf check
+
+; vsub, n = 3
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 3
+vsub
+push 16384
+push 3
+vsum
+push -1488922045
+callf check
+push 16392
+load32
+push 1870696833
+callf check
+push 16396
+load32
+push -1414812757
+callf check
+
+; vsub, n = 4
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 4
+vsub
+push 16384
+push 4
+vsum
+push 1317123204
+callf check
+push 16396
+load32
+push -1488922047
+callf check
+push 16400
+load32
+push -1414812757
+callf check
+
+; vsub, n = 5
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 5
+vsub
+push 16384
+push 5
+vsum
+push 763549573
+callf check
+push 16400
+load32
+push -553573631
+callf check
+push 16404
+load32
+push -1414812757
+callf check
+
+; vsub, n = 7
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 7
+vsub
+push 16384
+push 7
+vsum
+push -1832519737
+callf check
+push 16408
+load32
+push 1317123201
+callf check
+push 16412
+load32
+push -1414812757
+callf check
+
+; vsub, n = 8
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 8
+vsub
+push 16384
+push 8
+vsum
+push 419951880
+callf check
+push 16412
+load32
+push -2042495679
+callf check
+push 16416
+load32
+push -1414812757
+callf check
+
+; vsub, n = 9
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 9
+vsub
+push 16384
+push 9
+vsum
+push -687195383
+callf check
+push 16416
+load32
+push -1107147263
+callf check
+push 16420
+load32
+push -1414812757
+callf check
+
+; vsub, n = 15
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 15
+vsub
+push 16384
+push 15
+vsum
+push -572664113
+callf check
+push 16440
+load32
+push 209975937
+callf check
+push 16444
+load32
+push -1414812757
+callf check
+
+; vsub, n = 16
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 16
+vsub
+push 16384
+push 16
+vsum
+push 572660240
+callf check
+push 16444
+load32
+push 1145324353
+callf check
+push 16448
+load32
+push -1414812757
+callf check
+
+; vsub, n = 17
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 17
+vsub
+push 16384
+push 17
+vsum
+push -1641634287
+callf check
+push 16448
+load32
+push 2080672769
+callf check
+push 16452
+load32
+push -1414812757
+callf check
+
+; vsub, n = 33
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 33
+vsub
+push 16384
+push 33
+vsum
+push -57275359
+callf check
+push 16512
+load32
+push -133621759
+callf check
+push 16516
+load32
+push -1414812757
+callf check
+
+; vmul, n = 0
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 0
+vmul
+push 16384
+push 0
+vsum
+push 0
+callf check
+push 16384
+load32
+push -1414812757
+callf check
+
+; vmul, n = 1
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 1
+vmul
+push 16384
+push 1
+vsum
+push -2147483648
+callf check
+push 16384
+load32
+push -2147483648
+callf check
+push 16388
+load32
+push -1414812757
+callf check
+
+; vmul, n = 3
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 3
+vmul
+push 16384
+push 3
+vsum
+push 1512888930
+callf check
+push 16392
+load32
+push 166156866
+callf check
+push 16396
+load32
+push -1414812757
+callf check
+
+; vmul, n = 4
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 4
+vmul
+push 16384
+push 4
+vsum
+push -2028836664
+callf check
+push 16396
+load32
+push 753241702
+callf check
+push 16400
+load32
+push -1414812757
+callf check
+
+; vmul, n = 5
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 5
+vmul
+push 16384
+push 5
+vsum
+push -1068333740
+callf check
+push 16400
+load32
+push 960502924
+callf check
+push 16404
+load32
+push -1414812757
+callf check
+
+; vmul, n = 7
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 7
+vmul
+push 16384
+push 7
+vsum
+push -44838682
+callf check
+push 16408
+load32
+push 235554526
+callf check
+push 16412
+load32
+push -1414812757
+callf check
+
+; vmul, n = 8
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 8
+vmul
+push 16384
+push 8
+vsum
+push -741493776
+callf check
+push 16412
+load32
+push -696655094
+callf check
+push 16416
+load32
+push -1414812757
+callf check
+
+; vmul, n = 9
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 9
+vmul
+push 16384
+push 9
+vsum
+push 1544785192
+callf check
+push 16416
+load32
+push -2008688328
+callf check
+push 16420
+load32
+push -1414812757
+callf check
+
+; vmul, n = 15
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 15
+vmul
+push 16384
+push 15
+vsum
+push 799377070
+callf check
+push 16440
+load32
+push -677314442
+callf check
+push 16444
+load32
+push -1414812757
+callf check
+
+; vmul, n = 16
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 16
+vmul
+push 16384
+push 16
+vsum
+push 446231392
+callf check
+push 16444
+load32
+push -353145678
+callf check
+push 16448
+load32
+push -1414812757
+callf check
+
+; vmul, n = 17
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 17
+vmul
+push 16384
+push 17
+vsum
+push 37430864
+callf check
+push 16448
+load32
+push -408800528
+callf check
+push 16452
+load32
+push -1414812757
+callf check
+
+; vmul, n = 33
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 33
+vmul
+push 16384
+push 33
+vsum
+push -1885959008
+callf check
+push 16512
+load32
+push -1415682080
+callf check
+push 16516
+load32
+push -1414812757
+callf check
+
+; vmin, n = 0
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 0
+vmin
+push 16384
+push 0
+vsum
+push 0
+callf check
+push 16384
+load32
+push -1414812757
+callf check
+
+; vmin, n = 1
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 1
+vmin
+push 16384
+push 1
+vsum
+push -2147483648
+callf check
+push 16384
+load32
+push -2147483648
+callf check
+push 16388
+load32
+push -1414812757
+callf check
+
+; vmin, n = 3
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 3
+vmin
+push 16384
+push 3
+vsum
+push -314964317
+callf check
+push 16392
+load32
+push -925804094
+callf check
+push 16396
+load32
+push -1414812757
+callf check
+
+; vmin, n = 4
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 4
+vmin
+push 16384
+push 4
+vsum
+push -629928634
+callf check
+push 16396
+load32
+push -314964317
+callf check
+push 16400
+load32
+push -1414812757
+callf check
+
+; vmin, n = 5
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 5
+vmin
+push 16384
+push 5
+vsum
+push -334053174
+callf check
+push 16400
+load32
+push 295875460
+callf check
+push 16404
+load32
+push -1414812757
+callf check
+
+; vmin, n = 7
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 7
+vmin
+push 16384
+push 7
+vsum
+push 391319091
+callf check
+push 16408
+load32
+push 200431813
+callf check
+push 16412
+load32
+push -1414812757
+callf check
+
+; vmin, n = 8
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 8
+vmin
+push 16384
+push 8
+vsum
+push 267242265
+callf check
+push 16412
+load32
+push -124076826
+callf check
+push 16416
+load32
+push -1414812757
+callf check
+
+; vmin, n = 9
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 9
+vmin
+push 16384
+push 9
+vsum
+push -1288490463
+callf check
+push 16416
+load32
+push -1555732728
+callf check
+push 16420
+load32
+push -1414812757
+callf check
+
+; vmin, n = 15
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 15
+vmin
+push 16384
+push 15
+vsum
+push 1918418369
+callf check
+push 16440
+load32
+push 1899329997
+callf check
+push 16444
+load32
+push -1414812757
+callf check
+
+; vmin, n = 16
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 16
+vmin
+push 16384
+push 16
+vsum
+push 343596784
+callf check
+push 16444
+load32
+push -1574821585
+callf check
+push 16448
+load32
+push -1414812757
+callf check
+
+; vmin, n = 17
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 17
+vmin
+push 16384
+push 17
+vsum
+push -620385024
+callf check
+push 16448
+load32
+push -963981808
+callf check
+push 16452
+load32
+push -1414812757
+callf check
+
+; vmin, n = 33
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 33
+vmin
+push 16384
+push 33
+vsum
+push 429492736
+callf check
+push 16512
+load32
+push 219520032
+callf check
+push 16516
+load32
+push -1414812757
+callf check
+
+; vmax, n = 0
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 0
+vmax
+push 16384
+push 0
+vsum
+push 0
+callf check
+push 16384
+load32
+push -1414812757
+callf check
+
+; vmax, n = 1
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 1
+vmax
+push 16384
+push 1
+vsum
+push 2147483647
+callf check
+push 16384
+load32
+push 2147483647
+callf check
+push 16388
+load32
+push -1414812757
+callf check
+
+; vmax, n = 3
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 3
+vmax
+push 16384
+push 3
+vsum
+push 1173957728
+callf check
+push 16392
+load32
+push 1498466369
+callf check
+push 16396
+load32
+push -1414812757
+callf check
+
+; vmax, n = 4
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 4
+vmax
+push 16384
+push 4
+vsum
+push -1947051838
+callf check
+push 16396
+load32
+push 1173957730
+callf check
+push 16400
+load32
+push -1414812757
+callf check
+
+; vmax, n = 5
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 5
+vmax
+push 16384
+push 5
+vsum
+push -1097602747
+callf check
+push 16400
+load32
+push 849449091
+callf check
+push 16404
+load32
+push -1414812757
+callf check
+
+; vmax, n = 7
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 7
+vmax
+push 16384
+push 7
+vsum
+push 1326667504
+callf check
+push 16408
+load32
+push 1517555014
+callf check
+push 16412
+load32
+push -1414812757
+callf check
+
+; vmax, n = 8
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 8
+vmax
+push 16384
+push 8
+vsum
+push -839905001
+callf check
+push 16412
+load32
+push 2128394791
+callf check
+push 16416
+load32
+push -1414812757
+callf check
+
+; vmax, n = 9
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 9
+vmax
+push 16384
+push 9
+vsum
+push -1288490466
+callf check
+push 16416
+load32
+push -448585465
+callf check
+push 16420
+load32
+push -1414812757
+callf check
+
+; vmax, n = 15
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 15
+vmax
+push 16384
+push 15
+vsum
+push -1918419966
+callf check
+push 16440
+load32
+push 2109305934
+callf check
+push 16444
+load32
+push -1414812757
+callf check
+
+; vmax, n = 16
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 16
+vmax
+push 16384
+push 16
+vsum
+push -343598608
+callf check
+push 16444
+load32
+push 1574821358
+callf check
+push 16448
+load32
+push -1414812757
+callf check
+
+; vmax, n = 17
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 17
+vmax
+push 16384
+push 17
+vsum
+push 906714111
+callf check
+push 16448
+load32
+push 1250312719
+callf check
+push 16452
+load32
+push -1414812757
+callf check
+
+; vmax, n = 33
+push 16384
+push 171
+push 256
+memset
+push 16384
+push 4096
+push 8192
+push 33
+vmax
+push 16384
+push 33
+vsum
+push 429492735
+callf check
+push 16512
+load32
+push 353141791
+callf check
+push 16516
+load32
+push -1414812757
+callf check
+
+push 10
+syscall print
+load 31
+syscall exit
+
+; value expected -> prints the result, counts a failure in local 31
+check:
+    eq
+    dup
+    push -24
+    mul
+    push 70
+    add
+    syscall print
+    push 1
+    swap
+    sub
+    load 31
+    add
+    store 31
+    retf
+
+; addr n value step -> addr[i] = value + i * step, wrapping
+fill:
+    store 23
+    store 22
+    store 21
+    store 20
+fill_loop:
+    load 21
+    push 0
+    gt
+    jz fill_done
+    load 20
+    load 22
+    store32
+    load 20
+    push 4
+    add
+    store 20
+    load 22
+    load 23
+    add
+    store 22
+    load 21
+    push 1
+    sub
+    store 21
+    jmp fill_loop
+fill_done:
+    retf
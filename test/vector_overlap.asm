@@ -0,0 +1,2218 @@
+.NVM0
+; Element-wise vector opcodes whose dst overlaps a or b, which behave like a
+; loop from the first element
+; Prints "." for every check that passes and "F" for one that fails, then
+; exits with the number of failures. Needs --heap 1.
+
+
+; vadd, n = 1, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 1
+vadd
+push 4096
+push 2
+vsum
+push 606480431
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4100
+load32
+push 303240219
+callf check
+
+; vadd, n = 1, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 1
+vadd
+push 4096
+push 4
+vsum
+push 2071954314
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4108
+load32
+push 303240219
+callf check
+
+; vadd, n = 1, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 1
+vadd
+push 4096
+push 9
+vsum
+push -2138467689
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4128
+load32
+push 303240219
+callf check
+
+; vadd, n = 1, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 1
+vadd
+push 4092
+push 2
+vsum
+push 606480431
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4092
+load32
+push 303240219
+callf check
+
+; vadd, n = 1, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 1
+vadd
+push 4096
+push 1026
+vsum
+push 1047238756
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8196
+load32
+push 303240219
+callf check
+
+; vadd, n = 1, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 1
+vadd
+push 4096
+push 1
+vsum
+push 303240219
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4096
+load32
+push 303240219
+callf check
+
+; vadd, n = 4, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 4
+vadd
+push 4096
+push 5
+vsum
+push 1516201100
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4112
+load32
+push 303240222
+callf check
+
+; vadd, n = 4, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 4
+vadd
+push 4096
+push 7
+vsum
+push -454298877
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4120
+load32
+push 303240217
+callf check
+
+; vadd, n = 4, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 4
+vadd
+push 4096
+push 12
+vsum
+push 489239868
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4140
+load32
+push 1162233669
+callf check
+
+; vadd, n = 4, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 4
+vadd
+push 4092
+push 5
+vsum
+push -201785849
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4104
+load32
+push 1162233669
+callf check
+
+; vadd, n = 4, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 4
+vadd
+push 4096
+push 1029
+vsum
+push -1950222377
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8208
+load32
+push -1364019523
+callf check
+
+; vadd, n = 4, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 4
+vadd
+push 4096
+push 4
+vsum
+push -1364019520
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4108
+load32
+push 1162233669
+callf check
+
+; vadd, n = 5, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 5
+vadd
+push 4096
+push 6
+vsum
+push 1819441317
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4116
+load32
+push 303240217
+callf check
+
+; vadd, n = 5, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 5
+vadd
+push 4096
+push 8
+vsum
+push 135272487
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4124
+load32
+push 589571364
+callf check
+
+; vadd, n = 5, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 5
+vadd
+push 4096
+push 13
+vsum
+push 1937804687
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4144
+load32
+push 1448564819
+callf check
+
+; vadd, n = 5, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 5
+vadd
+push 4092
+push 6
+vsum
+push 1533110123
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4108
+load32
+push 1448564819
+callf check
+
+; vadd, n = 5, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 5
+vadd
+push 4096
+push 1030
+vsum
+push -1865677076
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8212
+load32
+push 84545301
+callf check
+
+; vadd, n = 5, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 5
+vadd
+push 4096
+push 5
+vsum
+push 84545299
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4112
+load32
+push 1448564819
+callf check
+
+; vadd, n = 9, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 9
+vadd
+push 4096
+push 10
+vsum
+push -1262565221
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4132
+load32
+push 303240167
+callf check
+
+; vadd, n = 9, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 9
+vadd
+push 4096
+push 12
+vsum
+push -1515078248
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4140
+load32
+push 875902494
+callf check
+
+; vadd, n = 9, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 9
+vadd
+push 4096
+push 17
+vsum
+push -285208346
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4160
+load32
+push 303240202
+callf check
+
+; vadd, n = 9, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 9
+vadd
+push 4092
+push 10
+vsum
+push -1548896377
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4124
+load32
+push -1701077877
+callf check
+
+; vadd, n = 9, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 9
+vadd
+push 4096
+push 1034
+vsum
+push 1504906244
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8228
+load32
+push 152181535
+callf check
+
+; vadd, n = 9, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 9
+vadd
+push 4096
+push 9
+vsum
+push 152181483
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4128
+load32
+push -1701077877
+callf check
+
+; vadd, n = 17, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 17
+vadd
+push 4096
+push 18
+vsum
+push 1163355143
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4164
+load32
+push 303239923
+callf check
+
+; vadd, n = 17, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 17
+vadd
+push 4096
+push 20
+vsum
+push -1379806305
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4172
+load32
+push 589571254
+callf check
+
+; vadd, n = 17, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 17
+vadd
+push 4096
+push 25
+vsum
+push 1568050753
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4192
+load32
+push 303240161
+callf check
+
+; vadd, n = 17, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 17
+vadd
+push 4092
+push 18
+vsum
+push 1736018527
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4156
+load32
+push 589571323
+callf check
+
+; vadd, n = 17, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 17
+vadd
+push 4096
+push 1042
+vsum
+push 1613097700
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8260
+load32
+push 1146447459
+callf check
+
+; vadd, n = 17, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 17
+vadd
+push 4096
+push 17
+vsum
+push 1146447163
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4160
+load32
+push 589571323
+callf check
+
+; vadd, n = 33, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 33
+vadd
+push 4096
+push 34
+vsum
+push 1720218591
+callf check
+push 4100
+load32
+push 303240219
+callf check
+push 4228
+load32
+push 303238859
+callf check
+
+; vadd, n = 33, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 33
+vadd
+push 4096
+push 36
+vsum
+push -250272488
+callf check
+push 4108
+load32
+push 303240219
+callf check
+push 4236
+load32
+push 875902034
+callf check
+
+; vadd, n = 33, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 33
+vadd
+push 4096
+push 41
+vsum
+push 979600155
+callf check
+push 4128
+load32
+push 303240219
+callf check
+push 4256
+load32
+push 303240007
+callf check
+
+; vadd, n = 33, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 33
+vadd
+push 4092
+push 34
+vsum
+push -1143080305
+callf check
+push 4092
+load32
+push 303240219
+callf check
+push 4220
+load32
+push 875902427
+callf check
+
+; vadd, n = 33, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 33
+vadd
+push 4096
+push 1058
+vsum
+push -1223265692
+callf check
+push 8196
+load32
+push 303240219
+callf check
+push 8324
+load32
+push -2018981461
+callf check
+
+; vadd, n = 33, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 33
+vadd
+push 4096
+push 33
+vsum
+push -2018982821
+callf check
+push 4096
+load32
+push 303240219
+callf check
+push 4224
+load32
+push 875902427
+callf check
+
+; vmin, n = 1, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 1
+vmin
+push 4096
+push 2
+vsum
+push 303240219
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4100
+load32
+push 7
+callf check
+
+; vmin, n = 1, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 1
+vmin
+push 4096
+push 4
+vsum
+push 1768714102
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4108
+load32
+push 7
+callf check
+
+; vmin, n = 1, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 1
+vmin
+push 4096
+push 9
+vsum
+push 1853259395
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4128
+load32
+push 7
+callf check
+
+; vmin, n = 1, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 1
+vmin
+push 4092
+push 2
+vsum
+push 303240219
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4092
+load32
+push 7
+callf check
+
+; vmin, n = 1, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 1
+vmin
+push 4096
+push 1026
+vsum
+push 743998544
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8196
+load32
+push 7
+callf check
+
+; vmin, n = 1, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 1
+vmin
+push 4096
+push 1
+vsum
+push 7
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4096
+load32
+push 7
+callf check
+
+; vmin, n = 4, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 4
+vmin
+push 4096
+push 5
+vsum
+push 303240222
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4112
+load32
+push -2
+callf check
+
+; vmin, n = 4, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 4
+vmin
+push 4096
+push 7
+vsum
+push 1768714105
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4120
+load32
+push -2
+callf check
+
+; vmin, n = 4, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 4
+vmin
+push 4096
+push 12
+vsum
+push 1853259398
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4140
+load32
+push -2
+callf check
+
+; vmin, n = 4, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 4
+vmin
+push 4092
+push 5
+vsum
+push 1162233681
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4104
+load32
+push -2
+callf check
+
+; vmin, n = 4, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 4
+vmin
+push 4096
+push 1029
+vsum
+push 743998565
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8208
+load32
+push 7
+callf check
+
+; vmin, n = 4, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 4
+vmin
+push 4096
+push 4
+vsum
+push 10
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4108
+load32
+push -2
+callf check
+
+; vmin, n = 5, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 5
+vmin
+push 4096
+push 6
+vsum
+push 303240217
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4116
+load32
+push -5
+callf check
+
+; vmin, n = 5, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 5
+vmin
+push 4096
+push 8
+vsum
+push 1768714100
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4124
+load32
+push -5
+callf check
+
+; vmin, n = 5, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 5
+vmin
+push 4096
+push 13
+vsum
+push 1853259393
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4144
+load32
+push -5
+callf check
+
+; vmin, n = 5, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 5
+vmin
+push 4092
+push 6
+vsum
+push 1448564829
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4108
+load32
+push -5
+callf check
+
+; vmin, n = 5, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 5
+vmin
+push 4096
+push 1030
+vsum
+push 743998572
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8212
+load32
+push 7
+callf check
+
+; vmin, n = 5, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 5
+vmin
+push 4096
+push 5
+vsum
+push 5
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4112
+load32
+push -5
+callf check
+
+; vmin, n = 9, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 9
+vmin
+push 4096
+push 10
+vsum
+push 303240167
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4132
+load32
+push -17
+callf check
+
+; vmin, n = 9, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 9
+vmin
+push 4096
+push 12
+vsum
+push 1768714050
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4140
+load32
+push -17
+callf check
+
+; vmin, n = 9, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 9
+vmin
+push 4096
+push 17
+vsum
+push -134149656
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4160
+load32
+push -17
+callf check
+
+; vmin, n = 9, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 9
+vmin
+push 4092
+push 10
+vsum
+push -1094597451
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4124
+load32
+push -1701077860
+callf check
+
+; vmin, n = 9, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 9
+vmin
+push 4096
+push 1034
+vsum
+push 1064147856
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8228
+load32
+push -1987409013
+callf check
+
+; vmin, n = 9, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 9
+vmin
+push 4096
+push 9
+vsum
+push 606480409
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4128
+load32
+push -1701077860
+callf check
+
+; vmin, n = 17, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 17
+vmin
+push 4096
+push 18
+vsum
+push 303239923
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4164
+load32
+push -41
+callf check
+
+; vmin, n = 17, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 17
+vmin
+push 4096
+push 20
+vsum
+push 1768713806
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4172
+load32
+push -41
+callf check
+
+; vmin, n = 17, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 17
+vmin
+push 4096
+push 25
+vsum
+push -2121558875
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4192
+load32
+push -41
+callf check
+
+; vmin, n = 17, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 17
+vmin
+push 4092
+push 18
+vsum
+push 1280596950
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4156
+load32
+push -41
+callf check
+
+; vmin, n = 17, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 17
+vmin
+push 4096
+push 1042
+vsum
+push -1950222360
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8260
+load32
+push -1987409013
+callf check
+
+; vmin, n = 17, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 17
+vmin
+push 4096
+push 17
+vsum
+push 691025586
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4160
+load32
+push -41
+callf check
+
+; vmin, n = 33, dst = a + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4100
+push 4096
+push 8192
+push 33
+vmin
+push 4096
+push 34
+vsum
+push 303238859
+callf check
+push 4100
+load32
+push 7
+callf check
+push 4228
+load32
+push -89
+callf check
+
+; vmin, n = 33, dst = a + 12
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4108
+push 4096
+push 8192
+push 33
+vmin
+push 4096
+push 36
+vsum
+push 1768712742
+callf check
+push 4108
+load32
+push 7
+callf check
+push 4236
+load32
+push -89
+callf check
+
+; vmin, n = 33, dst = a + 32
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4128
+push 4096
+push 8192
+push 33
+vmin
+push 4096
+push 41
+vsum
+push -1801410521
+callf check
+push 4128
+load32
+push 7
+callf check
+push 4256
+load32
+push -89
+callf check
+
+; vmin, n = 33, dst = a - 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4092
+push 4096
+push 8192
+push 33
+vmin
+push 4092
+push 34
+vsum
+push -2037014075
+callf check
+push 4092
+load32
+push 7
+callf check
+push 4220
+load32
+push -89
+callf check
+
+; vmin, n = 33, dst = b + 4
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 8196
+push 4096
+push 8192
+push 33
+vmin
+push 4096
+push 1058
+vsum
+push 610971789
+callf check
+push 8196
+load32
+push 7
+callf check
+push 8324
+load32
+push -1987409014
+callf check
+
+; vmin, n = 33, dst = a
+push 4032
+push 60
+push 16909060
+push 286331153
+callf fill
+push 8192
+push 40
+push 7
+push -3
+callf fill
+push 4096
+push 4096
+push 8192
+push 33
+vmin
+push 4096
+push 33
+vsum
+push 1382050705
+callf check
+push 4096
+load32
+push 7
+callf check
+push 4224
+load32
+push -89
+callf check
+
+push 10
+syscall print
+load 31
+syscall exit
+
+; value expected -> prints the result, counts a failure in local 31
+check:
+    eq
+    dup
+    push -24
+    mul
+    push 70
+    add
+    syscall print
+    push 1
+    swap
+    sub
+    load 31
+    add
+    store 31
+    retf
+
+; addr n value step -> addr[i] = value + i * step, wrapping
+fill:
+    store 23
+    store 22
+    store 21
+    store 20
+fill_loop:
+    load 21
+    push 0
+    gt
+    jz fill_done
+    load 20
+    load 22
+    store32
+    load 20
+    push 4
+    add
+    store 20
+    load 22
+    load 23
+    add
+    store 22
+    load 21
+    push 1
+    sub
+    store 21
+    jmp fill_loop
+fill_done:
+    retf
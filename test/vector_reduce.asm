@@ -0,0 +1,1292 @@
+.NVM0
+; Vector reductions on every tail length, n = 0 included
+; Prints "." for every check that passes and "F" for one that fails, then
+; exits with the number of failures. Needs --heap 1.
+
+
+; a: INT32_MIN and on, wrapping
+push 4096
+push 40
+push -2147483648
+push 610839777
+callf fill
+; b: INT32_MAX and down, wrapping
+push 8192
+push 40
+push 2147483647
+push -324508639
+callf fill
+; c: -6, -5, ..
+push 12288
+push 40
+push -6
+push 1
+callf fill
+
+; n = 0
+push 4096
+push 0
+vsum
+push 0
+callf check
+push 4096
+push 0
+vrmin
+push 2147483647
+callf check
+push 4096
+push 0
+vrmax
+push -2147483648
+callf check
+push 4096
+push 8192
+push 0
+vdot
+push 0
+callf check
+push 12288
+push 0
+push 0
+vcounteq
+push 0
+callf check
+push 4096
+push 0
+push 0
+vcountgt
+push 0
+callf check
+push 4096
+push 0
+push -1
+vcountlt
+push 0
+callf check
+push 4096
+push 0
+push -2147483648
+vcountgt
+push 0
+callf check
+push 4096
+push 0
+push 2147483647
+vcountlt
+push 0
+callf check
+push 12288
+push 0
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 0
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 0
+push 2
+vcountlt
+push 0
+callf check
+
+; n = 1
+push 4096
+push 1
+vsum
+push -2147483648
+callf check
+push 4096
+push 1
+vrmin
+push -2147483648
+callf check
+push 4096
+push 1
+vrmax
+push -2147483648
+callf check
+push 4096
+push 8192
+push 1
+vdot
+push -2147483648
+callf check
+push 12288
+push 1
+push 0
+vcounteq
+push 0
+callf check
+push 4096
+push 1
+push 0
+vcountgt
+push 0
+callf check
+push 4096
+push 1
+push -1
+vcountlt
+push 1
+callf check
+push 4096
+push 1
+push -2147483648
+vcountgt
+push 0
+callf check
+push 4096
+push 1
+push 2147483647
+vcountlt
+push 1
+callf check
+push 12288
+push 1
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 1
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 1
+push 2
+vcountlt
+push 1
+callf check
+; extremes in the last element
+push 12288
+push 2147483647
+store32
+push 12288
+push 1
+vrmax
+push 2147483647
+callf check
+push 12288
+push 1
+vrmin
+push 2147483647
+callf check
+push 12288
+push -2147483648
+store32
+push 12288
+push 1
+vrmin
+push -2147483648
+callf check
+push 12288
+push 1
+vrmax
+push -2147483648
+callf check
+push 12288
+push -6
+store32
+
+; n = 3
+push 4096
+push 3
+vsum
+push -314964317
+callf check
+push 4096
+push 3
+vrmin
+push -2147483648
+callf check
+push 4096
+push 3
+vrmax
+push -925804094
+callf check
+push 4096
+push 8192
+push 3
+vdot
+push 1512888930
+callf check
+push 12288
+push 3
+push 0
+vcounteq
+push 0
+callf check
+push 4096
+push 3
+push 0
+vcountgt
+push 0
+callf check
+push 4096
+push 3
+push -1
+vcountlt
+push 3
+callf check
+push 4096
+push 3
+push -2147483648
+vcountgt
+push 2
+callf check
+push 4096
+push 3
+push 2147483647
+vcountlt
+push 3
+callf check
+push 12288
+push 3
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 3
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 3
+push 2
+vcountlt
+push 3
+callf check
+; extremes in the last element
+push 12296
+push 2147483647
+store32
+push 12288
+push 3
+vrmax
+push 2147483647
+callf check
+push 12288
+push 3
+vrmin
+push -6
+callf check
+push 12296
+push -2147483648
+store32
+push 12288
+push 3
+vrmin
+push -2147483648
+callf check
+push 12288
+push 3
+vrmax
+push -5
+callf check
+push 12296
+push -4
+store32
+
+; n = 4
+push 4096
+push 4
+vsum
+push -629928634
+callf check
+push 4096
+push 4
+vrmin
+push -2147483648
+callf check
+push 4096
+push 4
+vrmax
+push -314964317
+callf check
+push 4096
+push 8192
+push 4
+vdot
+push -2028836664
+callf check
+push 12288
+push 4
+push 0
+vcounteq
+push 0
+callf check
+push 4096
+push 4
+push 0
+vcountgt
+push 0
+callf check
+push 4096
+push 4
+push -1
+vcountlt
+push 4
+callf check
+push 4096
+push 4
+push -2147483648
+vcountgt
+push 3
+callf check
+push 4096
+push 4
+push 2147483647
+vcountlt
+push 4
+callf check
+push 12288
+push 4
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 4
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 4
+push 2
+vcountlt
+push 4
+callf check
+; extremes in the last element
+push 12300
+push 2147483647
+store32
+push 12288
+push 4
+vrmax
+push 2147483647
+callf check
+push 12288
+push 4
+vrmin
+push -6
+callf check
+push 12300
+push -2147483648
+store32
+push 12288
+push 4
+vrmin
+push -2147483648
+callf check
+push 12288
+push 4
+vrmax
+push -4
+callf check
+push 12300
+push -3
+store32
+
+; n = 5
+push 4096
+push 5
+vsum
+push -334053174
+callf check
+push 4096
+push 5
+vrmin
+push -2147483648
+callf check
+push 4096
+push 5
+vrmax
+push 295875460
+callf check
+push 4096
+push 8192
+push 5
+vdot
+push -1068333740
+callf check
+push 12288
+push 5
+push 0
+vcounteq
+push 0
+callf check
+push 4096
+push 5
+push 0
+vcountgt
+push 1
+callf check
+push 4096
+push 5
+push -1
+vcountlt
+push 4
+callf check
+push 4096
+push 5
+push -2147483648
+vcountgt
+push 4
+callf check
+push 4096
+push 5
+push 2147483647
+vcountlt
+push 5
+callf check
+push 12288
+push 5
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 5
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 5
+push 2
+vcountlt
+push 5
+callf check
+; extremes in the last element
+push 12304
+push 2147483647
+store32
+push 12288
+push 5
+vrmax
+push 2147483647
+callf check
+push 12288
+push 5
+vrmin
+push -6
+callf check
+push 12304
+push -2147483648
+store32
+push 12288
+push 5
+vrmin
+push -2147483648
+callf check
+push 12288
+push 5
+vrmax
+push -3
+callf check
+push 12304
+push -2
+store32
+
+; n = 7
+push 4096
+push 7
+vsum
+push 2090217077
+callf check
+push 4096
+push 7
+vrmin
+push -2147483648
+callf check
+push 4096
+push 7
+vrmax
+push 1517555014
+callf check
+push 4096
+push 8192
+push 7
+vdot
+push -44838682
+callf check
+push 12288
+push 7
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 7
+push 0
+vcountgt
+push 3
+callf check
+push 4096
+push 7
+push -1
+vcountlt
+push 4
+callf check
+push 4096
+push 7
+push -2147483648
+vcountgt
+push 6
+callf check
+push 4096
+push 7
+push 2147483647
+vcountlt
+push 7
+callf check
+push 12288
+push 7
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 7
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 7
+push 2
+vcountlt
+push 7
+callf check
+; extremes in the last element
+push 12312
+push 2147483647
+store32
+push 12288
+push 7
+vrmax
+push 2147483647
+callf check
+push 12288
+push 7
+vrmin
+push -6
+callf check
+push 12312
+push -2147483648
+store32
+push 12288
+push 7
+vrmin
+push -2147483648
+callf check
+push 12288
+push 7
+vrmax
+push -1
+callf check
+push 12312
+push 0
+store32
+
+; n = 8
+push 4096
+push 8
+vsum
+push -76355428
+callf check
+push 4096
+push 8
+vrmin
+push -2147483648
+callf check
+push 4096
+push 8
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 8
+vdot
+push -741493776
+callf check
+push 12288
+push 8
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 8
+push 0
+vcountgt
+push 4
+callf check
+push 4096
+push 8
+push -1
+vcountlt
+push 4
+callf check
+push 4096
+push 8
+push -2147483648
+vcountgt
+push 7
+callf check
+push 4096
+push 8
+push 2147483647
+vcountlt
+push 8
+callf check
+push 12288
+push 8
+push 2
+vcounteq
+push 0
+callf check
+push 12288
+push 8
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 8
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12316
+push 2147483647
+store32
+push 12288
+push 8
+vrmax
+push 2147483647
+callf check
+push 12288
+push 8
+vrmin
+push -6
+callf check
+push 12316
+push -2147483648
+store32
+push 12288
+push 8
+vrmin
+push -2147483648
+callf check
+push 12288
+push 8
+vrmax
+push 0
+callf check
+push 12316
+push 1
+store32
+
+; n = 9
+push 4096
+push 9
+vsum
+push -1632088156
+callf check
+push 4096
+push 9
+vrmin
+push -2147483648
+callf check
+push 4096
+push 9
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 9
+vdot
+push 1544785192
+callf check
+push 12288
+push 9
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 9
+push 0
+vcountgt
+push 4
+callf check
+push 4096
+push 9
+push -1
+vcountlt
+push 5
+callf check
+push 4096
+push 9
+push -2147483648
+vcountgt
+push 8
+callf check
+push 4096
+push 9
+push 2147483647
+vcountlt
+push 9
+callf check
+push 12288
+push 9
+push 2
+vcounteq
+push 1
+callf check
+push 12288
+push 9
+push 2
+vcountgt
+push 0
+callf check
+push 12288
+push 9
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12320
+push 2147483647
+store32
+push 12288
+push 9
+vrmax
+push 2147483647
+callf check
+push 12288
+push 9
+vrmin
+push -6
+callf check
+push 12320
+push -2147483648
+store32
+push 12288
+push 9
+vrmin
+push -2147483648
+callf check
+push 12288
+push 9
+vrmax
+push 1
+callf check
+push 12320
+push 2
+store32
+
+; n = 15
+push 4096
+push 15
+vsum
+push 1861150793
+callf check
+push 4096
+push 15
+vrmin
+push -2147483648
+callf check
+push 4096
+push 15
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 15
+vdot
+push 799377070
+callf check
+push 12288
+push 15
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 15
+push 0
+vcountgt
+push 8
+callf check
+push 4096
+push 15
+push -1
+vcountlt
+push 7
+callf check
+push 4096
+push 15
+push -2147483648
+vcountgt
+push 14
+callf check
+push 4096
+push 15
+push 2147483647
+vcountlt
+push 15
+callf check
+push 12288
+push 15
+push 2
+vcounteq
+push 1
+callf check
+push 12288
+push 15
+push 2
+vcountgt
+push 6
+callf check
+push 12288
+push 15
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12344
+push 2147483647
+store32
+push 12288
+push 15
+vrmax
+push 2147483647
+callf check
+push 12288
+push 15
+vrmin
+push -6
+callf check
+push 12344
+push -2147483648
+store32
+push 12288
+push 15
+vrmin
+push -2147483648
+callf check
+push 12288
+push 15
+vrmax
+push 7
+callf check
+push 12344
+push 8
+store32
+
+; n = 16
+push 4096
+push 16
+vsum
+push 286329208
+callf check
+push 4096
+push 16
+vrmin
+push -2147483648
+callf check
+push 4096
+push 16
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 16
+vdot
+push 446231392
+callf check
+push 12288
+push 16
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 16
+push 0
+vcountgt
+push 8
+callf check
+push 4096
+push 16
+push -1
+vcountlt
+push 8
+callf check
+push 4096
+push 16
+push -2147483648
+vcountgt
+push 15
+callf check
+push 4096
+push 16
+push 2147483647
+vcountlt
+push 16
+callf check
+push 12288
+push 16
+push 2
+vcounteq
+push 1
+callf check
+push 12288
+push 16
+push 2
+vcountgt
+push 7
+callf check
+push 12288
+push 16
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12348
+push 2147483647
+store32
+push 12288
+push 16
+vrmax
+push 2147483647
+callf check
+push 12288
+push 16
+vrmin
+push -6
+callf check
+push 12348
+push -2147483648
+store32
+push 12288
+push 16
+vrmin
+push -2147483648
+callf check
+push 12288
+push 16
+vrmax
+push 8
+callf check
+push 12348
+push 9
+store32
+
+; n = 17
+push 4096
+push 17
+vsum
+push -677652600
+callf check
+push 4096
+push 17
+vrmin
+push -2147483648
+callf check
+push 4096
+push 17
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 17
+vdot
+push 37430864
+callf check
+push 12288
+push 17
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 17
+push 0
+vcountgt
+push 8
+callf check
+push 4096
+push 17
+push -1
+vcountlt
+push 9
+callf check
+push 4096
+push 17
+push -2147483648
+vcountgt
+push 16
+callf check
+push 4096
+push 17
+push 2147483647
+vcountlt
+push 17
+callf check
+push 12288
+push 17
+push 2
+vcounteq
+push 1
+callf check
+push 12288
+push 17
+push 2
+vcountgt
+push 8
+callf check
+push 12288
+push 17
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12352
+push 2147483647
+store32
+push 12288
+push 17
+vrmax
+push 2147483647
+callf check
+push 12288
+push 17
+vrmin
+push -6
+callf check
+push 12352
+push -2147483648
+store32
+push 12288
+push 17
+vrmin
+push -2147483648
+callf check
+push 12288
+push 17
+vrmax
+push 9
+callf check
+push 12352
+push 10
+store32
+
+; n = 33
+push 4096
+push 33
+vsum
+push -1746628592
+callf check
+push 4096
+push 33
+vrmin
+push -2147483648
+callf check
+push 4096
+push 33
+vrmax
+push 2128394791
+callf check
+push 4096
+push 8192
+push 33
+vdot
+push -1885959008
+callf check
+push 12288
+push 33
+push 0
+vcounteq
+push 1
+callf check
+push 4096
+push 33
+push 0
+vcountgt
+push 17
+callf check
+push 4096
+push 33
+push -1
+vcountlt
+push 16
+callf check
+push 4096
+push 33
+push -2147483648
+vcountgt
+push 32
+callf check
+push 4096
+push 33
+push 2147483647
+vcountlt
+push 33
+callf check
+push 12288
+push 33
+push 2
+vcounteq
+push 1
+callf check
+push 12288
+push 33
+push 2
+vcountgt
+push 24
+callf check
+push 12288
+push 33
+push 2
+vcountlt
+push 8
+callf check
+; extremes in the last element
+push 12416
+push 2147483647
+store32
+push 12288
+push 33
+vrmax
+push 2147483647
+callf check
+push 12288
+push 33
+vrmin
+push -6
+callf check
+push 12416
+push -2147483648
+store32
+push 12288
+push 33
+vrmin
+push -2147483648
+callf check
+push 12288
+push 33
+vrmax
+push 25
+callf check
+push 12416
+push 26
+store32
+
+; wrapping: 33 x INT32_MAX and 33 x INT32_MAX * INT32_MAX
+push 16384
+push 33
+push 2147483647
+push 0
+callf fill
+push 16384
+push 33
+vsum
+push 2147483615
+callf check
+push 16384
+push 16384
+push 33
+vdot
+push 33
+callf check
+push 16384
+push 33
+push -2147483648
+push 0
+callf fill
+push 16384
+push 33
+vsum
+push -2147483648
+callf check
+push 16384
+push 16384
+push 33
+vdot
+push 0
+callf check
+
+push 10
+syscall print
+load 31
+syscall exit
+
+; value expected -> prints the result, counts a failure in local 31
+check:
+    eq
+    dup
+    push -24
+    mul
+    push 70
+    add
+    syscall print
+    push 1
+    swap
+    sub
+    load 31
+    add
+    store 31
+    retf
+
+; addr n value step -> addr[i] = value + i * step, wrapping
+fill:
+    store 23
+    store 22
+    store 21
+    store 20
+fill_loop:
+    load 21
+    push 0
+    gt
+    jz fill_done
+    load 20
+    load 22
+    store32
+    load 20
+    push 4
+    add
+    store 20
+    load 22
+    load 23
+    add
+    store 22
+    load 21
+    push 1
+    sub
+    store 21
+    jmp fill_loop
+fill_done:
+    retf